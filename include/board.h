@@ -8,6 +8,8 @@
 #define BOARD_H
 
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dac.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/exti.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/i2c.h>
@@ -20,6 +22,7 @@
 #define SERIAL_GPIO_TX_PIN	GPIO_USART1_TX
 #define SERIAL_USART		USART1
 #define SERIAL_USART_RCC	RCC_USART1
+#define SERIAL_USART_IRQ	NVIC_USART1_IRQ
 #define SERIAL_GPIO_RCC		RCC_GPIOA
 
 /* Temperature sensor */
@@ -31,11 +34,19 @@
 #define WH1602_GPIO_RCC		RCC_GPIOC
 #define WH1602_GPIO_PORT	GPIOC
 #define WH1602_RS_PIN		GPIO4
+#define WH1602_RW_PIN		0	/* tied to GND; no busy flag polling */
 #define WH1602_EN_PIN		GPIO5
 #define WH1602_DB4_PIN		GPIO0
 #define WH1602_DB5_PIN		GPIO1
 #define WH1602_DB6_PIN		GPIO2
 #define WH1602_DB7_PIN		GPIO3
+#define WH1602_TIM_RCC		RCC_TIM7
+#define WH1602_TIM_BASE		TIM7
+#define WH1602_TIM_RST		RST_TIM7
+#define WH1602_DMA_RCC		RCC_DMA1
+#define WH1602_DMA_BASE		DMA1
+#define WH1602_DMA_CHANNEL	DMA_CHANNEL4	/* TIM7_UP request */
+#define WH1602_DMA_IRQ		NVIC_DMA1_CHANNEL4_IRQ
 
 /* Matrix keypad 2x2 */
 #define KBD_AFIO_RCC		RCC_AFIO
@@ -69,10 +80,29 @@
 #define DS3231_EXTI_TRIGGER	EXTI_TRIGGER_FALLING
 #define DS3231_EXTI_IRQ		NVIC_EXTI15_10_IRQ
 
-/* Buzzer */
-#define BUZZER_GPIO_RCC		RCC_GPIOC
-#define BUZZER_GPIO_PORT	GPIOC
-#define BUZZER_GPIO_PIN		GPIO12
+/* Buzzer: driven by TIM4_CH1 PWM (PB6, no remap) */
+#define BUZZER_AFIO_RCC		RCC_AFIO
+#define BUZZER_GPIO_RCC		RCC_GPIOB
+#define BUZZER_GPIO_PORT	GPIOB
+#define BUZZER_GPIO_PIN		GPIO_TIM4_CH1
+#define BUZZER_TIM_RCC		RCC_TIM4
+#define BUZZER_TIM_BASE		TIM4
+#define BUZZER_TIM_RST		RST_TIM4
+#define BUZZER_TIM_OC		TIM_OC1
+
+/* Wavetable synth: DAC channel 2 output (PA5), fed by DMA on TIM6 update */
+#define SYNTH_GPIO_RCC		RCC_GPIOA
+#define SYNTH_GPIO_PORT		GPIOA
+#define SYNTH_GPIO_PIN		GPIO5
+#define SYNTH_DAC_RCC		RCC_DAC
+#define SYNTH_DAC_CHANNEL	DAC_CHANNEL2
+#define SYNTH_TIM_RCC		RCC_TIM6
+#define SYNTH_TIM_BASE		TIM6
+#define SYNTH_TIM_RST		RST_TIM6
+#define SYNTH_DMA_RCC		RCC_DMA1
+#define SYNTH_DMA_BASE		DMA1
+#define SYNTH_DMA_CHANNEL	DMA_CHANNEL3	/* TIM6_UP request */
+#define SYNTH_DMA_IRQ		NVIC_DMA1_CHANNEL3_IRQ
 
 int board_init(void);
 
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef CLOCK_FACE_H
+#define CLOCK_FACE_H
+
+#include <drivers/wh1602.h>
+
+/* Width of big digit, in LCD cells */
+#define CLOCK_FACE_DIGIT_WIDTH	3
+
+enum clock_face_icon {
+	ICON_DEGREE,
+	ICON_BELL,
+};
+
+void clock_face_put_icon(struct wh1602 *wh, int line, int col,
+			 enum clock_face_icon icon);
+void clock_face_big_time(struct wh1602 *wh, int col, int hour, int min);
+
+#endif /* CLOCK_FACE_H */
@@ -8,6 +8,8 @@
 
 /* Vector table size (=sizeof(vector_table) */
 #define CONFIG_VTOR_SIZE		0x150
+/* RAM left for main stack (MSP) after static data, bytes; checked on link */
+#define CONFIG_MAIN_STACK_SIZE		1024
 
 /* GPIO level transient time, usec */
 #define CONFIG_GPIO_STAB_DELAY		10
@@ -23,5 +25,23 @@
 #define CONFIG_SCHED_IDLE
 /* Enable profiler */
 #define CONFIG_SCHED_PROFILE
+/* Measure IRQs-off time of critical sections; needs CONFIG_SCHED_PROFILE */
+/*#define CONFIG_CRIT_PROFILE*/
+/* Preempt lower priority tasks; each task gets its own stack */
+/*#define CONFIG_SCHED_PREEMPT*/
+/* Task stack size, bytes; printk() (newlib vsnprintf) takes most of it */
+#define CONFIG_SCHED_STACK_SIZE		512
+
+/* ---- Tracing ---- */
+/* Record events to RAM ring buffer; needs CONFIG_SERIAL_CONSOLE */
+/*#define CONFIG_TRACE*/
+/* Ring buffer size, events (8 bytes each); power of 2 */
+#define CONFIG_TRACE_LEN		128
+/* Character to send to serial console to get the trace dump */
+#define CONFIG_TRACE_CMD		't'
+
+/* ---- Sound ---- */
+/* Play melodies with DAC wavetable synth instead of PWM buzzer */
+/*#define CONFIG_SOUND_DAC*/
 
 #endif /* CONFIG_COMMON_H */
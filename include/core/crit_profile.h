@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef CORE_CRIT_PROFILE_H
+#define CORE_CRIT_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Critical section statistics, one per enter_critical() or
+ * enter_critical_prio() call site
+ */
+struct crit_site {
+	const char *func;		/* function containing the section */
+	uint16_t line;			/* enter_critical*() line */
+	bool registered;		/* site is in the list of sites */
+	uint32_t count;			/* times IRQs were masked here */
+	uint32_t max;			/* longest masked time, CPU cycles */
+	uint64_t sum;			/* total masked time, CPU cycles */
+	struct crit_site *next;
+};
+
+#ifdef CONFIG_CRIT_PROFILE
+/* Called by enter_critical(): start timing if IRQs were enabled before */
+#define crit_profile_site_enter(flags)					\
+do {									\
+	static struct crit_site __crit_site = {				\
+		.func = __func__,					\
+		.line = __LINE__,					\
+	};								\
+									\
+	if (!((flags) & 1))						\
+		crit_profile_enter(&__crit_site);			\
+} while (0)
+
+/* Called by exit_critical() before IRQs are enabled back */
+#define crit_profile_site_exit(flags)					\
+do {									\
+	if (!((flags) & 1))						\
+		crit_profile_exit();					\
+} while (0)
+
+/*
+ * Called by enter_critical_prio(): start timing if no IRQs were masked by
+ * BASEPRI before, i.e. for the outermost section
+ */
+#define crit_profile_prio_site_enter(flags)				\
+do {									\
+	static struct crit_site __crit_site = {				\
+		.func = __func__,					\
+		.line = __LINE__,					\
+	};								\
+									\
+	if (!(flags))							\
+		crit_profile_prio_enter(&__crit_site);			\
+} while (0)
+
+/* Called by exit_critical_prio() before BASEPRI is restored */
+#define crit_profile_prio_site_exit(flags)				\
+do {									\
+	if (!(flags))							\
+		crit_profile_prio_exit();				\
+} while (0)
+
+int crit_profile_init(void);
+void crit_profile_enter(struct crit_site *site);
+void crit_profile_exit(void);
+void crit_profile_prio_enter(struct crit_site *site);
+void crit_profile_prio_exit(void);
+void crit_profile_restart(void);
+void crit_profile_report(void);
+#else
+#define crit_profile_site_enter(flags)	do { } while (0)
+#define crit_profile_site_exit(flags)	do { } while (0)
+#define crit_profile_prio_site_enter(flags)	do { } while (0)
+#define crit_profile_prio_site_exit(flags)	do { } while (0)
+
+static inline int crit_profile_init(void)
+{
+	return 0;
+}
+
+static inline void crit_profile_restart(void)
+{
+}
+
+static inline void crit_profile_report(void)
+{
+}
+#endif /* CONFIG_CRIT_PROFILE */
+
+#endif /* CORE_CRIT_PROFILE_H */
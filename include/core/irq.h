@@ -13,6 +13,28 @@ enum irqreturn {
 	IRQ_HANDLED	= BIT(0),	/* IRQ was handled by this device */
 };
 
+/*
+ * Interrupt priority map: NVIC priority levels of all IRQs used in firmware,
+ * lower level is more urgent. ISRs are ordered by deadline: the one that
+ * breaks first when delayed goes first, and it preempts the less urgent ISRs.
+ * Level 0 is left unused, so that any IRQ can be masked by
+ * enter_critical_prio(); SysTick stays at level 0 and is never masked by it.
+ *
+ * A critical section shared with ISRs takes the level of the most urgent of
+ * them as a ceiling, so that ISRs above it stay live during the section.
+ */
+enum irq_prio {
+	IRQ_PRIO_SYNTH = 1,	/* DAC DMA: next half of samples, within 2 ms */
+	IRQ_PRIO_LCD,		/* WH1602 DMA: next queued command */
+	IRQ_PRIO_SWTIMER,	/* TIM2: 5 ms tick, missing it slows timers */
+	IRQ_PRIO_KBD,		/* keypad EXTIs: debounced by swtimer anyway */
+	IRQ_PRIO_RTC,		/* DS3231 alarm EXTI: once a minute at most */
+	IRQ_PRIO_I2C,		/* I2C2: transfers are polled for now */
+	IRQ_PRIO_SERIAL,	/* USART1 RX: console commands */
+	/* PendSV (task switch) level: ceiling that masks no ISR */
+	IRQ_PRIO_TASKS = BIT(NVIC_PRIO_BITS) - 1,
+};
+
 typedef enum irqreturn irqreturn_t;
 typedef irqreturn_t (*irq_handler_t)(int irq, void *data);
 
@@ -24,6 +46,32 @@ struct irq_action {
 	struct irq_action *next;	/* list (shared pointer) */
 };
 
+/* Table of DEFINE_IRQ() actions, ".irq_actions" section (ld/kitchen.ld) */
+extern const struct irq_action __irq_actions_start[];
+extern const struct irq_action __irq_actions_end[];
+
+/**
+ * Request interrupt at build time.
+ *
+ * Action is kept in flash and hooked up in irq_init(), no irq_request() call
+ * is needed. It can't be freed. Only one DEFINE_IRQ() action per IRQ is
+ * allowed (irq_init() fails otherwise); its handler runs before ones added
+ * with irq_request() for the same IRQ.
+ *
+ * @param _name Action name (C identifier), must be unique
+ * @param _irq IRQ number (constant)
+ * @param _handler Interrupt handler function
+ * @param _data Private user data passed to @p _handler
+ */
+#define DEFINE_IRQ(_name, _irq, _handler, _data)			\
+const struct irq_action __irq_action_##_name				\
+__attribute__((section(".irq_actions"), used)) = {			\
+	.handler	= _handler,					\
+	.irq		= _irq,						\
+	.name		= #_name,					\
+	.data		= _data,					\
+}
+
 int irq_init(void);
 void irq_exit(void);
 int irq_request(struct irq_action *action);
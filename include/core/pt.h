@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef CORE_PT_H
+#define CORE_PT_H
+
+#include <core/sched.h>
+#include <core/swtimer.h>
+#include <stdbool.h>
+
+/*
+ * Protothreads: stackless coroutines on top of scheduler tasks.
+ *
+ * Task function wrapped in PT_BEGIN()..PT_END() can wait in the middle and
+ * continue from the same place on next run, instead of being rewritten as a
+ * state machine. Waiting returns from task function, so other tasks run
+ * meanwhile. Thread runs again when its task is set ready:
+ *   - PT_YIELD(): right away, on next scheduler round
+ *   - PT_WAIT_UNTIL(): by whoever makes the condition true, with
+ *     sched_set_ready(); condition is checked on each run
+ *   - PT_SLEEP_MS(): by swtimer, once the time is out (5 msec granularity)
+ *
+ * Limitations (resume point is a label address saved in struct pt):
+ *   - local variables are lost on waiting: keep the state in some object
+ *   - only one PT_* wait per source line
+ *
+ * Usage:
+ *
+ *	static void blink_task(void *data)
+ *	{
+ *		struct blink *obj = data;
+ *
+ *		PT_BEGIN(&obj->pt);
+ *		for (;;) {
+ *			led_toggle();
+ *			PT_SLEEP_MS(&obj->pt, 500);
+ *		}
+ *		PT_END(&obj->pt);
+ *	}
+ *
+ *	sched_add_task("blink", blink_task, &blink, &task_id);
+ *	pt_init(&blink.pt, task_id);
+ *	sched_set_ready(task_id);
+ */
+struct pt {
+	void *lc;			/* where to resume; NULL: from start */
+	bool yielded;			/* PT_YIELD() returned already */
+	int task_id;			/* task running the thread */
+	struct swtimer_sw_tim tim;	/* wakes the task after PT_SLEEP_MS() */
+};
+
+#define __PT_LABEL2(line)	pt_resume_##line
+#define __PT_LABEL(line)	__PT_LABEL2(line)
+
+/* Save resume point: next run of the thread continues from here */
+#define __PT_SET(pt)							\
+do {									\
+	__PT_LABEL(__LINE__):						\
+	(pt)->lc = &&__PT_LABEL(__LINE__);				\
+} while (0)
+
+/* Start of the thread body: jump to saved resume point, if any */
+#define PT_BEGIN(pt)							\
+do {									\
+	if ((pt)->lc)							\
+		goto *(pt)->lc;						\
+} while (0)
+
+/* End of the thread body: next run starts from PT_BEGIN() again */
+#define PT_END(pt)							\
+do {									\
+	(pt)->lc = NULL;						\
+	return;								\
+} while (0)
+
+/* Return until @p cond is true; task must be set ready to re-check it */
+#define PT_WAIT_UNTIL(pt, cond)						\
+do {									\
+	__PT_SET(pt);							\
+	if (!(cond))							\
+		return;							\
+} while (0)
+
+/* Let other tasks run, continue on next scheduler round */
+#define PT_YIELD(pt)							\
+do {									\
+	(pt)->yielded = false;						\
+	__PT_SET(pt);							\
+	if (!(pt)->yielded) {						\
+		(pt)->yielded = true;					\
+		sched_set_ready((pt)->task_id);				\
+		return;							\
+	}								\
+} while (0)
+
+/* Wait for @p msec (rounded up to SWTIMER_HW_OVERFLOW) */
+#define PT_SLEEP_MS(pt, msec)						\
+do {									\
+	pt_sleep(pt, msec);						\
+	PT_WAIT_UNTIL(pt, !pt_sleeping(pt));				\
+} while (0)
+
+int pt_init(struct pt *pt, int task_id);
+void pt_exit(struct pt *pt);
+void pt_sleep(struct pt *pt, int msec);
+
+/* Check if thread waits in PT_SLEEP_MS() */
+static inline bool pt_sleeping(const struct pt *pt)
+{
+	return pt->tim.active;
+}
+
+#endif /* CORE_PT_H */
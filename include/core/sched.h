@@ -14,11 +14,79 @@
 
 typedef void (*task_func_t)(void *data);
 
+/* Task description; ones defined with DEFINE_TASK() are kept in flash */
+struct sched_task_desc {
+	const char *name;		/* task name */
+	task_func_t func;		/* task function to run */
+	void *data;			/* user private data; passed to func */
+};
+
+/* Table of DEFINE_TASK() tasks, ".sched_tasks" section (ld/kitchen.ld) */
+extern const struct sched_task_desc __sched_tasks_start[];
+extern const struct sched_task_desc __sched_tasks_end[];
+
+/**
+ * Define task at build time.
+ *
+ * Task exists from the start: no sched_add_task() call and no name checks on
+ * boot. Such tasks take the first task slots, in link order; use TASK_ID() to
+ * get the task ID. They can't be deleted.
+ *
+ * @param _name Task name (C identifier), must be unique
+ * @param _func Task function
+ * @param _data Pointer to data to be passed to task function
+ */
+#define DEFINE_TASK(_name, _func, _data)				\
+const struct sched_task_desc __task_##_name				\
+__attribute__((section(".sched_tasks"), used)) = {			\
+	.name	= #_name,						\
+	.func	= _func,						\
+	.data	= _data,						\
+}
+
+/* Declare task defined with DEFINE_TASK() in another place */
+#define DECLARE_TASK(_name)						\
+	extern const struct sched_task_desc __task_##_name
+
+/*
+ * Get ID of task defined with DEFINE_TASK().
+ *
+ * Task position in ".sched_tasks" is only known after linking, so this is a
+ * difference of two addresses, computed at run time (a couple of
+ * instructions). It is not an integer constant expression: don't use it in
+ * static initializers, case labels or #if.
+ */
+#define TASK_ID(_name)	((int)(&__task_##_name - __sched_tasks_start) + 1)
+
 int sched_init(void);
 int sched_start(void) __attribute__((__noreturn__));
 int sched_add_task(const char *name, task_func_t func, void *data,
 		   int *task_id);
+int sched_add_periodic_task(const char *name, task_func_t func, void *data,
+			    int period, int phase, int *task_id);
 int sched_del_task(int task_id);
+void sched_tick(int msec);
 void sched_set_ready(int task_id);
+const char *sched_task_name(int task_id);
+
+#ifdef CONFIG_SCHED_PREEMPT
+/* Mutex with priority inheritance; zero-initialized one is unlocked */
+struct sched_mutex {
+	int owner;			/* task index + 1; 0 if unlocked */
+	uint32_t waiters;		/* tasks blocked on mutex, bit per task */
+};
+
+/* Counting semaphore; zero-initialized one is taken */
+struct sched_sem {
+	unsigned int count;
+	uint32_t waiters;		/* tasks blocked on semaphore */
+};
+
+void sched_set_priority(int task_id, uint8_t prio);
+void sched_mutex_lock(struct sched_mutex *m);
+void sched_mutex_unlock(struct sched_mutex *m);
+void sched_sem_wait(struct sched_sem *s);
+void sched_sem_post(struct sched_sem *s);
+#endif /* CONFIG_SCHED_PREEMPT */
 
 #endif /* CORE_SCHED_H */
@@ -8,6 +8,7 @@
 #define CORE_SWTIMER_H
 
 #include <libopencm3/stm32/rcc.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* HW timer granularity (min SW timer period), msec */
@@ -36,6 +37,33 @@ struct swtimer_sw_tim {
 	struct swtimer_sw_tim *next;
 };
 
+/* Table of DEFINE_SWTIMER() timers, ".swtimers" section (ld/kitchen.ld) */
+extern struct swtimer_sw_tim * const __swtimers_start[];
+extern struct swtimer_sw_tim * const __swtimers_end[];
+
+/**
+ * Define software timer at build time; it's started from the beginning.
+ *
+ * No swtimer_tim_register() call is needed: the framework walks the table of
+ * such timers in flash. Timer ID is assigned in swtimer_init() (such timers
+ * take the first IDs, in link order); the timer can't be deleted, only stopped.
+ *
+ * @param _name Name of struct swtimer_sw_tim variable to define
+ * @param _cb Function to call when timer overflows
+ * @param _data User private data passed to @p _cb
+ * @param _period Timer period, msec
+ */
+#define DEFINE_SWTIMER(_name, _cb, _data, _period)			\
+struct swtimer_sw_tim _name = {						\
+	.cb		= _cb,						\
+	.data		= _data,					\
+	.period		= _period,					\
+	.remaining	= _period,					\
+	.active		= true,						\
+};									\
+struct swtimer_sw_tim * const __swtimer_##_name				\
+__attribute__((section(".swtimers"), used)) = &_name
+
 /* Global swtimer fwk API */
 int swtimer_init(const struct swtimer_hw_tim *hw_tim);
 void swtimer_exit(void);
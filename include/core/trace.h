@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef CORE_TRACE_H
+#define CORE_TRACE_H
+
+#include <tools/common.h>
+#include <stdint.h>
+
+/* Event type; OR-ed with TRACE_END for the end of duration event */
+enum trace_type {
+	TRACE_IRQ = 1,		/* id: IRQ number */
+	TRACE_TASK,		/* id: task ID */
+	TRACE_SWTIMER,		/* id: swtimer ID */
+	TRACE_I2C_READ,		/* id: slave address; arg: register, result */
+	TRACE_I2C_WRITE,	/* id: slave address; arg: register, result */
+	TRACE_OW_RESET,		/* arg: result */
+	TRACE_OW_WRITE,		/* arg: byte */
+	TRACE_OW_READ,		/* arg: bits count, bits read */
+	TRACE_LCD_FLUSH,	/* arg: bytes queued to LCD */
+};
+
+#define TRACE_END		0x80
+
+/* Ring buffer entry, as it's sent by trace dump */
+struct trace_event {
+	uint32_t ts;		/* CPU cycles */
+	uint8_t type;		/* enum trace_type [| TRACE_END] */
+	uint8_t id;
+	uint16_t arg;
+};
+
+#ifdef CONFIG_TRACE
+int trace_init(void);
+void trace_event(uint8_t type, uint8_t id, uint16_t arg);
+#else
+static inline int trace_init(void)
+{
+	return 0;
+}
+
+static inline void trace_event(uint8_t type, uint8_t id, uint16_t arg)
+{
+	UNUSED(type);
+	UNUSED(id);
+	UNUSED(arg);
+}
+#endif /* CONFIG_TRACE */
+
+#define trace_begin(type, id, arg)	trace_event(type, id, arg)
+#define trace_end(type, id, arg)	trace_event((type) | TRACE_END, id, arg)
+
+#endif /* CORE_TRACE_H */
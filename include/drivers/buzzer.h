@@ -6,15 +6,25 @@
 #ifndef DRIVERS_BUZZER_H
 #define DRIVERS_BUZZER_H
 
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
 #include <stdint.h>
 
+/* Timer channel driving the buzzer (pin must be muxed to it) */
+struct buzzer_tim {
+	uint32_t base;			/* timer base address, e.g. TIM4 */
+	enum rcc_periph_rst rst;	/* timer reset, e.g. RST_TIM4 */
+	enum tim_oc_id oc;		/* output channel, e.g. TIM_OC1 */
+};
+
 struct buzzer {
-	uint32_t port;
-	uint16_t pin;
+	struct buzzer_tim tim;
+	uint32_t clk;			/* timer input clock, Hz */
 };
 
-int buzzer_init(struct buzzer *obj, uint32_t gpio_port, uint16_t gpio_pin);
+int buzzer_init(struct buzzer *obj, const struct buzzer_tim *tim);
 void buzzer_exit(struct buzzer *obj);
+void buzzer_start_sound(struct buzzer *obj, uint16_t freq);
 void buzzer_make_sound(struct buzzer *obj, uint16_t freq, uint16_t duration);
 void buzzer_stop_sound(struct buzzer *obj);
 
@@ -8,8 +8,12 @@
 #define DRIVERS_DS18B20_H
 
 #include <drivers/one_wire.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+/* Max. conversion time at 12-bit resolution (with margin), msec */
+#define DS18B20_CONV_TIME	900
+
 /* Contains parsed data from DS18B20 temperature sensor */
 struct ds18b20_temp {
 	uint16_t integer:12;
@@ -21,11 +25,16 @@ struct ds18b20 {
 	uint32_t port;
 	uint16_t pin;
 	struct ds18b20_temp temp;
+	int8_t degrees;		/* last read value, whole degrees (floor) */
+	bool window_set;	/* TH/TL are programmed around .degrees */
+	uint8_t skipped;	/* scratchpad reads skipped in a row */
 };
 
 int ds18b20_init(struct ds18b20 *obj);
 void ds18b20_exit(struct ds18b20 *obj);
 struct ds18b20_temp ds18b20_read_temp(struct ds18b20 *obj);
+void ds18b20_start_conversion(void);
+int ds18b20_update_temp(struct ds18b20 *obj);
 char *ds18b20_temp2str(struct ds18b20_temp *obj, char str[]);
 
 #endif /* DRIVERS_DS18B20_H */
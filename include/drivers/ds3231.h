@@ -68,6 +68,7 @@ int ds3231_init(struct ds3231 *obj, const struct ds3231_device *dev,
 		int epoch_year, ds3231_alarm_callback_t cb);
 void ds3231_exit(struct ds3231 *obj, const struct ds3231_device *dev);
 int ds3231_read_time(struct ds3231 *obj, struct rtc_time *tm);
+int ds3231_restore(struct ds3231 *obj, struct rtc_time *tm);
 int ds3231_set_time(struct ds3231 *obj, struct rtc_time *tm);
 int ds3231_set_alarm(struct ds3231 *obj);
 int ds3231_read_alarm(struct ds3231 *obj);
@@ -7,40 +7,76 @@
 #ifndef DRIVERS_KBD_H
 #define DRIVERS_KBD_H
 
+#include <core/irq.h>
+#include <core/swtimer.h>
 #include <libopencm3/stm32/exti.h>
 #include <libopencm3/cm3/nvic.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Matrix size; the same for all keyboard instances */
+#ifndef KBD_SCAN_LINES
 #define KBD_SCAN_LINES		2
+#endif
+#ifndef KBD_READ_LINES
 #define KBD_READ_LINES		2
-#define KEYS			4
+#endif
+#define KBD_KEYS		(KBD_SCAN_LINES * KBD_READ_LINES)
+#define KBD_QUEUE_LEN		16	/* must be power of 2 */
 
-typedef void (*kbd_btn_event_cb_t)(int button, bool pressed);
-typedef void (*kbd_btn_alarm_cb_t)(void);
+enum kbd_event {
+	KBD_EVENT_PRESS,	/* button pressed (debounced) */
+	KBD_EVENT_RELEASE,	/* button released (debounced) */
+	KBD_EVENT_LONG_PRESS,	/* button is held for long enough */
+	KBD_EVENT_REPEAT,	/* auto-repeat while button is held */
+};
+
+struct kbd_key_event {
+	uint32_t time;		/* timestamp, msec since boot */
+	uint8_t button;		/* button number */
+	uint8_t event;		/* enum kbd_event */
+};
+
+typedef void (*kbd_btn_event_cb_t)(const struct kbd_key_event *ev);
 
 struct kbd_gpio {
+	const char *name;			/* unique name of the keyboard */
 	uint32_t port;
 	uint16_t read[KBD_READ_LINES];		/* sampling lines */
 	uint16_t scan[KBD_SCAN_LINES];		/* scan lines */
-	int irq[KBD_READ_LINES];		/* external interrupt number */
 	enum exti_trigger_type trigger;		/* exti trigger condition */
 };
 
+/* Debounce and hold state of a single button */
+struct kbd_key {
+	uint8_t integrator;	/* debounce integrator, 0..KBD_DEBOUNCE_MAX */
+	bool pressed;		/* debounced state */
+	uint16_t hold_time;	/* msec since press, up to long press time */
+	uint16_t repeat_left;	/* msec till next auto-repeat */
+	uint16_t repeat_period;	/* current auto-repeat period, msec */
+};
+
 struct kbd {
 	struct kbd_gpio gpio;	/* user data */
 	kbd_btn_event_cb_t btn_event_cb;
-	kbd_btn_alarm_cb_t btn_alarm_cb;
 	uint16_t scan_mask;	/* cached mask for scan pins */
-	uint16_t read_mask;	/* cached mask for read pins */
-	bool pressed[KEYS];	/* storage for button pushed/released state */
+	uint16_t read_mask;	/* cached mask for read pins (and exti lines) */
+	struct irq_action action[KBD_READ_LINES]; /* one per distinct IRQ */
+	int irq_nr;		/* number of used entries in action[] */
+	struct swtimer_sw_tim swtim;	/* scan timer */
+	int scan_line;		/* scan line being driven now */
+	bool pressed_now[KBD_KEYS];	/* raw state sampled by current scan */
+	struct kbd_key keys[KBD_KEYS];	/* debounced state of buttons */
+	struct kbd_key_event queue[KBD_QUEUE_LEN]; /* events to be handled */
+	uint8_t head;		/* next event to handle */
+	uint8_t tail;		/* next free slot in queue */
+	uint16_t dropped;	/* events lost due to queue overflow */
 	int btn_task_id;	/* task id for task manager */
-	bool scan_pending;	/* Allows external interrupts */
-	int timer_id;		/* timer id for software timer */
+	bool scan_pending;	/* periodic scan is active, exti disabled */
 };
 
 int kbd_init(struct kbd *obj, const struct kbd_gpio *gpio,
-	     kbd_btn_event_cb_t btn_event_cb, kbd_btn_alarm_cb_t btn_alarm_cb);
+	     kbd_btn_event_cb_t btn_event_cb);
 void kbd_exit(struct kbd *obj);
 
 #endif /* DRIVERS_KBD_H */
@@ -7,6 +7,7 @@
 #ifndef DRIVERS_ONE_WIRE_H
 #define DRIVERS_ONE_WIRE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct ow {
@@ -18,6 +19,7 @@ int ow_init(struct ow *obj);
 void ow_exit(struct ow *obj);
 int ow_reset_pulse(struct ow *obj);
 void ow_write_byte(struct ow *obj, uint8_t byte);
+uint8_t ow_read_bits(struct ow *obj, size_t count);
 int8_t ow_read_byte(struct ow *obj);
 
 #endif /* DRIVERS_ONE_WIRE_H */
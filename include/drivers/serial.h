@@ -7,10 +7,15 @@
 #define DRIVERS_SERIAL_H
 
 #include <tools/common.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Called from ISR on each received character */
+typedef void (*serial_rx_callback_t)(char c);
+
 struct serial_params {
 	uint32_t uart;
+	uint8_t irq;
 	uint32_t baud;
 	uint32_t bits;
 	uint32_t stopbits;
@@ -22,6 +27,8 @@ struct serial_params {
 #ifdef CONFIG_SERIAL_CONSOLE
 int serial_init(struct serial_params *params);
 void serial_exit(void);
+int serial_set_rx_callback(serial_rx_callback_t cb);
+void serial_write(const void *buf, size_t len);
 #else
 static inline int serial_init(struct serial_params *params)
 {
@@ -32,6 +39,18 @@ static inline int serial_init(struct serial_params *params)
 static inline void serial_exit(void)
 {
 }
+
+static inline int serial_set_rx_callback(serial_rx_callback_t cb)
+{
+	UNUSED(cb);
+	return -1;
+}
+
+static inline void serial_write(const void *buf, size_t len)
+{
+	UNUSED(buf);
+	UNUSED(len);
+}
 #endif /* CONFIG_SERIAL_CONSOLE*/
 
 #endif /* DRIVERS_SERIAL_H */
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef DRIVERS_SYNTH_H
+#define DRIVERS_SYNTH_H
+
+#include <core/irq.h>
+#include <libopencm3/stm32/rcc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SYNTH_SAMPLE_RATE	16000	/* Hz */
+#define SYNTH_BLOCK_LEN		32	/* samples per DMA half-buffer */
+#define SYNTH_VOLUME_MAX	255
+
+enum synth_wave {
+	SYNTH_WAVE_SINE = 0,
+	SYNTH_WAVE_SQUARE,
+};
+
+/* Hardware used for sample output (see synth_init()) */
+struct synth_hw {
+	uint32_t tim;			/* sample rate timer base; e.g. TIM6 */
+	enum rcc_periph_rst tim_rst;	/* timer reset; e.g. RST_TIM6 */
+	uint32_t dma;			/* DMA controller; e.g. DMA1 */
+	uint8_t channel;		/* DMA channel for timer update request */
+	uint8_t irq;			/* DMA channel IRQ number */
+	int dac_channel;		/* DAC_CHANNEL1 or DAC_CHANNEL2 */
+};
+
+struct synth {
+	/* User data */
+	struct synth_hw hw;
+
+	/* Internal driver's data */
+	struct irq_action action;
+	const int16_t *wave;		/* wavetable, one period */
+	uint8_t wave_shift;		/* phase -> wavetable index shift */
+	uint16_t buf[2 * SYNTH_BLOCK_LEN]; /* circular DMA buffer */
+	uint32_t phase;			/* DDS phase accumulator */
+	uint32_t phase_inc;		/* phase step per sample (pitch) */
+	uint32_t pos;			/* samples played since note start */
+	uint32_t len;			/* note length, samples; 0 - silence */
+	uint32_t gain;			/* envelope * volume at end of block */
+	uint8_t volume;			/* master volume */
+	uint8_t vol_target;		/* volume ramp destination */
+	uint16_t vol_period;		/* volume ramp: blocks per 1 step */
+	uint16_t vol_cnt;		/* blocks left till next ramp step */
+	uint8_t idle;			/* silent blocks in a row */
+	bool running;			/* DMA is streaming samples */
+};
+
+int synth_init(struct synth *obj, const struct synth_hw *hw);
+void synth_exit(struct synth *obj);
+void synth_set_wave(struct synth *obj, enum synth_wave wave);
+void synth_play(struct synth *obj, uint16_t freq, uint16_t duration);
+void synth_stop(struct synth *obj);
+void synth_set_volume(struct synth *obj, uint8_t volume);
+void synth_ramp_volume(struct synth *obj, uint8_t volume, uint32_t time);
+
+#endif /* DRIVERS_SYNTH_H */
@@ -7,7 +7,10 @@
 #ifndef DRIVERS_WH1602_H
 #define DRIVERS_WH1602_H
 
+#include <core/irq.h>
 #include <tools/common.h>
+#include <libopencm3/stm32/rcc.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #define CURSOR_BLINK_OFF	0
@@ -29,12 +32,26 @@
 #define LINE_1			0
 #define LINE_2			0x1
 
+#define WH1602_ROWS		2
+#define WH1602_COLS		16
+
+/* CGRAM: custom characters 5x8 */
+#define WH1602_CGRAM_SLOTS	8
+#define WH1602_GLYPH_ROWS	8
+
+/* DMA engine parameters */
+#define WH1602_QUEUE_LEN	64	/* bytes to queue; must be power of 2 */
+#define WH1602_BYTE_WORDS	6	/* BSRR words per byte: 2 nibbles x 3 */
+
+typedef void (*wh1602_done_cb_t)(void *data);
+
 struct wh1602_gpio {
 	/* GPIO port */
 	uint32_t port;
 
 	/* GPIO pins */
 	uint16_t rs;
+	uint16_t rw;	/* optional; 0 if RW is tied low (no busy flag) */
 	uint16_t en;
 	uint16_t db4;
 	uint16_t db5;
@@ -42,6 +59,21 @@ struct wh1602_gpio {
 	uint16_t db7;
 };
 
+/* Hardware used for non-blocking output (see wh1602_dma_init()) */
+struct wh1602_dma {
+	uint32_t tim;			/* pacing timer base; e.g. TIM7 */
+	enum rcc_periph_rst tim_rst;	/* timer reset; e.g. RST_TIM7 */
+	uint32_t dma;			/* DMA controller; e.g. DMA1 */
+	uint8_t channel;		/* DMA channel for timer update request */
+	uint8_t irq;			/* DMA channel IRQ number */
+};
+
+/* Byte queued for DMA engine */
+struct wh1602_xfer {
+	uint8_t data;
+	uint8_t flags;
+};
+
 struct wh1602 {
 	/* User data */
 	struct wh1602_gpio gpio;
@@ -49,18 +81,48 @@ struct wh1602 {
 	/* Internal driver's data */
 	uint16_t pin_mask;	/* cached value: db4 | db5 | db6 | db7 */
 	uint16_t lookup[9];	/* mapping: data bit -> GPIO line */
+	uint8_t addr;		/* DDRAM address counter, as LCD sees it */
+	uint8_t ddram[WH1602_ROWS][WH1602_COLS]; /* what is shown on LCD */
+	uint8_t fb[WH1602_ROWS][WH1602_COLS];	/* frame to be shown on flush */
+	const uint8_t *cgram[WH1602_CGRAM_SLOTS]; /* glyphs resident in CGRAM */
+	uint8_t cgram_used;	/* mask of CGRAM slots used by current frame */
+
+	/* DMA engine data */
+	struct wh1602_dma dma;
+	struct irq_action action;
+	wh1602_done_cb_t done_cb;	/* called from ISR when queue drained */
+	void *done_data;		/* user data passed to done_cb */
+	uint32_t bsrr_nibble[16];	/* BSRR words: data nibble -> GPIO */
+	uint32_t words[WH1602_BYTE_WORDS]; /* DMA buffer for current byte */
+	struct wh1602_xfer queue[WH1602_QUEUE_LEN];
+	uint8_t head;			/* next free queue slot */
+	uint8_t tail;			/* next byte to send */
+	uint16_t pad_len;		/* exec delay for current byte, ticks */
+	bool bf_enabled;		/* poll busy flag instead of delays */
+	bool dma_enabled;		/* output goes through DMA engine */
+	bool busy;			/* DMA transfer is in progress */
+	bool pad;			/* waiting for current byte execution */
 };
 
 int wh1602_init(struct wh1602 *obj, const struct wh1602_gpio *gpio);
+int wh1602_dma_init(struct wh1602 *obj, const struct wh1602_dma *dma,
+		    wh1602_done_cb_t cb, void *cb_data);
+bool wh1602_busy(struct wh1602 *obj);
 void wh1602_exit(struct wh1602 *obj);
 void wh1602_clear_display(struct wh1602 *obj);
 void wh1602_return_home(struct wh1602 *obj);
 void wh1602_set_entry_mode(struct wh1602 *obj, int id, int sh);
 void wh1602_control_display(struct wh1602 *obj, int d, int c, int b);
 void wh1602_set_function(struct wh1602 *obj, int dl, int n, int f);
-void wh1602_set_address(struct wh1602 *obj, uint8_t addr);
-void wh1602_write_char(struct wh1602 *obj, uint8_t data);
+int wh1602_set_address(struct wh1602 *obj, uint8_t addr);
+int wh1602_write_char(struct wh1602 *obj, uint8_t data);
 void wh1602_print_str(struct wh1602 *obj, const char *str);
 void wh1602_set_line(struct wh1602 *obj, int line);
+void wh1602_fb_clear(struct wh1602 *obj);
+void wh1602_fb_put_char(struct wh1602 *obj, int line, int col, uint8_t c);
+void wh1602_fb_print_str(struct wh1602 *obj, int line, int col,
+			 const char *str);
+int wh1602_fb_flush(struct wh1602 *obj);
+int wh1602_glyph_get(struct wh1602 *obj, const uint8_t *glyph);
 
 #endif /* DRIVERS_WH1602_H */
@@ -9,7 +9,7 @@
 #include <note.h>
 #include <stddef.h>
 
-extern const struct note melody_alarm[];
-extern const size_t melody_alarm_len;
+extern const struct melody melodies[];
+extern const size_t melodies_nr;
 
 #endif /* MELODY_H */
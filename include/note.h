@@ -6,9 +6,41 @@
 #ifndef NOTE_H
 #define NOTE_H
 
+#include <tools/common.h>
+#include <stdint.h>
+
+/*
+ * Packed note format (1 or 2 bytes per note):
+ *
+ *   byte 0: [7] NOTE_EXT  [6:4] duration code  [3:0] pitch
+ *   byte 1: [7:4] zero    [3] NOTE_DOTTED      [2:0] octave
+ *
+ * Pitch is a semitone number counting from C (0..11), or NOTE_REST for pause;
+ * codes 12..14 are invalid and decoded as a pause.
+ * Duration code n means 1/2^n of the whole note (0..5: whole..1/32).
+ * Byte 1 is only present when NOTE_EXT is set; otherwise the note is not
+ * dotted and has the default octave of the melody.
+ */
+#define NOTE_EXT		BIT(7)
+#define NOTE_DUR_SHIFT		4
+#define NOTE_DUR_MASK		0x7
+#define NOTE_PITCH_MASK		0xf
+#define NOTE_REST		0xf
+#define NOTE_DOTTED		BIT(3)
+#define NOTE_OCTAVE_MASK	0x7
+
+/* Decoded note */
 struct note {
-	int tone;
-	int duration;
+	uint16_t tone;		/* frequency, Hz; 0 for pause */
+	uint16_t duration;	/* msec */
+};
+
+struct melody {
+	const char *name;
+	const uint8_t *notes;	/* packed notes */
+	uint16_t len;		/* size of notes[], bytes */
+	uint16_t whole;		/* whole note duration, msec */
+	uint8_t octave;		/* default octave */
 };
 
 #endif /* NOTE_H */
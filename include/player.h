@@ -6,22 +6,37 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include <note.h>
+#include <core/swtimer.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/*
+ * Start playing the tone and return right away; the tone must keep sounding
+ * until the next call. Tone 0 means silence.
+ */
 typedef void (*player_play_note_cb_t)(uint16_t tone, uint16_t duration);
+typedef void (*player_done_cb_t)(void *data);
 
 struct player {
 	player_play_note_cb_t play_note_cb;
-	const struct note *melody;
-	size_t melody_len;
-	size_t pos; /* indicates what note to play next */
+	const struct melody *melody;
+	size_t pos; /* offset of the next note to play in melody->notes[] */
+	struct swtimer_sw_tim swtim;	/* expires when current note ends */
+	uint32_t elapsed;	/* play time since start, msec */
+	uint32_t timeout;	/* play time limit, msec; 0 - no limit */
+	bool playing;
+	player_done_cb_t done_cb;	/* called when timeout expires */
+	void *done_data;
 };
 
-int player_init(struct player *obj, const struct note *melody,
-		size_t melody_len, player_play_note_cb_t play_note_cb);
+int player_init(struct player *obj, const struct melody *melody,
+		player_play_note_cb_t play_note_cb);
 void player_exit(struct player *obj);
-void player_play_next_note(struct player *obj);
+void player_set_melody(struct player *obj, const struct melody *melody);
+void player_start(struct player *obj, uint32_t timeout,
+		  player_done_cb_t done_cb, void *done_data);
 void player_stop(struct player *obj);
 
 #endif /* PLAYER_H */
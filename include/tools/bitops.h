@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef TOOLS_BITOPS_H
+#define TOOLS_BITOPS_H
+
+#include <tools/common.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Atomic operations on 32-bit words, safe to use from tasks and ISRs without
+ * disabling interrupts.
+ *
+ * Built on Cortex-M3 exclusive access: LDREX loads the word and tags it, STREX
+ * only stores it back if nothing happened in between. Any exception entry or
+ * return clears the tag, so when ISR preempts the read-modify-write, STREX
+ * fails and the sequence is retried with the value ISR left there.
+ *
+ * Only compiler barrier is provided, which is enough for single core.
+ */
+
+#define ATOMIC_FETCH_OP(op, asm_op)					\
+static inline __attribute__((always_inline))				\
+uint32_t atomic_fetch_##op(uint32_t *p, uint32_t val)			\
+{									\
+	uint32_t old, new, fail;					\
+									\
+	do {								\
+		__asm__ __volatile__ (					\
+			"ldrex %0, [%3]\n"				\
+			#asm_op " %1, %0, %4\n"				\
+			"strex %2, %1, [%3]"				\
+			: "=&r" (old), "=&r" (new), "=&r" (fail)	\
+			: "r" (p), "r" (val)				\
+			: "memory");					\
+	} while (fail);							\
+									\
+	return old;							\
+}
+
+/**
+ * atomic_fetch_or() - OR @p val into word @p p, return the old word value.
+ * atomic_fetch_and() - AND @p val into word @p p, return the old word value.
+ */
+ATOMIC_FETCH_OP(or, orr)
+ATOMIC_FETCH_OP(and, and)
+
+#undef ATOMIC_FETCH_OP
+
+/**
+ * Set bit in word atomically.
+ *
+ * @param nr Bit number, 0..31
+ * @param p Word to modify
+ */
+static inline void set_bit(unsigned int nr, uint32_t *p)
+{
+	atomic_fetch_or(p, BIT(nr));
+}
+
+/**
+ * Clear bit in word atomically.
+ *
+ * @param nr Bit number, 0..31
+ * @param p Word to modify
+ */
+static inline void clear_bit(unsigned int nr, uint32_t *p)
+{
+	atomic_fetch_and(p, ~BIT(nr));
+}
+
+/**
+ * Set bit in word atomically and return its old value.
+ *
+ * @param nr Bit number, 0..31
+ * @param p Word to modify
+ * @return true if the bit was set already
+ */
+static inline bool test_and_set_bit(unsigned int nr, uint32_t *p)
+{
+	return atomic_fetch_or(p, BIT(nr)) & BIT(nr);
+}
+
+/**
+ * Clear bit in word atomically and return its old value.
+ *
+ * @param nr Bit number, 0..31
+ * @param p Word to modify
+ * @return true if the bit was set
+ */
+static inline bool test_and_clear_bit(unsigned int nr, uint32_t *p)
+{
+	return atomic_fetch_and(p, ~BIT(nr)) & BIT(nr);
+}
+
+/**
+ * Check bit in word.
+ *
+ * @param nr Bit number, 0..31
+ * @param p Word to check
+ * @return true if the bit is set
+ */
+static inline bool test_bit(unsigned int nr, const uint32_t *p)
+{
+	return READ_ONCE(*p) & BIT(nr);
+}
+
+#endif /* TOOLS_BITOPS_H */
@@ -6,6 +6,7 @@
 #ifndef TOOLS_COMMON_H
 #define TOOLS_COMMON_H
 
+#include <core/crit_profile.h>
 #include <core/systick.h>
 #include <libopencm3/cm3/assert.h>
 
@@ -31,6 +32,9 @@
  *
  * Memory barriers are not needed when disabling interrupts (see AN321).
  *
+ * With CONFIG_CRIT_PROFILE, time with interrupts disabled is measured for
+ * each call site (outermost critical sections only).
+ *
  * @param[out] flags Will contain IRQ flags value before disabling interrupts;
  *                   must have "unsigned long" type
  */
@@ -42,6 +46,7 @@ do {									\
 		: "=r" (flags)						\
 		:							\
 		: "memory");						\
+	crit_profile_site_enter(flags);					\
 } while (0)
 
 /**
@@ -60,6 +65,7 @@ do {									\
  */
 #define exit_critical(flags)						\
 do {									\
+	crit_profile_site_exit(flags);					\
 	__asm__ __volatile__ (						\
 		"msr primask, %0\n" /* load PRIMASK from "flags" */	\
 		"isb"							\
@@ -68,6 +74,58 @@ do {									\
 		: "memory");						\
 } while (0)
 
+/** Number of priority bits implemented in NVIC (STM32F1) */
+#define NVIC_PRIO_BITS		4
+/** Convert priority level (0 is the most urgent) to NVIC register value */
+#define NVIC_PRIO(level)	((level) << (8 - NVIC_PRIO_BITS))
+
+/**
+ * Enter critical section for ISRs up to specified priority (BASEPRI).
+ *
+ * Like @ref enter_critical(), but only masks interrupts with priority level
+ * @p prio and less urgent ones; more urgent ISRs still run inside of the
+ * section. @p prio must be the level of the most urgent ISR touching the
+ * guarded data (see enum irq_prio). It's never lowered here, so nesting these
+ * sections with any ceilings (and into enter_critical() ones) is fine.
+ *
+ * SysTick and faults are never masked by this, as well as the IRQs with
+ * level 0. Don't use it for bit-banging: timing is only kept with all
+ * interrupts disabled. CONFIG_CRIT_PROFILE times the outermost sections
+ * (BASEPRI was 0 before), apart from the enter_critical() ones.
+ *
+ * @param[out] flags Will contain BASEPRI value before masking interrupts;
+ *                   must have "unsigned long" type
+ * @param prio Priority level to mask, 1..15
+ */
+#define enter_critical_prio(flags, prio)				\
+do {									\
+	__asm__ __volatile__ (						\
+		"mrs %0, basepri\n"	/* save BASEPRI to "flags" */	\
+		"msr basepri_max, %1"	/* only raise masked level */	\
+		: "=&r" (flags)						\
+		: "r" (NVIC_PRIO(prio))					\
+		: "memory");						\
+	crit_profile_prio_site_enter(flags);				\
+} while (0)
+
+/**
+ * Exit critical section entered with @ref enter_critical_prio().
+ *
+ * Memory barriers are the same as in @ref exit_critical().
+ *
+ * @param[in] flags Previously saved BASEPRI value
+ */
+#define exit_critical_prio(flags)					\
+do {									\
+	crit_profile_prio_site_exit(flags);				\
+	__asm__ __volatile__ (						\
+		"msr basepri, %0\n"	/* load BASEPRI from "flags" */	\
+		"isb"							\
+		:							\
+		: "r" (flags)						\
+		: "memory");						\
+} while (0)
+
 /**
  * Wait for some event (condition) to happen, breaking off on timeout.
  *
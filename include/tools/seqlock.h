@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#ifndef TOOLS_SEQLOCK_H
+#define TOOLS_SEQLOCK_H
+
+#include <tools/common.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Sequence counter: lockless publishing of the latest value.
+ *
+ * Writer makes the counter odd while updating the data and even again when
+ * done. Reader copies the data and retries if the counter was odd or changed
+ * meanwhile, so it never sees half-updated value, and writer never waits.
+ * Counter value also tells reader if there is new data since last read.
+ *
+ * Writer must not be interrupted by reader (e.g. reader in ISR and writer in
+ * task), or the reader spins forever. Writers must be serialized.
+ *
+ * Usage:
+ *
+ *	write_seqcount_begin(&box.seq);
+ *	box.data = data;
+ *	write_seqcount_end(&box.seq);
+ *
+ *	do {
+ *		seq = read_seqcount_begin(&box.seq);
+ *		data = box.data;
+ *	} while (read_seqcount_retry(&box.seq, seq));
+ */
+struct seqcount {
+	uint32_t sequence;
+};
+
+static inline uint32_t read_seqcount_begin(const struct seqcount *s)
+{
+	uint32_t seq;
+
+	while ((seq = READ_ONCE(s->sequence)) & 1)
+		;
+	barrier();
+
+	return seq;
+}
+
+static inline bool read_seqcount_retry(const struct seqcount *s, uint32_t start)
+{
+	barrier();
+	return READ_ONCE(s->sequence) != start;
+}
+
+static inline void write_seqcount_begin(struct seqcount *s)
+{
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+	barrier();
+}
+
+static inline void write_seqcount_end(struct seqcount *s)
+{
+	barrier();
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+}
+
+#endif /* TOOLS_SEQLOCK_H */
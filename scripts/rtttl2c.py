@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+"""Convert RTTTL ringtones to packed melodies for src/melody.c.
+
+Usage: rtttl2c.py FILE...
+
+Each input file contains RTTTL strings, one per line ("name:d=4,o=5,b=63:
+notes"); empty lines and lines starting with '#' are skipped. C code is printed
+to stdout: packed notes array for each melody plus melodies[] table entries.
+
+See include/note.h for the packed note format description.
+"""
+
+import re
+import sys
+
+NOTE_EXT = 0x80
+NOTE_DUR_SHIFT = 4
+NOTE_REST = 0xf
+NOTE_DOTTED = 0x08
+NOTE_OCTAVE_MAX = 7
+WHOLE_MAX = 0xffff      # struct melody .whole is uint16_t
+
+SEMITONES = {'c': 0, 'd': 2, 'e': 4, 'f': 5, 'g': 7, 'a': 9, 'b': 11, 'h': 11}
+DURATIONS = {1: 0, 2: 1, 4: 2, 8: 3, 16: 4, 32: 5}
+
+NOTE_RE = re.compile(r'^(\d+)?([a-hp])(#)?(\.)?(\d)?(\.)?$')
+
+
+def die(msg):
+    sys.stderr.write('Error: %s\n' % msg)
+    sys.exit(1)
+
+
+def parse_defaults(name, text):
+    defaults = {'d': 4, 'o': 6, 'b': 63}
+    for item in filter(None, text.split(',')):
+        key, _, val = item.strip().partition('=')
+        if key not in defaults or not val.isdigit():
+            die('%s: bad default "%s"' % (name, item))
+        defaults[key] = int(val)
+    return defaults
+
+
+def encode_note(name, text, defaults):
+    m = NOTE_RE.match(text.strip().lower())
+    if not m:
+        die('%s: bad note "%s"' % (name, text))
+    dur, letter, sharp, dot1, octave, dot2 = m.groups()
+
+    dur = int(dur) if dur else defaults['d']
+    if dur not in DURATIONS:
+        die('%s: bad duration in "%s"' % (name, text))
+    octave = int(octave) if octave else defaults['o']
+    dotted = bool(dot1 or dot2)
+
+    if letter == 'p':
+        pitch = NOTE_REST
+        octave = defaults['o']
+    else:
+        pitch = (SEMITONES[letter] + (1 if sharp else 0)) % 12
+        if letter == 'b' and sharp:
+            octave += 1
+
+    # Checked after b# -> c normalization: octave field is only 3 bits wide
+    if octave > NOTE_OCTAVE_MAX:
+        die('%s: octave is too high in "%s"' % (name, text))
+
+    b0 = (DURATIONS[dur] << NOTE_DUR_SHIFT) | pitch
+    if octave == defaults['o'] and not dotted:
+        return [b0]
+    return [b0 | NOTE_EXT, (NOTE_DOTTED if dotted else 0) | octave]
+
+
+def convert(line):
+    try:
+        name, defaults, notes = line.split(':')
+    except ValueError:
+        die('bad RTTTL string "%s"' % line)
+    name = name.strip()
+    defaults = parse_defaults(name, defaults)
+    if defaults['o'] > NOTE_OCTAVE_MAX:
+        die('%s: default octave is too high' % name)
+    if defaults['b'] == 0 or 4 * 60000 // defaults['b'] > WHOLE_MAX:
+        die('%s: tempo is too slow (b=%d)' % (name, defaults['b']))
+
+    data = []
+    for note in filter(None, notes.split(',')):
+        data += encode_note(name, note, defaults)
+
+    whole = 4 * 60000 // defaults['b']
+    return name, defaults['o'], whole, data
+
+
+def c_ident(name):
+    return 'melody_' + re.sub(r'\W+', '_', name).strip('_').lower()
+
+
+def main():
+    if len(sys.argv) < 2:
+        die('Usage: %s FILE...' % sys.argv[0])
+
+    melodies = []
+    for path in sys.argv[1:]:
+        with open(path) as f:
+            for line in f:
+                line = line.strip()
+                if line and not line.startswith('#'):
+                    melodies.append(convert(line))
+
+    for name, octave, whole, data in melodies:
+        print('/* %s */' % name)
+        print('static const uint8_t %s[] = {' % c_ident(name))
+        for i in range(0, len(data), 8):
+            print('\t' + ' '.join('0x%02x,' % b for b in data[i:i + 8]))
+        print('};')
+        print()
+
+    print('const struct melody melodies[] = {')
+    for name, octave, whole, data in melodies:
+        print('\tMELODY("%s", %s, %d, %d),' % (name, c_ident(name), whole,
+                                                octave))
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
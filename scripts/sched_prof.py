@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+
+"""Show scheduler profiler reports from serial console log.
+
+Usage: sched_prof.py [--plot] [FILE]
+
+Reads console output (FILE or stdin) and picks up lines printed by
+CONFIG_SCHED_PROFILE code in src/core/sched.c:
+
+    @sched <total_sec> <sched_and_irqs_sec> <idle_sec>
+    @run <task> <total_sec> <count> <min> <mean> <max> <hist...>
+    @lat <task> <count> <min> <mean> <max> <hist...>
+    @stack <task> <used> <size>
+    @ctxsw <count> <min> <mean> <max>
+    @crit <function>:<line> <count> <max> <mean> <total>
+
+@stack is the task stack high-water mark in bytes and @ctxsw is context switch
+cost in CPU cycles (both CONFIG_SCHED_PREEMPT); used == size means the stack
+has overflown.
+@crit lines list critical sections with the longest IRQs-off time (see
+CONFIG_CRIT_PROFILE). min/mean/max/total are in usec. Histogram bucket 0
+counts times < 1 usec, bucket N counts [2^(N-1), 2^N) usec, the last one
+counts all longer times too.
+
+The last complete report is printed as a table. With --plot, run time and
+latency histograms of each task are plotted (needs matplotlib).
+"""
+
+import sys
+
+
+def die(msg):
+    sys.stderr.write('Error: %s\n' % msg)
+    sys.exit(1)
+
+
+def parse_stat(fields):
+    count, vmin, mean, vmax = [int(f) for f in fields[:4]]
+    return {'count': count, 'min': vmin, 'mean': mean, 'max': vmax,
+            'hist': [int(f) for f in fields[4:]]}
+
+
+def parse(lines):
+    """Return list of reports:
+    (totals, {task: (run, lat)}, [crit], ctxsw, {task: (used, size)})."""
+    reports = []
+    report = None
+    for line in lines:
+        fields = line.split()
+        if not fields or not fields[0].startswith('@'):
+            continue
+        try:
+            if fields[0] == '@sched':
+                report = [[float(f) for f in fields[1:4]], {}, [], None, {}]
+                reports.append(report)
+            elif report is None:
+                continue
+            elif fields[0] == '@run':
+                run = parse_stat(fields[3:])
+                run['total'] = float(fields[2])
+                report[1][fields[1]] = [run, None]
+            elif fields[0] == '@lat' and fields[1] in report[1]:
+                report[1][fields[1]][1] = parse_stat(fields[2:])
+            elif fields[0] == '@stack':
+                report[4][fields[1]] = (int(fields[2]), int(fields[3]))
+            elif fields[0] == '@ctxsw':
+                report[3] = [int(f) for f in fields[1:5]]
+            elif fields[0] == '@crit':
+                count, vmax, mean, total = [int(f) for f in fields[2:6]]
+                report[2].append((fields[1], count, vmax, mean, total))
+        except (IndexError, ValueError):
+            sys.stderr.write('Warning: bad line "%s"\n' % line.strip())
+    return reports
+
+
+def bucket_name(i):
+    return '<1' if i == 0 else '<%d' % (1 << i)
+
+
+def show_table(report):
+    (total, sched, idle), tasks, crit, ctxsw, stacks = report
+
+    def perc(val):
+        return 100.0 * val / total if total else 0.0
+
+    print('total %.3f s, sched + IRQs %.2f%%, idle %.2f%%' %
+          (total, perc(sched), perc(idle)))
+    print('%-10s %6s %8s %8s %8s %8s | %8s %8s %8s' %
+          ('task', 'load,%', 'runs', 'min,us', 'mean,us', 'max,us',
+           'lat min', 'lat mean', 'lat max'))
+    for name, (run, lat) in tasks.items():
+        lat = lat or {'min': 0, 'mean': 0, 'max': 0}
+        print('%-10s %6.2f %8d %8d %8d %8d | %8d %8d %8d' %
+              (name, perc(run['total']), run['count'], run['min'],
+               run['mean'], run['max'], lat['min'], lat['mean'], lat['max']))
+
+    if stacks:
+        print()
+        print('%-10s %8s %8s' % ('task', 'stack', 'size'))
+        for name, (used, size) in stacks.items():
+            print('%-10s %8d %8d%s' % (name, used, size,
+                                       '  OVERFLOW' if used >= size else ''))
+
+    if ctxsw:
+        print()
+        print('context switches %d, cycles min %d, mean %d, max %d' %
+              tuple(ctxsw))
+
+    if crit:
+        print()
+        print('%-30s %8s %8s %8s %10s' %
+              ('critical section', 'count', 'max,us', 'mean,us', 'total,us'))
+        for site in crit:
+            print('%-30s %8d %8d %8d %10d' % site)
+
+
+def show_plot(report):
+    try:
+        import matplotlib.pyplot as plt
+    except ImportError:
+        die('matplotlib is needed for --plot')
+
+    tasks = report[1]
+    fig, axes = plt.subplots(len(tasks), 2, squeeze=False,
+                             figsize=(10, 2 * len(tasks)))
+    for row, (name, stats) in zip(axes, tasks.items()):
+        for ax, stat, title in zip(row, stats, ('run time', 'latency')):
+            if stat is None:
+                continue
+            hist = stat['hist']
+            ax.bar(range(len(hist)), hist)
+            ax.set_xticks(range(len(hist)))
+            ax.set_xticklabels([bucket_name(i) for i in range(len(hist))],
+                               fontsize=6)
+            ax.set_title('%s: %s, usec' % (name, title), fontsize=8)
+    fig.tight_layout()
+    plt.show()
+
+
+def main():
+    args = sys.argv[1:]
+    plot = '--plot' in args
+    args = [a for a in args if a != '--plot']
+    if len(args) > 1:
+        die('Usage: %s [--plot] [FILE]' % sys.argv[0])
+
+    if args:
+        with open(args[0], errors='replace') as f:
+            reports = parse(f)
+    else:
+        reports = parse(sys.stdin)
+
+    if not reports:
+        die('no profiler reports found')
+
+    show_table(reports[-1])
+    if plot:
+        show_plot(reports[-1])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+
+"""Convert trace dump to Chrome/Perfetto trace JSON.
+
+Usage: trace2json.py DUMP [OUT]
+
+DUMP is raw data captured from serial console after sending trace dump
+command (see CONFIG_TRACE_CMD), e.g.:
+
+    $ stty -F /dev/ttyUSB0 115200 raw
+    $ cat /dev/ttyUSB0 > dump.bin &
+    $ printf t > /dev/ttyUSB0
+
+Console text around the dump is skipped; if there are a few dumps, the last one
+is converted. See src/core/trace.c for the dump format. OUT is JSON file to
+write (stdout by default); open it in chrome://tracing or ui.perfetto.dev.
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = b'KTRC'
+VERSION = 1
+HEADER = struct.Struct('<4sBBHI')
+EVENT = struct.Struct('<IBBH')
+TRACE_END = 0x80
+
+# enum trace_type
+TRACE_IRQ = 1
+TRACE_TASK = 2
+TRACE_SWTIMER = 3
+TRACE_I2C_READ = 4
+TRACE_I2C_WRITE = 5
+TRACE_OW_RESET = 6
+TRACE_OW_WRITE = 7
+TRACE_OW_READ = 8
+TRACE_LCD_FLUSH = 9
+
+# Threads in trace viewer: ISRs preempt tasks, so they need separate track
+TID_TASKS = 1
+TID_IRQS = 2
+
+# STM32F100 IRQ numbers used by firmware
+IRQ_NAMES = {
+    6: 'EXTI0', 7: 'EXTI1', 8: 'EXTI2', 9: 'EXTI3', 10: 'EXTI4',
+    13: 'DMA1_CH3', 14: 'DMA1_CH4', 23: 'EXTI9_5', 28: 'TIM2', 29: 'TIM3',
+    30: 'TIM4', 33: 'I2C2_EV', 34: 'I2C2_ER', 37: 'USART1', 40: 'EXTI15_10',
+    54: 'TIM6_DAC', 55: 'TIM7',
+}
+
+
+def die(msg):
+    sys.stderr.write('Error: %s\n' % msg)
+    sys.exit(1)
+
+
+def parse(data):
+    pos = data.rfind(MAGIC)
+    if pos < 0:
+        die('no trace dump found')
+
+    try:
+        _, version, ntasks, nevents, freq = HEADER.unpack_from(data, pos)
+        if version != VERSION:
+            die('unsupported dump version %d' % version)
+        pos += HEADER.size
+
+        tasks = {}
+        for task_id in range(1, ntasks + 1):
+            length = data[pos]
+            tasks[task_id] = data[pos + 1:pos + 1 + length].decode(
+                'ascii', 'replace')
+            pos += 1 + length
+
+        events = []
+        for _ in range(nevents):
+            events.append(EVENT.unpack_from(data, pos))
+            pos += EVENT.size
+    except (IndexError, struct.error):
+        die('truncated trace dump')
+
+    return freq, tasks, events
+
+
+def event_name(etype, eid, tasks):
+    if etype == TRACE_IRQ:
+        return IRQ_NAMES.get(eid, 'IRQ %d' % eid), TID_IRQS
+    if etype == TRACE_TASK:
+        return tasks.get(eid) or 'task %d' % eid, TID_TASKS
+    if etype == TRACE_SWTIMER:
+        return 'swtimer %d' % eid, TID_TASKS
+    if etype == TRACE_I2C_READ:
+        return 'i2c read 0x%02x' % eid, TID_TASKS
+    if etype == TRACE_I2C_WRITE:
+        return 'i2c write 0x%02x' % eid, TID_TASKS
+    if etype == TRACE_OW_RESET:
+        return '1-wire reset', TID_TASKS
+    if etype == TRACE_OW_WRITE:
+        return '1-wire write', TID_TASKS
+    if etype == TRACE_OW_READ:
+        return '1-wire read', TID_TASKS
+    if etype == TRACE_LCD_FLUSH:
+        return 'lcd flush', TID_TASKS
+    return 'event %d' % etype, TID_TASKS
+
+
+def convert(freq, tasks, events):
+    out = [
+        {'ph': 'M', 'pid': 0, 'tid': TID_TASKS, 'name': 'thread_name',
+         'args': {'name': 'tasks'}},
+        {'ph': 'M', 'pid': 0, 'tid': TID_IRQS, 'name': 'thread_name',
+         'args': {'name': 'IRQs'}},
+    ]
+    wraps = 0
+    prev = None
+    start = None
+
+    for ts, etype, eid, arg in events:
+        # Cycle counter is 32-bit: it wraps in a few minutes
+        if prev is not None and ts < prev:
+            wraps += 1
+        prev = ts
+        cycles = ts + (wraps << 32)
+        if start is None:
+            start = cycles
+
+        name, tid = event_name(etype & ~TRACE_END, eid, tasks)
+        out.append({
+            'ph': 'E' if etype & TRACE_END else 'B',
+            'pid': 0,
+            'tid': tid,
+            'name': name,
+            'ts': (cycles - start) * 1e6 / freq,
+            'args': {'arg': arg},
+        })
+
+    return {'traceEvents': out, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        die('Usage: %s DUMP [OUT]' % sys.argv[0])
+
+    with open(sys.argv[1], 'rb') as f:
+        trace = convert(*parse(f.read()))
+
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+        sys.stdout.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -43,8 +43,9 @@ static struct pin_mode pins[] = {
 	},
 	{
 		.port = WH1602_GPIO_PORT,
-		.pins = WH1602_RS_PIN | WH1602_EN_PIN | WH1602_DB4_PIN |
-			WH1602_DB5_PIN | WH1602_DB6_PIN | WH1602_DB7_PIN,
+		.pins = WH1602_RS_PIN | WH1602_RW_PIN | WH1602_EN_PIN |
+			WH1602_DB4_PIN | WH1602_DB5_PIN | WH1602_DB6_PIN |
+			WH1602_DB7_PIN,
 		.mode = GPIO_MODE_OUTPUT_2_MHZ,
 		.conf = GPIO_CNF_OUTPUT_PUSHPULL,
 	},
@@ -79,7 +80,13 @@ static struct pin_mode pins[] = {
 		.port = BUZZER_GPIO_PORT,
 		.pins = BUZZER_GPIO_PIN,
 		.mode = GPIO_MODE_OUTPUT_2_MHZ,
-		.conf = GPIO_CNF_OUTPUT_PUSHPULL,
+		.conf = GPIO_CNF_OUTPUT_ALTFN_PUSHPULL,
+	},
+	{
+		.port = SYNTH_GPIO_PORT,
+		.pins = SYNTH_GPIO_PIN,
+		.mode = GPIO_MODE_INPUT,
+		.conf = GPIO_CNF_INPUT_ANALOG,
 	},
 };
 
@@ -88,13 +95,21 @@ enum rcc_periph_clken clocks[] = {
 	SERIAL_GPIO_RCC,
 	DS18B20_GPIO_RCC,
 	WH1602_GPIO_RCC,
+	WH1602_TIM_RCC,
+	WH1602_DMA_RCC,
 	KBD_GPIO_RCC,
 	KBD_AFIO_RCC,
 	SWTIMER_TIM_RCC,
 	DS3231_AFIO_RCC,
 	DS3231_GPIO_RCC,
 	DS3231_I2C_RCC,
+	BUZZER_AFIO_RCC,
 	BUZZER_GPIO_RCC,
+	BUZZER_TIM_RCC,
+	SYNTH_GPIO_RCC,
+	SYNTH_DAC_RCC,
+	SYNTH_TIM_RCC,
+	SYNTH_DMA_RCC,
 };
 
 /**
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+#include <clock_face.h>
+#include <drivers/wh1602.h>
+#include <tools/common.h>
+#include <stdint.h>
+
+/* Character codes from HD44780 ROM (A00) */
+#define ROM_FULL_BLOCK		0xff
+#define ROM_DEGREE		0xdf
+
+/* Big digits are built of the segments below plus ROM full block */
+enum clock_face_seg {
+	SEG_NONE,	/* empty cell */
+	SEG_FULL,	/* full block */
+	SEG_TOP,	/* bar at the top of the cell */
+	SEG_BOT,	/* bar at the bottom of the cell */
+	SEG_TOP_BOT,	/* bars at the top and at the bottom of the cell */
+	SEG_DOT,	/* dot in the middle of the cell (for colon) */
+};
+
+static const uint8_t glyph_top[WH1602_GLYPH_ROWS] = {
+	0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t glyph_bot[WH1602_GLYPH_ROWS] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f,
+};
+
+static const uint8_t glyph_top_bot[WH1602_GLYPH_ROWS] = {
+	0x1f, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f,
+};
+
+static const uint8_t glyph_dot[WH1602_GLYPH_ROWS] = {
+	0x00, 0x00, 0x0e, 0x0e, 0x0e, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t glyph_degree[WH1602_GLYPH_ROWS] = {
+	0x0c, 0x12, 0x12, 0x0c, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t glyph_bell[WH1602_GLYPH_ROWS] = {
+	0x04, 0x0e, 0x0e, 0x0e, 0x1f, 0x00, 0x04, 0x00,
+};
+
+/* Big digits: 3 cells wide, 2 lines high */
+static const uint8_t big_digits[10][WH1602_ROWS][CLOCK_FACE_DIGIT_WIDTH] = {
+	{ { SEG_FULL, SEG_TOP, SEG_FULL },
+	  { SEG_FULL, SEG_BOT, SEG_FULL } },		/* 0 */
+	{ { SEG_TOP, SEG_FULL, SEG_NONE },
+	  { SEG_BOT, SEG_FULL, SEG_BOT } },		/* 1 */
+	{ { SEG_TOP_BOT, SEG_TOP_BOT, SEG_FULL },
+	  { SEG_FULL, SEG_BOT, SEG_BOT } },		/* 2 */
+	{ { SEG_TOP_BOT, SEG_TOP_BOT, SEG_FULL },
+	  { SEG_BOT, SEG_BOT, SEG_FULL } },		/* 3 */
+	{ { SEG_FULL, SEG_BOT, SEG_FULL },
+	  { SEG_NONE, SEG_NONE, SEG_FULL } },		/* 4 */
+	{ { SEG_FULL, SEG_TOP_BOT, SEG_TOP_BOT },
+	  { SEG_BOT, SEG_BOT, SEG_FULL } },		/* 5 */
+	{ { SEG_FULL, SEG_TOP_BOT, SEG_TOP_BOT },
+	  { SEG_FULL, SEG_BOT, SEG_FULL } },		/* 6 */
+	{ { SEG_TOP, SEG_TOP, SEG_FULL },
+	  { SEG_NONE, SEG_NONE, SEG_FULL } },		/* 7 */
+	{ { SEG_FULL, SEG_TOP_BOT, SEG_FULL },
+	  { SEG_FULL, SEG_BOT, SEG_FULL } },		/* 8 */
+	{ { SEG_FULL, SEG_TOP_BOT, SEG_FULL },
+	  { SEG_BOT, SEG_BOT, SEG_FULL } },		/* 9 */
+};
+
+/* Get character code for segment, uploading its glyph if needed */
+static uint8_t clock_face_seg_char(struct wh1602 *wh, enum clock_face_seg seg)
+{
+	static const uint8_t * const seg_glyph[] = {
+		[SEG_TOP]	= glyph_top,
+		[SEG_BOT]	= glyph_bot,
+		[SEG_TOP_BOT]	= glyph_top_bot,
+		[SEG_DOT]	= glyph_dot,
+	};
+	int c;
+
+	switch (seg) {
+	case SEG_NONE:
+		return ' ';
+	case SEG_FULL:
+		return ROM_FULL_BLOCK;
+	default:
+		c = wh1602_glyph_get(wh, seg_glyph[seg]);
+		/* No free CGRAM slot: draw something recognizable */
+		return c < 0 ? ROM_FULL_BLOCK : c;
+	}
+}
+
+static void clock_face_big_digit(struct wh1602 *wh, int col, int digit)
+{
+	int line, i;
+
+	for (line = 0; line < WH1602_ROWS; ++line) {
+		for (i = 0; i < CLOCK_FACE_DIGIT_WIDTH; ++i) {
+			enum clock_face_seg seg = big_digits[digit][line][i];
+
+			wh1602_fb_put_char(wh, line, col + i,
+					   clock_face_seg_char(wh, seg));
+		}
+	}
+}
+
+/**
+ * Put icon into LCD frame buffer.
+ *
+ * Icon glyph is uploaded to LCD CGRAM on first use. If there is no free CGRAM
+ * slot, the closest ROM character is used instead.
+ *
+ * @param wh LCD object
+ * @param line LCD line to use (LINE_1 or LINE_2)
+ * @param col Column to put icon into
+ * @param icon Which icon to show
+ */
+void clock_face_put_icon(struct wh1602 *wh, int line, int col,
+			 enum clock_face_icon icon)
+{
+	static const struct {
+		const uint8_t *glyph;
+		uint8_t fallback;
+	} icons[] = {
+		[ICON_DEGREE]	= { glyph_degree, ROM_DEGREE },
+		[ICON_BELL]	= { glyph_bell, '*' },
+	};
+	int c;
+
+	c = wh1602_glyph_get(wh, icons[icon].glyph);
+	wh1602_fb_put_char(wh, line, col, c < 0 ? icons[icon].fallback : c);
+}
+
+/**
+ * Render time as big (2-line) digits into LCD frame buffer.
+ *
+ * Takes 15 columns: digits of hours and minutes are separated by a blank
+ * column, hours and minutes are separated by a colon column.
+ *
+ * @param wh LCD object
+ * @param col Start column
+ * @param hour Hours (0..23)
+ * @param min Minutes (0..59)
+ */
+void clock_face_big_time(struct wh1602 *wh, int col, int hour, int min)
+{
+	const int step = CLOCK_FACE_DIGIT_WIDTH + 1;
+	uint8_t dot;
+
+	clock_face_big_digit(wh, col, hour / 10);
+	clock_face_big_digit(wh, col + step, hour % 10);
+
+	dot = clock_face_seg_char(wh, SEG_DOT);
+	col += step * 2 - 1;
+	wh1602_fb_put_char(wh, LINE_1, col, dot);
+	wh1602_fb_put_char(wh, LINE_2, col, dot);
+
+	clock_face_big_digit(wh, col + 1, min / 10);
+	clock_face_big_digit(wh, col + 1 + step, min % 10);
+}
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+/**
+ * @file
+ *
+ * Critical sections profiler.
+ *
+ * Measures how long interrupts stay disabled in each enter_critical() call
+ * site, which is the worst-case extra latency for any ISR. Sections of
+ * enter_critical_prio() are timed the same way: they delay ISRs up to their
+ * priority level. Only outermost critical sections are timed: nested ones don't
+ * change the masked time. Sites are registered on first use. Report of the
+ * worst sites is printed along with scheduler profiler report.
+ *
+ * Functions here are called with interrupts masked, so they must not use
+ * enter_critical() themselves. BASEPRI sections are timed separately from
+ * PRIMASK ones: the latter may be entered by more urgent ISRs inside of the
+ * former.
+ */
+
+#ifdef CONFIG_CRIT_PROFILE
+
+#ifndef CONFIG_SCHED_PROFILE
+#error "CONFIG_CRIT_PROFILE needs CONFIG_SCHED_PROFILE"
+#endif
+
+#include <core/crit_profile.h>
+#include <core/log.h>
+#include <tools/common.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+#include <stddef.h>
+
+#define CRIT_TOP_NR		5	/* sites to report */
+
+/* Outermost section being timed */
+struct crit_timing {
+	struct crit_site *current;	/* site IRQs are masked in */
+	uint32_t start;			/* cycle counter on entering it */
+};
+
+struct crit_profile {
+	struct crit_site *sites;	/* all sites seen so far */
+	struct crit_timing irq;		/* enter_critical() (PRIMASK) */
+	struct crit_timing prio;	/* enter_critical_prio() (BASEPRI) */
+};
+
+static struct crit_profile crit;
+
+/* Add site to the list; ISRs not masked by BASEPRI can register sites too */
+static void crit_profile_register(struct crit_site *site)
+{
+	unsigned long primask;
+
+	__asm__ __volatile__ (
+		"mrs %0, primask\n"
+		"cpsid i"
+		: "=r" (primask)
+		:
+		: "memory");
+	if (!site->registered) {
+		site->registered = true;
+		site->next = crit.sites;
+		crit.sites = site;
+	}
+	__asm__ __volatile__ (
+		"msr primask, %0"
+		:
+		: "r" (primask)
+		: "memory");
+}
+
+static void crit_timing_enter(struct crit_timing *t, struct crit_site *site)
+{
+	if (!site->registered)
+		crit_profile_register(site);
+
+	t->current = site;
+	t->start = DWT_CYCCNT;
+}
+
+static void crit_timing_exit(struct crit_timing *t)
+{
+	struct crit_site *site = t->current;
+	uint32_t cycles = DWT_CYCCNT - t->start;
+
+	if (!site)
+		return;
+
+	site->count++;
+	site->sum += cycles;
+	if (cycles > site->max)
+		site->max = cycles;
+	t->current = NULL;
+}
+
+/**
+ * Start timing critical section.
+ *
+ * @param site Call site of enter_critical()
+ */
+void crit_profile_enter(struct crit_site *site)
+{
+	crit_timing_enter(&crit.irq, site);
+}
+
+/* Finish timing critical section entered last */
+void crit_profile_exit(void)
+{
+	crit_timing_exit(&crit.irq);
+}
+
+/**
+ * Start timing BASEPRI critical section.
+ *
+ * @param site Call site of enter_critical_prio()
+ */
+void crit_profile_prio_enter(struct crit_site *site)
+{
+	crit_timing_enter(&crit.prio, site);
+}
+
+/* Finish timing BASEPRI critical section entered last */
+void crit_profile_prio_exit(void)
+{
+	crit_timing_exit(&crit.prio);
+}
+
+/**
+ * Don't count time spent in critical section so far.
+ *
+ * For sections where CPU sleeps with IRQs masked (see sched_idle()): pending
+ * IRQ wakes the CPU up, so only time after wakeup delays the ISR.
+ */
+void crit_profile_restart(void)
+{
+	crit.irq.start = DWT_CYCCNT;
+}
+
+/* Convert CPU cycles to usec */
+static unsigned long crit_cycles_to_us(uint64_t cycles)
+{
+	return cycles / (rcc_ahb_frequency / 1000000);
+}
+
+/*
+ * Print the sites with longest masked time, one per line:
+ *   @crit <function>:<line> <count> <max> <mean> <total>
+ * Times are in usec.
+ */
+void crit_profile_report(void)
+{
+	struct crit_site top[CRIT_TOP_NR];
+	struct crit_site *site;
+	unsigned long flags;
+	int nr = 0;
+	int i;
+
+	/* Take consistent copy of the worst sites */
+	enter_critical(flags);
+	for (site = crit.sites; site; site = site->next) {
+		if (!site->count)
+			continue;
+		for (i = nr; i > 0 && top[i - 1].max < site->max; --i) {
+			if (i < CRIT_TOP_NR)
+				top[i] = top[i - 1];
+		}
+		if (i < CRIT_TOP_NR) {
+			top[i] = *site;
+			if (nr < CRIT_TOP_NR)
+				nr++;
+		}
+	}
+	exit_critical(flags);
+
+	for (i = 0; i < nr; ++i) {
+		printk("@crit %s:%u %lu %lu %lu %lu\n", top[i].func,
+		       top[i].line, (unsigned long)top[i].count,
+		       crit_cycles_to_us(top[i].max),
+		       crit_cycles_to_us(top[i].sum / top[i].count),
+		       crit_cycles_to_us(top[i].sum));
+	}
+}
+
+/**
+ * Initialize critical sections profiler.
+ *
+ * @return 0 on success or negative value on error
+ */
+int crit_profile_init(void)
+{
+	if (!dwt_enable_cycle_counter())
+		return -1;
+
+	return 0;
+}
+
+#endif /* CONFIG_CRIT_PROFILE */
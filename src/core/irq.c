@@ -20,6 +20,7 @@
 
 #include <core/irq.h>
 #include <core/log.h>
+#include <core/trace.h>
 #include <libopencm3/stm32/flash.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scb.h>
@@ -33,12 +34,15 @@
 #define irq_to_desc(irq)	(irq_desc + (irq))
 #define for_each_action_of_desc(desc, act)			\
 	for (act = desc->action; act; act = act->next)
+#define for_each_static_action(act)				\
+	for (act = __irq_actions_start; act < __irq_actions_end; ++act)
 
 struct irq_desc;
 typedef void (*irq_flow_handler_t)(unsigned int irq, struct irq_desc *desc);
 
 struct irq_desc {
 	irq_flow_handler_t handle_irq;	/* high-level IRQ events handler */
+	const struct irq_action *static_action; /* DEFINE_IRQ() one, in flash */
 	struct irq_action *action;	/* list of actions (shared pointer) */
 };
 
@@ -58,9 +62,13 @@ struct irq_desc irq_desc[NVIC_IRQ_COUNT] = {
 /* High-level IRQ handler for requested IRQs */
 static void irq_handle(unsigned int irq, struct irq_desc *desc)
 {
+	const struct irq_action *sa = desc->static_action;
 	struct irq_action *action;
 	irqreturn_t retval = IRQ_NONE;
 
+	if (sa)
+		retval |= sa->handler(irq, sa->data);
+
 	for_each_action_of_desc(desc, action) {
 		irqreturn_t res;
 
@@ -78,8 +86,10 @@ static void __irq_entry(void)
 	unsigned int irq;
 	struct irq_desc *desc;
 
-	/* Keep interrupts disabled during ISR */
-	__asm__ __volatile__ ("cpsid i" : : : "memory");
+	/*
+	 * Interrupts are kept enabled: NVIC only lets more urgent ISRs (see
+	 * enum irq_prio) preempt this one.
+	 */
 
 	/* Get IRQ number */
 	__asm__ __volatile__ ("mrs %0, ipsr" : "=r" (irq) : : "memory");
@@ -90,10 +100,9 @@ static void __irq_entry(void)
 	desc = irq_to_desc(irq);
 
 	/* Run high-level IRQ handler */
+	trace_begin(TRACE_IRQ, irq, 0);
 	desc->handle_irq(irq, desc);
-
-	/* Enable interrupts once ISR is handled */
-	__asm__ __volatile__ ("cpsie i" : : : "memory");
+	trace_end(TRACE_IRQ, irq, 0);
 }
 
 /**
@@ -105,15 +114,28 @@ static void __irq_entry(void)
  *    and specified ISR function needs to be set in vector table.
  * 2. Replace all IRQ handlers in vector table with internal low-level handler,
  *    which in turn runs handlers registered with @ref irq_request().
+ * 3. Hook up actions defined with DEFINE_IRQ() to their IRQ descriptors, so
+ *    that ISR doesn't have to look for them. Only one such action per IRQ is
+ *    allowed; use @ref irq_request() for shared IRQs.
  *
  * @return 0 on success or negative value on error
  */
 int irq_init(void)
 {
+	const struct irq_action *sa, *prev;
 	unsigned long flags;
 	vector_table_t *vtable;
 	size_t i;
 
+	for_each_static_action(sa) {
+		if (sa->irq >= NVIC_IRQ_COUNT)
+			return -1;
+		for (prev = __irq_actions_start; prev < sa; ++prev) {
+			if (prev->irq == sa->irq)
+				return -2;
+		}
+	}
+
 	enter_critical(flags);
 
 	/* Copy vector table from flash to RAM */
@@ -123,6 +145,12 @@ int irq_init(void)
 	vtable = (vector_table_t *)SRAM_BASE;
 	for (i = 0; i < NVIC_IRQ_COUNT; ++i)
 		vtable->irq[i] = __irq_entry;
+	for_each_static_action(sa) {
+		struct irq_desc *desc = irq_to_desc(sa->irq);
+
+		desc->static_action = sa;
+		desc->handle_irq = irq_handle;
+	}
 
 	/* Make CPU use vector table from RAM */
 	SCB_VTOR = SRAM_BASE;
@@ -150,6 +178,7 @@ void irq_exit(void)
 	/* Cleanup irq descriptor table */
 	for (i = 0; i < NVIC_IRQ_COUNT; ++i) {
 		irq_desc[i].handle_irq = irq_handle_bad;
+		irq_desc[i].static_action = NULL;
 		irq_desc[i].action = NULL;
 	}
 }
@@ -210,28 +239,34 @@ int irq_request(struct irq_action *action)
 int irq_free(struct irq_action *action)
 {
 	struct irq_desc *desc;
+	struct irq_action *a;
 	unsigned long flags;
 
 	cm3_assert(action != NULL);
 
 	/*
 	 * Find and remove specified action from `desc->action' list and relink
-	 * the list if needed.
+	 * the list if needed. Keep high-level handler while there is still
+	 * something to call for this IRQ (DEFINE_IRQ() action or other shared
+	 * actions).
 	 */
 	enter_critical(flags);
 	desc = irq_to_desc(action->irq);
 	if (desc->action == action) {
-		desc->action = NULL;
-	} else {
-		struct irq_action *a;
+		desc->action = action->next;
+		action->next = NULL;
+		if (!desc->action && !desc->static_action)
+			desc->handle_irq = irq_handle_bad;
+		exit_critical(flags);
+		return 0;
+	}
 
-		for_each_action_of_desc(desc, a) {
-			if (a->next == action) {
-				a->next = a->next->next; /* relink */
-				action->next = NULL;
-				exit_critical(flags);
-				return 0;
-			}
+	for_each_action_of_desc(desc, a) {
+		if (a->next == action) {
+			a->next = a->next->next; /* relink */
+			action->next = NULL;
+			exit_critical(flags);
+			return 0;
 		}
 	}
 	exit_critical(flags);
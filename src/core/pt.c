@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+/**
+ * @file
+ *
+ * Protothreads support: wakeup timers for PT_SLEEP_MS().
+ *
+ * See core/pt.h for the threads API. Each thread has one-shot software timer,
+ * which sets thread task ready when the sleep time is out.
+ */
+
+#include <core/pt.h>
+#include <tools/common.h>
+#include <stddef.h>
+
+/* Sleep time is out: stop the timer and wake up the thread */
+static void pt_wakeup(void *data)
+{
+	struct pt *pt = (struct pt *)data;
+
+	swtimer_tim_stop(pt->tim.id);
+	sched_set_ready(pt->task_id);
+}
+
+/**
+ * Initialize protothread.
+ *
+ * @param pt Thread to initialize
+ * @param task_id Scheduler task running the thread (from sched_add_task()
+ *		  or TASK_ID())
+ * @return 0 on success or negative value on error
+ */
+int pt_init(struct pt *pt, int task_id)
+{
+	int ret;
+
+	pt->lc = NULL;
+	pt->yielded = false;
+	pt->task_id = task_id;
+
+	pt->tim.cb = pt_wakeup;
+	pt->tim.data = pt;
+	pt->tim.period = SWTIMER_HW_OVERFLOW;
+	ret = swtimer_tim_register(&pt->tim);
+	if (ret < 0)
+		return ret;
+	swtimer_tim_stop(pt->tim.id);
+
+	return 0;
+}
+
+/**
+ * De-initialize protothread.
+ *
+ * @param pt Thread to de-initialize
+ */
+void pt_exit(struct pt *pt)
+{
+	swtimer_tim_del(pt->tim.id);
+	pt->lc = NULL;
+}
+
+/**
+ * Start sleep timer of the thread; use PT_SLEEP_MS() instead.
+ *
+ * @param pt Thread going to sleep
+ * @param msec Sleep time, msec
+ */
+void pt_sleep(struct pt *pt, int msec)
+{
+	if (msec < SWTIMER_HW_OVERFLOW)
+		msec = SWTIMER_HW_OVERFLOW;
+
+	swtimer_tim_set_period(pt->tim.id, msec);
+	swtimer_tim_reset(pt->tim.id);
+	swtimer_tim_start(pt->tim.id);
+}
@@ -7,16 +7,44 @@
 #include <core/sched.h>
 #include <core/systick.h>
 #include <core/swtimer.h>
+#include <core/trace.h>
+#include <core/wdt.h>
+#include <tools/bitops.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/stm32/rcc.h>
 #include <string.h>
 
+#ifdef CONFIG_SCHED_PROFILE
+/* Histogram: bucket 0 is < 1 usec, bucket N is [2^(N-1), 2^N) usec */
+#define SCHED_HIST_NR			16
+
+/* Statistics of task run time or wakeup latency */
+struct sched_stat {
+	uint32_t count;
+	uint32_t min;			/* nsec */
+	uint32_t max;			/* nsec */
+	uint64_t sum;			/* nsec */
+	uint16_t hist[SCHED_HIST_NR];	/* last bucket takes all longer ones */
+};
+#endif /* CONFIG_SCHED_PROFILE */
+
 struct task {
-	const char *name;		/* task name */
-	task_func_t func;		/* task function to run */
-	void *data;			/* user private data; passed to func */
+	const struct sched_task_desc *desc; /* NULL if slot is empty */
+	struct sched_task_desc dyn;	/* desc of task added at runtime */
+	int period;			/* msec; 0 if task is not periodic */
+	int remaining;			/* msec till periodic task is ready */
+	int wdt_tid;			/* WDT task ID of periodic task or -1 */
 #ifdef CONFIG_SCHED_PROFILE
-	uint32_t sec;
-	uint32_t nsec;
+	struct sched_stat run;		/* task function execution time */
+	struct sched_stat lat;		/* from sched_set_ready() to run */
+	struct systick_time ready_at;	/* when task became ready */
 #endif /* CONFIG_SCHED_PROFILE */
+#ifdef CONFIG_SCHED_PREEMPT
+	uint32_t *sp;			/* saved stack pointer of task thread */
+	uint8_t prio;			/* current priority, with inherited one */
+	uint8_t base_prio;		/* priority set by sched_set_priority() */
+#endif /* CONFIG_SCHED_PREEMPT */
 };
 
 /* Contains status of each task (1 - data is ready; 0 - blocked) */
@@ -24,84 +52,207 @@ static uint32_t sched_ready;
 static struct task task_list[TASK_NR];
 static int current;			/* current pos in task_list[] */
 
+/* Number of DEFINE_TASK() tasks; they take the first slots */
+#define SCHED_STATIC_NR		(__sched_tasks_end - __sched_tasks_start)
+
+/* Periodic tasks with longer period can't keep up with watchdog */
+#define SCHED_WDT_PERIOD_MAX	(CONFIG_WDT_PERIOD / 2)	/* msec */
+
+#ifdef CONFIG_SCHED_PREEMPT
+#define SCHED_IDLE_STACK_SIZE		128	/* bytes */
+#define SCHED_STACK_WORDS		(CONFIG_SCHED_STACK_SIZE / 4)
+/* Task stacks are filled with it; the lowest word is a canary */
+#define SCHED_STACK_MAGIC		0x57ac57acUL
+#define SCHED_XPSR_THUMB		BIT(24)
+#define SCHED_CONTROL_PSP		BIT(1)
+
+/* Task threads waiting for sched_set_ready() between task function runs */
+static uint32_t sched_waiting;
+/* Task threads blocked on mutex or semaphore */
+static uint32_t sched_blocked;
+/*
+ * Stack of each task slot, reserved at build time: adding a task can't run
+ * out of stacks, and too little RAM is caught on link (ld/kitchen.ld).
+ */
+static uint32_t task_stack[TASK_NR][SCHED_STACK_WORDS]
+	__attribute__((aligned(8)));
+static uint32_t idle_stack[SCHED_IDLE_STACK_SIZE / 4]
+	__attribute__((aligned(8)));
+static uint32_t *idle_sp;		/* saved stack pointer of idle thread */
+static bool threads_started;		/* context switch can be done */
+
+uint32_t *__sched_switch_context(uint32_t *sp);
+void __sched_ctxsw_account(uint32_t start);
+#endif /* CONFIG_SCHED_PREEMPT */
+
 #ifdef CONFIG_SCHED_PROFILE
 #define SCHED_PROFILER_PERIOD		5000	/* msec */
 /* 0 - collect statistics for the whole boot; 1 - for SCHED_PROFILER_PERIOD */
 #define SCHED_PROFILER_ITERATIVE	0
-/* Total execution time, including scheduler routines (sec + nsec) */
-static uint32_t profiler_total_nsec;
-static uint32_t profiler_total_sec;
-static uint32_t idle_sec;
-static uint32_t idle_nsec;
-
-static struct swtimer_sw_tim swtim;
+/* Total execution time, including scheduler routines, nsec */
+static uint64_t profiler_total_ns;
+/* Time spent in CPU sleep, nsec */
+static uint64_t idle_ns;
+#ifdef CONFIG_SCHED_PREEMPT
+/* Context switch cost (whole PendSV handler), CPU cycles */
+static struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+} ctxsw;
+static struct systick_time profiler_start;
+#endif /* CONFIG_SCHED_PREEMPT */
 #endif /* CONFIG_SCHED_PROFILE */
 
+#if defined(CONFIG_SCHED_PREEMPT) && defined(CONFIG_SCHED_PROFILE)
+/* High-water mark of task stack: words not equal to the fill pattern, bytes */
+static size_t sched_stack_used(int idx)
+{
+	size_t i;
+
+	for (i = 0; i < SCHED_STACK_WORDS; ++i) {
+		if (task_stack[idx][i] != SCHED_STACK_MAGIC)
+			break;
+	}
+
+	return (SCHED_STACK_WORDS - i) * 4;
+}
+#endif
+
 #ifdef CONFIG_SCHED_PROFILE
 
-static inline __attribute__((always_inline))
-void sched_profile_print(const char *task, int perc)
+static void sched_stat_add(struct sched_stat *st, uint64_t diff_ns)
 {
-	printk("%s : %d%%\n", task, perc);
+	const uint32_t ns = diff_ns > UINT32_MAX ? UINT32_MAX : diff_ns;
+	const uint32_t us = ns / 1000;
+	int bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	if (bucket >= SCHED_HIST_NR)
+		bucket = SCHED_HIST_NR - 1;
+
+	if (!st->count || ns < st->min)
+		st->min = ns;
+	if (ns > st->max)
+		st->max = ns;
+	st->count++;
+	st->sum += ns;
+	if (st->hist[bucket] < UINT16_MAX)
+		st->hist[bucket]++;
+}
+
+/* Print time as seconds with usec precision: no 64-bit printf needed */
+static void sched_profile_print_sec(uint64_t ns)
+{
+	const uint64_t us = ns / 1000;
+
+	printk(" %lu.%06lu", (unsigned long)(us / 1000000),
+	       (unsigned long)(us % 1000000));
+}
+
+/* Print "<count> <min> <mean> <max> <h0>..<h15>", times in usec */
+static void sched_profile_print_stat(const struct sched_stat *st)
+{
+	uint32_t mean = st->count ? st->sum / st->count : 0;
+	int i;
+
+	printk(" %lu %lu %lu %lu", (unsigned long)st->count,
+	       (unsigned long)(st->min / 1000), (unsigned long)(mean / 1000),
+	       (unsigned long)(st->max / 1000));
+	for (i = 0; i < SCHED_HIST_NR; ++i)
+		printk(" %u", st->hist[i]);
 }
 
+/*
+ * Report is a few lines, one per record, fields separated by spaces:
+ *   @sched <total_sec> <sched_and_irqs_sec> <idle_sec>
+ *   @run <task> <total_sec> <count> <min> <mean> <max> <hist...>
+ *   @lat <task> <count> <min> <mean> <max> <hist...>
+ *   @stack <task> <used> <size> (CONFIG_SCHED_PREEMPT, bytes)
+ *   @ctxsw <count> <min> <mean> <max> (CONFIG_SCHED_PREEMPT, CPU cycles)
+ *   @crit <function>:<line> <count> <max> <mean> <total> (see crit_profile.c)
+ * min/mean/max are in usec; see SCHED_HIST_NR for histogram buckets.
+ * Use scripts/sched_prof.py to show it as tables or plots.
+ *
+ * With CONFIG_SCHED_PREEMPT, run time of a task includes time it was
+ * preempted for. Stack usage is a high-water mark; used == size means the
+ * canary is gone, i.e. the stack has overflown into its neighbour.
+ */
 static void sched_profile_timer_tick(void *data)
 {
-	uint64_t tasks_ns = 0;
-	uint64_t total_ns;
-	uint64_t sched_ns, idle_ns;
-	int sched_perc, idle_perc;
+	uint64_t busy_ns = idle_ns;
 	int i;
+#ifdef CONFIG_SCHED_PREEMPT
+	struct systick_time now;
+
+	/* No super loop to measure: take time since start */
+	systick_get_time(&now);
+	profiler_total_ns = systick_calc_diff(&profiler_start, &now);
+#endif
 
 	UNUSED(data);
 
-	for (i = 0; i < TASK_NR; ++i) {
-		tasks_ns += (uint64_t)task_list[i].sec * NSEC_PER_SEC;
-		tasks_ns += (uint64_t)task_list[i].nsec;
-	}
+	for (i = 0; i < TASK_NR; ++i)
+		busy_ns += task_list[i].run.sum;
 
-	total_ns = (uint64_t)profiler_total_sec * NSEC_PER_SEC +
-		   profiler_total_nsec;
-	idle_ns = (uint64_t)idle_sec * NSEC_PER_SEC + idle_nsec;
-	idle_perc = (100ULL * idle_ns) / total_ns;
-	sched_ns = total_ns - (tasks_ns + idle_ns);
-	sched_perc = (100ULL * sched_ns) / total_ns;
+	printk("@sched");
+	sched_profile_print_sec(profiler_total_ns);
+	sched_profile_print_sec(profiler_total_ns > busy_ns ?
+				profiler_total_ns - busy_ns : 0);
+	sched_profile_print_sec(idle_ns);
+	printk("\n");
 
-	printk("\nScheduler profiler:\n");
-	sched_profile_print("sched + IRQs", sched_perc);
-	sched_profile_print("idle", idle_perc);
 	for (i = 0; i < TASK_NR; ++i) {
-		uint64_t task_ns;
-		int task_perc;
+		struct task *t = &task_list[i];
 
-		if (!task_list[i].func)
+		if (!t->desc)
 			continue;
 
-		task_ns = (uint64_t)task_list[i].sec * NSEC_PER_SEC +
-			  task_list[i].nsec;
-		task_perc = (100ULL * task_ns) / total_ns;
+		printk("@run %s", t->desc->name);
+		sched_profile_print_sec(t->run.sum);
+		sched_profile_print_stat(&t->run);
+		printk("\n@lat %s", t->desc->name);
+		sched_profile_print_stat(&t->lat);
+		printk("\n");
+#ifdef CONFIG_SCHED_PREEMPT
+		printk("@stack %s %u %u\n", t->desc->name,
+		       (unsigned int)sched_stack_used(i),
+		       (unsigned int)CONFIG_SCHED_STACK_SIZE);
+#endif
 #if SCHED_PROFILER_ITERATIVE == 1
-		task_list[i].sec = 0;
-		task_list[i].nsec = 0;
+		memset(&t->run, 0, sizeof(t->run));
+		memset(&t->lat, 0, sizeof(t->lat));
 #endif
-
-		sched_profile_print(task_list[i].name, task_perc);
 	}
 
+#ifdef CONFIG_SCHED_PREEMPT
+	printk("@ctxsw %lu %lu %lu %lu\n", (unsigned long)ctxsw.count,
+	       (unsigned long)ctxsw.min,
+	       (unsigned long)(ctxsw.count ? ctxsw.sum / ctxsw.count : 0),
+	       (unsigned long)ctxsw.max);
+#endif
+
+	crit_profile_report();
+
 #if SCHED_PROFILER_ITERATIVE == 1
-	profiler_total_sec = 0;
-	profiler_total_nsec = 0;
-	idle_sec = 0;
-	idle_nsec = 0;
+	profiler_total_ns = 0;
+	idle_ns = 0;
+#ifdef CONFIG_SCHED_PREEMPT
+	profiler_start = now;
+	memset(&ctxsw, 0, sizeof(ctxsw));
+#endif
 #endif
 }
 
+DEFINE_SWTIMER(sched_profile_swtim, sched_profile_timer_tick, NULL,
+	       SCHED_PROFILER_PERIOD);
+
 static void sched_profile_init(void)
 {
-	swtim.cb	= sched_profile_timer_tick;
-	swtim.period	= SCHED_PROFILER_PERIOD;
-	swtim.data	= &swtim;
-	swtimer_tim_register(&swtim);
+#ifdef CONFIG_SCHED_PREEMPT
+	if (!dwt_enable_cycle_counter())
+		pr_warn("Warning: No cycle counter for context switch cost\n");
+#endif
 }
 
 #else /* !CONFIG_SCHED_PROFILE */
@@ -117,19 +268,15 @@ static inline void sched_profile_init(void) { }
  */
 static void sched_set_blocked(int task_id)
 {
-	unsigned long flags;
-
-	enter_critical(flags);
-	WRITE_ONCE(sched_ready, sched_ready & ~BIT(task_id));
-	exit_critical(flags);
+	clear_bit(task_id, &sched_ready);
 }
 
 static int sched_find_empty_slot(void)
 {
 	int i;
 
-	for (i = 0; i < TASK_NR; ++i) {
-		if (!task_list[i].func)
+	for (i = SCHED_STATIC_NR; i < TASK_NR; ++i) {
+		if (!task_list[i].desc)
 			return i;
 	}
 
@@ -140,14 +287,22 @@ static int sched_slot_by_name(const char *name)
 {
 	int i;
 
-	for (i = 0; i < TASK_NR; ++i) {
-		if (strcmp(name, task_list[i].name) == 0)
+	/* DEFINE_TASK() tasks may be not bound to slots yet */
+	for (i = 0; i < SCHED_STATIC_NR; ++i) {
+		if (strcmp(name, __sched_tasks_start[i].name) == 0)
+			return i;
+	}
+
+	for (i = SCHED_STATIC_NR; i < TASK_NR; ++i) {
+		if (task_list[i].desc &&
+		    strcmp(name, task_list[i].desc->name) == 0)
 			return i;
 	}
 
 	return -1;
 }
 
+#ifndef CONFIG_SCHED_PREEMPT
 /**
  * Look for the next ready to run task.
  *
@@ -172,6 +327,7 @@ static int sched_find_next(void)
 
 	return -1;
 }
+#endif /* !CONFIG_SCHED_PREEMPT */
 
 #ifdef CONFIG_SCHED_IDLE
 /**
@@ -191,7 +347,6 @@ static inline __attribute__((always_inline)) void sched_idle(void)
 {
 #ifdef CONFIG_SCHED_PROFILE
 	struct systick_time t1, t2;
-	uint64_t diff_ns;
 
 	systick_get_time(&t1);
 #endif
@@ -206,15 +361,11 @@ static inline __attribute__((always_inline)) void sched_idle(void)
 	isb();
 	wfi();
 	isb();
+	crit_profile_restart();
 
 #ifdef CONFIG_SCHED_PROFILE
 	systick_get_time(&t2);
-	diff_ns = systick_calc_diff(&t1, &t2);
-	idle_nsec += (uint32_t)diff_ns;
-	while (idle_nsec > NSEC_PER_SEC) {
-		idle_nsec -= NSEC_PER_SEC;
-		idle_sec++;
-	}
+	idle_ns += systick_calc_diff(&t1, &t2);
 #endif
 }
 #else
@@ -223,6 +374,40 @@ static inline void sched_idle(void)
 }
 #endif
 
+/**
+ * Run task function once.
+ *
+ * @param idx Index of task in task_list[]
+ */
+static void sched_run_task(int idx)
+{
+	struct task *task = &task_list[idx];
+#ifdef CONFIG_SCHED_PROFILE
+	struct systick_time t1, t2;
+
+	systick_get_time(&t1);
+	sched_stat_add(&task->lat, systick_calc_diff(&task->ready_at, &t1));
+#endif
+
+	/*
+	 * Clear the task flag (put it in "Blocked" state) before running task
+	 * function, to avoid race conditions.
+	 */
+	sched_set_blocked(idx);
+	trace_begin(TRACE_TASK, idx + 1, 0);
+	task->desc->func(task->desc->data);
+	trace_end(TRACE_TASK, idx + 1, 0);
+
+	if (task->period && task->wdt_tid >= 0)
+		wdt_task_report(task->wdt_tid);
+
+#ifdef CONFIG_SCHED_PROFILE
+	systick_get_time(&t2);
+	sched_stat_add(&task->run, systick_calc_diff(&t1, &t2));
+#endif
+}
+
+#ifndef CONFIG_SCHED_PREEMPT
 /**
  * Run next task from scheduler list.
  *
@@ -232,10 +417,6 @@ static int sched_run_next(void)
 {
 	unsigned long irq_flags;
 	int next;
-#ifdef CONFIG_SCHED_PROFILE
-	struct systick_time t1, t2;
-	uint64_t diff_ns;
-#endif
 
 	enter_critical(irq_flags);
 	if (!READ_ONCE(sched_ready)) {
@@ -249,38 +430,276 @@ static int sched_run_next(void)
 	if (next == -1)
 		return -1;
 	current = next;
+	sched_run_task(current);
+
+	return current;
+}
+#endif /* !CONFIG_SCHED_PREEMPT */
+
+#ifdef CONFIG_SCHED_PREEMPT
+/*
+ * Preemptive mode.
+ *
+ * Each task has a thread with its own stack, which runs task function each
+ * time the task is set ready, like the super loop does. Ready task with higher
+ * priority preempts the running one; tasks with the same priority don't
+ * preempt each other and take turns, so with default priorities (all 0) tasks
+ * run just like in the super loop. Context is switched in PendSV handler,
+ * which has the lowest priority, so it only runs when all ISRs are done.
+ *
+ * Threads run on PSP, handlers on MSP. Idle thread (former main context) runs
+ * when no task thread can run.
+ */
+
+/* Request context switch; takes place once all ISRs are done */
+static void sched_reschedule(void)
+{
+	if (!threads_started)
+		return;
+
+	SCB_ICSR = SCB_ICSR_PENDSVSET;
+	dsb();
+	isb();
+}
+
+/* Check if thread of task @p idx can run (not waiting and not blocked) */
+static bool sched_runnable(int idx)
+{
+	if (!task_list[idx].desc || (sched_blocked & BIT(idx)))
+		return false;
+
+	return !(sched_waiting & BIT(idx)) || (sched_ready & BIT(idx));
+}
+
+/*
+ * Pick thread to run next: the highest priority one, round-robin among equal
+ * ones. Running thread is only preempted by higher priority ones.
+ *
+ * Returns task index or -1 for idle thread.
+ */
+static int sched_pick_next(void)
+{
+	int next = -1;
+	int i;
+
+	for (i = current + 1; i <= current + TASK_NR; ++i) {
+		const int idx = i % TASK_NR;
+
+		if (!sched_runnable(idx))
+			continue;
+		if (next < 0 || task_list[idx].prio > task_list[next].prio)
+			next = idx;
+	}
+
+	if (current >= 0 && next >= 0 && !(sched_waiting & BIT(current)) &&
+	    sched_runnable(current) &&
+	    task_list[current].prio >= task_list[next].prio)
+		next = current;
+
+	return next;
+}
+
+/* Switch to the thread if it should preempt the running one */
+static void sched_preempt_check(int idx)
+{
+	if (current < 0 || task_list[idx].prio > task_list[current].prio)
+		sched_reschedule();
+}
+
+/*
+ * Called from PendSV handler: save stack pointer of running thread and return
+ * stack pointer of the next one.
+ */
+uint32_t *__sched_switch_context(uint32_t *sp)
+{
+	unsigned long flags;
+	int next;
+
+	/* ISRs must see "current" matching the picked thread */
+	enter_critical(flags);
+	if (current < 0) {
+		idle_sp = sp;
+	} else {
+		/* Overflown stack has corrupted saved context of its neighbour */
+		cm3_assert(task_stack[current][0] == SCHED_STACK_MAGIC);
+		task_list[current].sp = sp;
+	}
+
+	next = sched_pick_next();
+	current = next;
+	sp = next < 0 ? idle_sp : task_list[next].sp;
+	exit_critical(flags);
+
+	return sp;
+}
 
+/*
+ * Called at the end of PendSV handler: account cycles since its entry.
+ * Handler instructions after this call (a few cycles) are not counted.
+ */
+void __sched_ctxsw_account(uint32_t start)
+{
 #ifdef CONFIG_SCHED_PROFILE
-	systick_get_time(&t1);
-#endif
+	const uint32_t cycles = DWT_CYCCNT - start;
 
-	/*
-	 * Clear the task flag (put it in "Blocked" state) before running task
-	 * function, to avoid race conditions.
-	 */
-	sched_set_blocked(current);
-	task_list[current].func(task_list[current].data);
+	if (!ctxsw.count || cycles < ctxsw.min)
+		ctxsw.min = cycles;
+	if (cycles > ctxsw.max)
+		ctxsw.max = cycles;
+	ctxsw.count++;
+	ctxsw.sum += cycles;
+#else
+	UNUSED(start);
+#endif
+}
 
+/*
+ * Save R4..R11 to the stack of running thread (the rest is saved by CPU on
+ * exception entry), switch stacks and restore R4..R11 of the next thread.
+ *
+ * With profiler, DWT_CYCCNT (0xe0001004) is read on entry and accounted on
+ * exit, so that @ctxsw shows the cost of the whole handler.
+ */
+void __attribute__((naked)) pend_sv_handler(void)
+{
+	__asm__ __volatile__ (
 #ifdef CONFIG_SCHED_PROFILE
-	systick_get_time(&t2);
-	diff_ns = systick_calc_diff(&t1, &t2);
-	task_list[current].nsec += diff_ns;
-	while (task_list[current].nsec > NSEC_PER_SEC) {
-		task_list[current].nsec -= NSEC_PER_SEC;
-		task_list[current].sec++;
+		"ldr r3, =0xe0001004\n"
+		"ldr r3, [r3]\n"	/* entry timestamp */
+#endif
+		"mrs r0, psp\n"
+		"stmdb r0!, {r4-r11}\n"
+		"push {r3, lr}\n"	/* keep EXC_RETURN and entry timestamp */
+		"bl __sched_switch_context\n"
+		"pop {r3, lr}\n"
+		"ldmia r0!, {r4-r11}\n"
+		"msr psp, r0\n"
+#ifdef CONFIG_SCHED_PROFILE
+		"push {r3, lr}\n"
+		"mov r0, r3\n"
+		"bl __sched_ctxsw_account\n"
+		"pop {r3, lr}\n"
+#endif
+		"bx lr"
+	);
+}
+
+/* Thread of task @p idx: run task function each time the task is ready */
+static void __attribute__((noreturn)) sched_thread(int idx)
+{
+	for (;;) {
+		if (test_bit(idx, &sched_ready))
+			sched_run_task(idx);
+
+		/* Let tasks with the same priority run before the next turn */
+		set_bit(idx, &sched_waiting);
+		sched_reschedule();
+		clear_bit(idx, &sched_waiting);
 	}
+}
+
+/*
+ * Prepare stack of task thread, as if it was preempted at sched_thread().
+ * The rest of the stack is filled with SCHED_STACK_MAGIC for the canary and
+ * the high-water mark.
+ */
+static void sched_init_stack(int idx)
+{
+	uint32_t *sp = task_stack[idx] + ARRAY_SIZE(task_stack[idx]);
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(task_stack[idx]); ++i)
+		task_stack[idx][i] = SCHED_STACK_MAGIC;
+
+	/* Exception frame, stacked by CPU */
+	*--sp = SCHED_XPSR_THUMB;			/* xPSR */
+	*--sp = (uint32_t)sched_thread & ~1UL;		/* PC */
+	*--sp = 0;					/* LR */
+	*--sp = 0;					/* R12 */
+	*--sp = 0;					/* R3 */
+	*--sp = 0;					/* R2 */
+	*--sp = 0;					/* R1 */
+	*--sp = idx;					/* R0 */
+	/* R4..R11, stacked by PendSV handler */
+	sp -= 8;
+
+	task_list[idx].sp = sp;
+}
+
+/*
+ * Idle thread: sleep while no task thread can run. Only request the switch
+ * when there is a task thread to switch to, so that idle doesn't switch to
+ * itself on each wakeup.
+ */
+static void __attribute__((noreturn)) sched_idle_thread(void)
+{
+	unsigned long flags;
+
+	for (;;) {
+		enter_critical(flags);
+		if (sched_pick_next() >= 0) {
+			sched_reschedule();
+		} else {
+#ifdef CONFIG_SCHED_IDLE
+			sched_idle();
+#else
+			/* No busy loop here even without CONFIG_SCHED_IDLE */
+			dsb();
+			wfi();
 #endif
+		}
+		exit_critical(flags);
+	}
+}
 
-	return current;
+/* Turn current context into idle thread and start task threads */
+static void __attribute__((noreturn)) sched_preempt_start(void)
+{
+#ifdef CONFIG_SCHED_PROFILE
+	systick_get_time(&profiler_start);
+#endif
+	current = -1;
+	threads_started = true;
+
+	/* Move to PSP; MSP keeps its current value for handlers */
+	__asm__ __volatile__ (
+		"msr psp, %0\n"
+		"msr control, %1\n"
+		"isb"
+		:
+		: "r" (idle_stack + ARRAY_SIZE(idle_stack)),
+		  "r" (SCHED_CONTROL_PSP)
+		: "memory");
+
+	sched_idle_thread();
 }
+#endif /* CONFIG_SCHED_PREEMPT */
 
 /**
  * Initialize the scheduler.
  *
+ * Binds DEFINE_TASK() tasks to their slots: descriptors stay in flash.
+ *
  * @return 0 on success or negative value on error
  */
 int sched_init(void)
 {
+	int i;
+
+	if (SCHED_STATIC_NR > TASK_NR)
+		return -1;
+
+	for (i = 0; i < SCHED_STATIC_NR; ++i) {
+		task_list[i].desc = &__sched_tasks_start[i];
+#ifdef CONFIG_SCHED_PREEMPT
+		sched_init_stack(i);
+#endif
+	}
+
+#ifdef CONFIG_SCHED_PREEMPT
+	/* PendSV must not preempt any ISR (SHPR index is exception number - 4) */
+	SCB_SHPR(14 - 4) = 0xff;
+#endif
 	sched_profile_init();
 	return 0;
 }
@@ -288,16 +707,20 @@ int sched_init(void)
 /**
  * Initiate the heart beat.
  *
- * Run the super loop, which executes registered tasks.
+ * Run the super loop, which executes registered tasks. With
+ * CONFIG_SCHED_PREEMPT, start task threads instead; caller context becomes the
+ * idle thread.
  *
  * @note Does not return.
  */
 int sched_start(void)
 {
+#ifdef CONFIG_SCHED_PREEMPT
+	sched_preempt_start();
+#else
 	for (;;) {
 #ifdef CONFIG_SCHED_PROFILE
 		struct systick_time t1, t2;
-		uint64_t diff_ns;
 
 		systick_get_time(&t1);
 #endif
@@ -306,14 +729,10 @@ int sched_start(void)
 
 #ifdef CONFIG_SCHED_PROFILE
 		systick_get_time(&t2);
-		diff_ns = systick_calc_diff(&t1, &t2);
-		profiler_total_nsec += diff_ns;
-		while (profiler_total_nsec > NSEC_PER_SEC) {
-			profiler_total_nsec -= NSEC_PER_SEC;
-			profiler_total_sec++;
-		}
+		profiler_total_ns += systick_calc_diff(&t1, &t2);
 #endif
 	}
+#endif
 }
 
 /**
@@ -352,9 +771,13 @@ int sched_add_task(const char *name, task_func_t func, void *data,
 
 	/* Add new task to task list */
 	memset(&task_list[slot], 0, sizeof(struct task));
-	task_list[slot].name = name;
-	task_list[slot].func = func;
-	task_list[slot].data = data;
+	task_list[slot].dyn.name = name;
+	task_list[slot].dyn.func = func;
+	task_list[slot].dyn.data = data;
+	task_list[slot].desc = &task_list[slot].dyn;
+#ifdef CONFIG_SCHED_PREEMPT
+	sched_init_stack(slot);
+#endif
 
 	if (task_id)
 		*task_id = slot + 1;
@@ -362,6 +785,62 @@ int sched_add_task(const char *name, task_func_t func, void *data,
 	return 0;
 }
 
+/**
+ * Add new periodic scheduler task.
+ *
+ * Same as @ref sched_add_task(), but the task is also set ready each @p period
+ * msec, from swtimer interrupt (see sched_tick()). So the periodic work runs
+ * as a separate task, with its own profiler statistics, and doesn't delay
+ * software timers like a long swtimer callback does. If @p period is not
+ * longer than SCHED_WDT_PERIOD_MAX, the task also reports to watchdog after
+ * each run, under its own name.
+ *
+ * Use @p phase to spread tasks with the same period over different ticks.
+ *
+ * @param name Task name, must be unique
+ * @param func Task function (callback) to be executed in schedule loop
+ * @param data Pointer to data to be passed to task function
+ * @param period Task period, msec; rounded up to SWTIMER_HW_OVERFLOW
+ * @param phase Delay of the first run, msec; from 0 to @p period - 1
+ * @param task_id If not null, will contain ID of created task, starting from 1
+ * @return 0 on success or negative value on error
+ *
+ * @note This function can be called before sched_init() and sched_start()
+ */
+int sched_add_periodic_task(const char *name, task_func_t func, void *data,
+			    int period, int phase, int *task_id)
+{
+	struct task *task;
+	int ret, id;
+
+	if (period <= 0 || phase < 0 || phase >= period)
+		return -5;
+
+	ret = sched_add_task(name, func, data, &id);
+	if (ret < 0)
+		return ret;
+
+	task = &task_list[id - 1];
+	task->wdt_tid = -1;
+	if (period <= SCHED_WDT_PERIOD_MAX) {
+		task->wdt_tid = wdt_task_add(name);
+		if (task->wdt_tid < 0) {
+			sched_del_task(id);
+			return -6;
+		}
+	}
+
+	/* Tick handler only looks at the task once the period is set */
+	task->remaining = phase;
+	barrier();
+	WRITE_ONCE(task->period, period);
+
+	if (task_id)
+		*task_id = id;
+
+	return 0;
+}
+
 /**
  * Remove task.
  *
@@ -371,11 +850,21 @@ int sched_add_task(const char *name, task_func_t func, void *data,
 int sched_del_task(int task_id)
 {
 	int idx = task_id - 1;
+	struct task *task = &task_list[idx];
 
 	cm3_assert(idx >= 0 && idx < TASK_NR);
 
-	if (!task_list[idx].func)
+	if (!task->desc)
 		return -1;
+	if (idx < SCHED_STATIC_NR)
+		return -2;
+
+	if (task->period) {
+		/* Stop tick handler from setting the task ready again */
+		WRITE_ONCE(task->period, 0);
+		if (task->wdt_tid >= 0)
+			wdt_task_del(task->wdt_tid);
+	}
 
 	sched_set_blocked(idx);
 	memset(&task_list[idx], 0, sizeof(struct task));
@@ -383,6 +872,51 @@ int sched_del_task(int task_id)
 	return 0;
 }
 
+/**
+ * Get task name.
+ *
+ * @param task_id Task ID obtained on sched_add_task()
+ * @return Task name or NULL if there is no such task
+ */
+const char *sched_task_name(int task_id)
+{
+	int idx = task_id - 1;
+
+	cm3_assert(idx >= 0 && idx < TASK_NR);
+
+	return task_list[idx].desc ? task_list[idx].desc->name : NULL;
+}
+
+/**
+ * Count time for periodic tasks; set ready the ones whose period is out.
+ *
+ * @param msec Time passed since previous call, msec
+ *
+ * @note Called from swtimer interrupt, each SWTIMER_HW_OVERFLOW msec
+ */
+void sched_tick(int msec)
+{
+	int i;
+
+	for (i = SCHED_STATIC_NR; i < TASK_NR; ++i) {
+		struct task *task = &task_list[i];
+		int period = READ_ONCE(task->period);
+
+		if (!period)
+			continue;
+
+		task->remaining -= msec;
+		if (task->remaining > 0)
+			continue;
+
+		/* Keep the phase: don't drift by the late part of the tick */
+		task->remaining += period;
+		if (task->remaining <= 0)
+			task->remaining = period;
+		sched_set_ready(i + 1);
+	}
+}
+
 /**
  * Set "Ready" state for specified task (new data is available).
  *
@@ -392,9 +926,151 @@ int sched_del_task(int task_id)
  */
 void sched_set_ready(int task_id)
 {
+#ifdef CONFIG_SCHED_PROFILE
+	/*
+	 * Latency is counted from the first wakeup, not from repeated ones.
+	 * Task can't be run before we return, so it's fine to set the time
+	 * after the flag.
+	 */
+	if (!test_and_set_bit(task_id - 1, &sched_ready))
+		systick_get_time(&task_list[task_id - 1].ready_at);
+#else
+	set_bit(task_id - 1, &sched_ready);
+#endif
+#ifdef CONFIG_SCHED_PREEMPT
+	sched_preempt_check(task_id - 1);
+#endif
+}
+
+#ifdef CONFIG_SCHED_PREEMPT
+/**
+ * Set task priority.
+ *
+ * Ready task preempts running tasks with lower priority. Tasks with equal
+ * priorities take turns, as in the super loop.
+ *
+ * @param task_id Task ID (obtained in sched_add_task())
+ * @param prio Priority; 0 (default) is the lowest
+ */
+void sched_set_priority(int task_id, uint8_t prio)
+{
+	struct task *task = &task_list[task_id - 1];
 	unsigned long flags;
 
 	enter_critical(flags);
-	WRITE_ONCE(sched_ready, sched_ready | BIT(task_id - 1));
+	/* Don't drop priority inherited through mutex */
+	if (task->prio == task->base_prio || prio > task->prio)
+		task->prio = prio;
+	task->base_prio = prio;
 	exit_critical(flags);
+
+	sched_reschedule();
+}
+
+/* Block current thread until woken up by mutex or semaphore owner */
+static void sched_block_current(uint32_t *waiters, unsigned long *flags)
+{
+	*waiters |= BIT(current);
+	sched_blocked |= BIT(current);
+	exit_critical(*flags);
+	sched_reschedule();
+	enter_critical(*flags);
+}
+
+/* Wake up all threads in @p waiters mask */
+static void sched_wake_up(uint32_t *waiters)
+{
+	sched_blocked &= ~*waiters;
+	*waiters = 0;
+}
+
+/**
+ * Lock mutex, waiting for the owner to unlock it.
+ *
+ * While the thread waits, owner runs with the priority of the thread, if that
+ * is higher: middle priority tasks can't delay it. Inheritance is not
+ * transitive, and owner gets its own priority back on any unlock, so avoid
+ * holding a few mutexes at once. Must not be called from ISR or with
+ * interrupts disabled.
+ *
+ * @param m Mutex to lock
+ */
+void sched_mutex_lock(struct sched_mutex *m)
+{
+	unsigned long flags;
+
+	cm3_assert(current >= 0);
+
+	enter_critical(flags);
+	while (m->owner) {
+		struct task *owner = &task_list[m->owner - 1];
+
+		if (owner->prio < task_list[current].prio)
+			owner->prio = task_list[current].prio;
+		sched_block_current(&m->waiters, &flags);
+	}
+	m->owner = current + 1;
+	exit_critical(flags);
+}
+
+/**
+ * Unlock mutex locked by current task.
+ *
+ * @param m Mutex to unlock
+ */
+void sched_mutex_unlock(struct sched_mutex *m)
+{
+	struct task *task = &task_list[current];
+	unsigned long flags;
+
+	cm3_assert(current >= 0 && m->owner == current + 1);
+
+	enter_critical(flags);
+	m->owner = 0;
+	task->prio = task->base_prio;
+	sched_wake_up(&m->waiters);
+	exit_critical(flags);
+
+	/* Woken up thread may have higher priority now */
+	sched_reschedule();
+}
+
+/**
+ * Take semaphore, waiting until it's given. Must not be called from ISR or
+ * with interrupts disabled.
+ *
+ * @param s Semaphore to take
+ */
+void sched_sem_wait(struct sched_sem *s)
+{
+	unsigned long flags;
+
+	cm3_assert(current >= 0);
+
+	enter_critical(flags);
+	while (!s->count)
+		sched_block_current(&s->waiters, &flags);
+	s->count--;
+	exit_critical(flags);
+}
+
+/**
+ * Give semaphore; can be called from ISR.
+ *
+ * @param s Semaphore to give
+ */
+void sched_sem_post(struct sched_sem *s)
+{
+	unsigned long flags;
+	bool woken;
+
+	enter_critical(flags);
+	s->count++;
+	woken = s->waiters;
+	sched_wake_up(&s->waiters);
+	exit_critical(flags);
+
+	if (woken)
+		sched_reschedule();
 }
+#endif /* CONFIG_SCHED_PREEMPT */
@@ -17,6 +17,7 @@
 #include <core/swtimer.h>
 #include <core/irq.h>
 #include <core/sched.h>
+#include <core/trace.h>
 #include <core/wdt.h>
 #include <tools/common.h>
 #include <libopencm3/cm3/nvic.h>
@@ -31,7 +32,6 @@ struct swtimer {
 	struct swtimer_hw_tim hw_tim;
 	struct irq_action action;
 	int ticks;			/* global ticks counter */
-	int task_id;			/* scheduler task ID */
 	int wdt_tid;			/* watchdog timer task ID */
 	int max_slot;			/* max timer slot */
 	struct swtimer_sw_tim *timer;	/* list of timers */
@@ -40,6 +40,15 @@ struct swtimer {
 /* Singleton driver object */
 static struct swtimer swtimer;
 
+static void swtimer_task(void *data);
+DEFINE_TASK(swtimer, swtimer_task, &swtimer);
+
+/* Number of DEFINE_SWTIMER() timers; they take the first timer IDs */
+#define SWTIMER_STATIC_NR	(__swtimers_end - __swtimers_start)
+
+#define for_each_static_tim(t)						\
+	for (t = __swtimers_start; t < __swtimers_end; ++t)
+
 /* -------------------------------------------------------------------------- */
 
 static irqreturn_t swtimer_isr(int irq, void *data)
@@ -58,27 +67,37 @@ static irqreturn_t swtimer_isr(int irq, void *data)
 		return IRQ_NONE;
 
 	WRITE_ONCE(obj->ticks, SWTIMER_HW_OVERFLOW);
-	sched_set_ready(obj->task_id);
+	sched_set_ready(TASK_ID(swtimer));
+	sched_tick(SWTIMER_HW_OVERFLOW);
 	timer_clear_flag(obj->hw_tim.base, TIM_SR_UIF);
 
 	return IRQ_HANDLED;
 }
 
+static void swtimer_run_tim(struct swtimer_sw_tim *tim)
+{
+	if (!tim->active)
+		return;
+	if (tim->remaining <= 0) {
+		trace_begin(TRACE_SWTIMER, tim->id, 0);
+		tim->cb(tim->data);
+		trace_end(TRACE_SWTIMER, tim->id, 0);
+		tim->remaining = tim->period;
+	}
+	tim->remaining -= READ_ONCE(swtimer.ticks);
+}
+
 static void swtimer_task(void *data)
 {
+	struct swtimer_sw_tim * const *t;
 	struct swtimer_sw_tim *tim;
 
 	UNUSED(data);
 
-	for (tim = swtimer.timer; tim; tim = tim->next) {
-		if (!tim->active)
-			continue;
-		if (tim->remaining <= 0) {
-			tim->cb(tim->data);
-			tim->remaining = tim->period;
-		}
-		tim->remaining -= READ_ONCE(swtimer.ticks);
-	}
+	for_each_static_tim(t)
+		swtimer_run_tim(*t);
+	for (tim = swtimer.timer; tim; tim = tim->next)
+		swtimer_run_tim(tim);
 	WRITE_ONCE(swtimer.ticks, 0);
 
 	wdt_task_report(swtimer.wdt_tid);
@@ -102,7 +121,7 @@ static void swtimer_hw_init(struct swtimer *obj)
 	timer_update_on_overflow(obj->hw_tim.base);
 	timer_enable_irq(obj->hw_tim.base, TIM_DIER_UIE);
 
-	nvic_set_priority(obj->hw_tim.irq, 1);
+	nvic_set_priority(obj->hw_tim.irq, NVIC_PRIO(IRQ_PRIO_SWTIMER));
 	nvic_enable_irq(obj->hw_tim.irq);
 
 	timer_enable_counter(obj->hw_tim.base);
@@ -110,8 +129,16 @@ static void swtimer_hw_init(struct swtimer *obj)
 
 static struct swtimer_sw_tim *swtimer_find_tim(struct swtimer_sw_tim *t, int i)
 {
-	if (t == NULL)
+	struct swtimer_sw_tim * const *s;
+
+	if (t == NULL) {
+		/* Not in the list: look in DEFINE_SWTIMER() timers */
+		for_each_static_tim(s) {
+			if ((*s)->id == i)
+				return *s;
+		}
 		return NULL;
+	}
 
 	if (t->id == i)
 		return t;
@@ -148,7 +175,7 @@ int swtimer_tim_register(struct swtimer_sw_tim *tim)
 	cm3_assert(tim->cb != NULL);
 	cm3_assert(tim->period >= SWTIMER_HW_OVERFLOW);
 
-	tim->id = swtimer.max_slot + 1;
+	tim->id = SWTIMER_STATIC_NR + swtimer.max_slot + 1;
 	tim->remaining = tim->period;
 	tim->active = true;
 	tim->next = NULL;
@@ -178,6 +205,9 @@ void swtimer_tim_del(int id)
 	if (tim == NULL)
 		return;
 
+	/* DEFINE_SWTIMER() timers are not in the list */
+	tim->active = false;
+
 	if (swtimer.timer == tim) {
 		swtimer.timer = NULL;
 	} else {
@@ -286,9 +316,13 @@ int swtimer_tim_get_remaining(int id)
  */
 int swtimer_init(const struct swtimer_hw_tim *hw_tim)
 {
+	struct swtimer_sw_tim * const *t;
 	int ret;
 	struct swtimer *obj = &swtimer;
 
+	for_each_static_tim(t)
+		(*t)->id = t - __swtimers_start + 1;
+
 	obj->hw_tim		= *hw_tim;
 	obj->action.handler	= swtimer_isr;
 	obj->action.irq		= hw_tim->irq;
@@ -301,10 +335,6 @@ int swtimer_init(const struct swtimer_hw_tim *hw_tim)
 
 	swtimer_hw_init(obj);
 
-	ret = sched_add_task(SWTIMER_TASK, swtimer_task, obj, &obj->task_id);
-	if (ret < 0)
-		return -2;
-
 	swtimer.wdt_tid = wdt_task_add(SWTIMER_TASK);
 	if (swtimer.wdt_tid < 0)
 		return -3;
@@ -321,7 +351,6 @@ void swtimer_exit(void)
 	timer_disable_irq(swtimer.hw_tim.base, TIM_DIER_UIE);
 	nvic_disable_irq(swtimer.hw_tim.irq);
 	wdt_task_del(swtimer.wdt_tid);
-	sched_del_task(swtimer.task_id);
 	irq_free(&swtimer.action);
 	UNUSED(swtimer);
 }
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+/**
+ * @file
+ *
+ * Event tracing.
+ *
+ * Timestamped events (ISRs, tasks, swtimer callbacks, bus transfers) are
+ * stored to RAM ring buffer, overwriting the oldest ones. Send CONFIG_TRACE_CMD
+ * character to serial console to get the buffer dumped in binary form; use
+ * scripts/trace2json.py to convert the dump to Chrome/Perfetto trace.
+ *
+ * Dump format (little-endian):
+ *   - header: "KTRC" magic, u8 version, u8 tasks number, u16 events number,
+ *     u32 timestamp frequency (Hz)
+ *   - task names, for task IDs 1..tasks number: u8 length + characters
+ *     (0 length for empty task slot)
+ *   - events, oldest first: struct trace_event
+ */
+
+#ifdef CONFIG_TRACE
+
+#ifndef CONFIG_SERIAL_CONSOLE
+#error "CONFIG_TRACE needs CONFIG_SERIAL_CONSOLE"
+#endif
+
+#include <core/trace.h>
+#include <core/sched.h>
+#include <drivers/serial.h>
+#include <tools/common.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+#include <string.h>
+
+#define TRACE_MAGIC		"KTRC"
+#define TRACE_VERSION		1
+#define TRACE_TASK_NAME		"trace"
+
+#if CONFIG_TRACE_LEN & (CONFIG_TRACE_LEN - 1)
+#error "CONFIG_TRACE_LEN must be power of 2"
+#endif
+
+struct trace_header {
+	char magic[4];
+	uint8_t version;
+	uint8_t tasks;
+	uint16_t events;
+	uint32_t freq;
+};
+
+struct trace {
+	struct trace_event buf[CONFIG_TRACE_LEN];
+	uint32_t head;			/* number of events ever written */
+	bool frozen;			/* don't record events during dump */
+	int task_id;
+};
+
+static struct trace trace;
+
+/* Serial ISR: start dump on request */
+static void trace_rx(char c)
+{
+	if (c == CONFIG_TRACE_CMD)
+		sched_set_ready(trace.task_id);
+}
+
+/* Task: send ring buffer contents to serial console and clear it */
+static void trace_task(void *data)
+{
+	struct trace_header hdr;
+	uint32_t first, i;
+	int id;
+
+	UNUSED(data);
+
+	WRITE_ONCE(trace.frozen, true);
+	barrier();
+
+	first = trace.head > CONFIG_TRACE_LEN ? trace.head - CONFIG_TRACE_LEN
+					      : 0;
+
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.tasks = TASK_NR;
+	hdr.events = trace.head - first;
+	hdr.freq = rcc_ahb_frequency;
+	serial_write(&hdr, sizeof(hdr));
+
+	for (id = 1; id <= TASK_NR; ++id) {
+		const char *name = sched_task_name(id);
+		uint8_t len = name ? strlen(name) : 0;
+
+		serial_write(&len, 1);
+		serial_write(name, len);
+	}
+
+	for (i = first; i != trace.head; ++i)
+		serial_write(&trace.buf[i % CONFIG_TRACE_LEN],
+			     sizeof(struct trace_event));
+
+	trace.head = 0;
+	barrier();
+	WRITE_ONCE(trace.frozen, false);
+}
+
+/**
+ * Record an event.
+ *
+ * Can be called from any context, including ISR.
+ *
+ * @param type Event type (enum trace_type), OR-ed with TRACE_END for the end
+ *             of the event
+ * @param id Event source, see enum trace_type
+ * @param arg Event specific data, see enum trace_type
+ */
+void trace_event(uint8_t type, uint8_t id, uint16_t arg)
+{
+	struct trace_event *e;
+	unsigned long flags;
+
+	if (READ_ONCE(trace.frozen))
+		return;
+
+	enter_critical(flags);
+	e = &trace.buf[trace.head % CONFIG_TRACE_LEN];
+	e->ts = DWT_CYCCNT;
+	e->type = type;
+	e->id = id;
+	e->arg = arg;
+	trace.head++;
+	exit_critical(flags);
+}
+
+/**
+ * Initialize tracing.
+ *
+ * Must be called after serial console initialization.
+ *
+ * @return 0 on success or negative value on error
+ */
+int trace_init(void)
+{
+	int ret;
+
+	if (!dwt_enable_cycle_counter())
+		return -1;
+
+	ret = sched_add_task(TRACE_TASK_NAME, trace_task, NULL,
+			     &trace.task_id);
+	if (ret < 0)
+		return ret;
+
+	return serial_set_rx_callback(trace_rx);
+}
+
+#endif /* CONFIG_TRACE */
@@ -41,6 +41,7 @@
 
 #include <core/wdt.h>
 #include <core/sched.h>
+#include <tools/bitops.h>
 #include <libopencm3/stm32/iwdg.h>
 #include <string.h>
 
@@ -50,23 +51,28 @@ struct wdt {
 	const char *task_names[MAX_WDT_TASKS];	/* registered tasks names */
 	uint32_t tasks;				/* registered tasks mask */
 	uint32_t executed_tasks;		/* executed tasks mask */
-	int tid;				/* WDT task ID */
 };
 
-static const char * const wdt_task_name = "wdt_task";
 static struct wdt wdt;
 
 static void wdt_task(void *data)
 {
+	uint32_t executed = READ_ONCE(wdt.executed_tasks);
+
 	UNUSED(data);
 
-	/* Ignore the case when some extra bits are set in executed_tasks */
-	if ((wdt.tasks & wdt.executed_tasks) == wdt.tasks) {
+	/*
+	 * Ignore the case when some extra bits are set in executed_tasks. Only
+	 * clear the reports seen here: new ones may come from ISRs meanwhile.
+	 */
+	if ((wdt.tasks & executed) == wdt.tasks) {
 		wdt_reset();
-		wdt.executed_tasks = 0;
+		atomic_fetch_and(&wdt.executed_tasks, ~executed);
 	}
 }
 
+DEFINE_TASK(wdt_task, wdt_task, NULL);
+
 /**
  * Initialize the watchdog timer and prepare per-task functionality.
  *
@@ -77,7 +83,7 @@ int wdt_init(void)
 	iwdg_set_period_ms(CONFIG_WDT_PERIOD);
 	iwdg_start();
 
-	return sched_add_task(wdt_task_name, wdt_task, NULL, &wdt.tid);
+	return 0;
 }
 
 /**
@@ -118,8 +124,8 @@ int wdt_task_add(const char *name)
 		return -2;
 
 	wdt.task_names[idx] = name;
-	wdt.tasks |= BIT(idx);
-	wdt.executed_tasks &= ~BIT(idx);
+	set_bit(idx, &wdt.tasks);
+	clear_bit(idx, &wdt.executed_tasks);
 
 	return idx + 1;
 }
@@ -140,8 +146,8 @@ int wdt_task_del(int id)
 		return -1;
 
 	wdt.task_names[idx] = NULL;
-	wdt.tasks &= ~BIT(idx);
-	wdt.executed_tasks &= ~BIT(idx);
+	clear_bit(idx, &wdt.tasks);
+	clear_bit(idx, &wdt.executed_tasks);
 
 	return 0;
 }
@@ -160,8 +166,8 @@ void wdt_task_report(int id)
 	cm3_assert(idx >= 0 && idx < MAX_WDT_TASKS);
 	cm3_assert(wdt.task_names[idx] != NULL);
 
-	wdt.executed_tasks |= BIT(idx);
-	sched_set_ready(wdt.tid);
+	set_bit(idx, &wdt.executed_tasks);
+	sched_set_ready(TASK_ID(wdt_task));
 }
 
 #endif /* CONFIG_WDT */
@@ -5,13 +5,58 @@
 
 #include <drivers/buzzer.h>
 #include <tools/common.h>
-#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
 #include <stddef.h>
 #include <string.h>
 
+/* Max. value of 16-bit timer registers (PSC, ARR) */
+#define TIM_MAX			0xffff
+
+/**
+ * Stop playing the sound.
+ *
+ * Output is forced low, so no current flows through the buzzer.
+ *
+ * @param obj Buzzer object
+ */
 void buzzer_stop_sound(struct buzzer *obj)
 {
-	gpio_clear(obj->port, obj->pin);
+	timer_set_oc_mode(obj->tim.base, obj->tim.oc, TIM_OCM_FORCE_LOW);
+	timer_disable_counter(obj->tim.base);
+}
+
+/**
+ * Start playing the sound; it keeps playing until stopped.
+ *
+ * Square wave (50% duty cycle) is generated by the timer, so it takes no CPU
+ * time. Prescaler is chosen to be the smallest possible, which gives the best
+ * pitch accuracy.
+ *
+ * @param obj Buzzer object
+ * @param freq Tone frequency, Hz; 0 means silence
+ */
+void buzzer_start_sound(struct buzzer *obj, uint16_t freq)
+{
+	uint32_t cycles, psc, arr;
+
+	if (freq == 0) {
+		buzzer_stop_sound(obj);
+		return;
+	}
+
+	cycles = obj->clk / freq;
+	psc = (cycles - 1) / (TIM_MAX + 1);
+	arr = cycles / (psc + 1) - 1;
+
+	timer_disable_counter(obj->tim.base);
+	timer_set_prescaler(obj->tim.base, psc);
+	timer_set_period(obj->tim.base, arr);
+	timer_set_oc_value(obj->tim.base, obj->tim.oc, (arr + 1) / 2);
+	timer_set_oc_mode(obj->tim.base, obj->tim.oc, TIM_OCM_PWM1);
+	/* Load preloaded registers and restart the period */
+	timer_generate_event(obj->tim.base, TIM_EGR_UG);
+	timer_enable_counter(obj->tim.base);
 }
 
 /**
@@ -23,29 +68,49 @@ void buzzer_stop_sound(struct buzzer *obj)
  */
 void buzzer_make_sound(struct buzzer *obj, uint16_t freq, uint16_t duration)
 {
-	uint16_t cycles = freq * duration / 1000;
-	uint16_t pause = 1000 / freq;
-	size_t i;
-
-	for (i = 0; i < cycles; i++) {
-		gpio_toggle(obj->port, obj->pin);
-		mdelay(pause);
-	}
-
-	gpio_clear(obj->port, obj->pin);
+	buzzer_start_sound(obj, freq);
+	mdelay(duration);
+	buzzer_stop_sound(obj);
 }
 
-int buzzer_init(struct buzzer *obj, uint32_t gpio_port, uint16_t gpio_pin)
+/**
+ * Initialize buzzer driven by timer PWM output.
+ *
+ * @param obj Buzzer object
+ * @param tim Timer and channel connected to the buzzer
+ * @return 0 on success
+ *
+ * @note Timer clock should be enabled and buzzer pin should be configured as
+ *       alternate function output before calling this function.
+ */
+int buzzer_init(struct buzzer *obj, const struct buzzer_tim *tim)
 {
-	obj->port = gpio_port;
-	obj->pin = gpio_pin;
+	cm3_assert(obj != NULL);
+	cm3_assert(tim != NULL);
+
+	obj->tim = *tim;
+
+	/* APB1 timers are clocked with x2 frequency if APB1 is divided */
+	obj->clk = rcc_apb1_frequency;
+	if (rcc_apb1_frequency != rcc_ahb_frequency)
+		obj->clk *= 2;
 
-	gpio_set(obj->port, obj->pin);
+	rcc_periph_reset_pulse(obj->tim.rst);
+	timer_set_mode(obj->tim.base, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE,
+		       TIM_CR1_DIR_UP);
+	timer_enable_preload(obj->tim.base);
+	timer_enable_oc_preload(obj->tim.base, obj->tim.oc);
+	timer_set_oc_polarity_high(obj->tim.base, obj->tim.oc);
+	timer_set_oc_mode(obj->tim.base, obj->tim.oc, TIM_OCM_FORCE_LOW);
+	timer_enable_oc_output(obj->tim.base, obj->tim.oc);
 
 	return 0;
 }
 
 void buzzer_exit(struct buzzer *obj)
 {
+	buzzer_stop_sound(obj);
+	timer_disable_oc_output(obj->tim.base, obj->tim.oc);
+	rcc_periph_reset_pulse(obj->tim.rst);
 	memset(obj, 0, sizeof(*obj));
 }
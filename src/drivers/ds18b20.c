@@ -11,12 +11,21 @@
 #include <libopencm3/stm32/gpio.h>
 #include <stddef.h>
 
-#define TEMPERATURE_CONV_TIME		900
+#define TEMPERATURE_CONV_TIME		DS18B20_CONV_TIME
 
 #define CMD_SKIP_ROM			0xcc
+#define CMD_ALARM_SEARCH		0xec
 #define CMD_CONVERT_T			0x44
+#define CMD_WRITE_SCRATCHPAD		0x4e
 #define CMD_READ_SCRATCHPAD		0xbe
 
+/* Configuration register value for 12-bit resolution (power-on default) */
+#define CONFIG_RES_12BIT		0x7f
+/* Both ROM bit and its complement read as 1: nobody answered the search */
+#define SEARCH_NO_DEVICES		0x3
+/* Read scratchpad at least once in this many conversions */
+#define FORCED_READ_PERIOD		12
+
 static struct ow ow;
 
 /**
@@ -55,25 +64,28 @@ static struct ds18b20_temp ds18b20_parse_temp(uint8_t lsb, uint8_t msb)
 	return tv;
 }
 
-/**
- * Read temperature register from DS18B20.
- *
- * @param obj 1-wire device object
- * @return Parsed value
+/*
+ * Start temperature conversion and wait for it to finish. Interrupts only make
+ * the wait longer, so they are not disabled here.
  */
-struct ds18b20_temp ds18b20_read_temp(struct ds18b20 *obj)
+static void ds18b20_convert(void)
+{
+	ds18b20_start_conversion();
+	mdelay(TEMPERATURE_CONV_TIME);
+}
+
+/*
+ * Read temperature register (first two bytes of scratchpad).
+ * Returns 0 on success or -1 if device didn't respond.
+ */
+static int ds18b20_read_scratchpad(struct ds18b20 *obj)
 {
-	unsigned long flags;
 	int8_t data[2];
 	size_t i;
 
-	ow_reset_pulse(&ow);
-	ow_write_byte(&ow, CMD_SKIP_ROM);
-	ow_write_byte(&ow, CMD_CONVERT_T);
-	enter_critical(flags);
-	mdelay(TEMPERATURE_CONV_TIME);
-	exit_critical(flags);
-	ow_reset_pulse(&ow);
+	if (ow_reset_pulse(&ow))
+		return -1;
+
 	ow_write_byte(&ow, CMD_SKIP_ROM);
 	ow_write_byte(&ow, CMD_READ_SCRATCHPAD);
 
@@ -81,10 +93,123 @@ struct ds18b20_temp ds18b20_read_temp(struct ds18b20 *obj)
 		data[i] = ow_read_byte(&ow);
 	ow_reset_pulse(&ow);
 
+	/* Bits 11..4 of temperature register: whole degrees, rounded down */
+	obj->degrees = (int8_t)(((uint8_t)data[1] << 4) |
+				((uint8_t)data[0] >> 4));
 	obj->temp = ds18b20_parse_temp(data[0], data[1]);
+
+	return 0;
+}
+
+/**
+ * Program TH/TL alarm registers around the last read temperature.
+ *
+ * DS18B20 compares only bits 11..4 of temperature register (whole degrees)
+ * against TH and TL, and flags alarm when T >= TH or T <= TL. So the narrowest
+ * possible window is the current whole degree: alarm fires as soon as the
+ * integer part of the temperature changes.
+ */
+static void ds18b20_set_window(struct ds18b20 *obj)
+{
+	obj->window_set = false;
+	if (ow_reset_pulse(&ow))
+		return;
+
+	ow_write_byte(&ow, CMD_SKIP_ROM);
+	ow_write_byte(&ow, CMD_WRITE_SCRATCHPAD);
+	ow_write_byte(&ow, (uint8_t)(obj->degrees + 1));	/* TH */
+	ow_write_byte(&ow, (uint8_t)(obj->degrees - 1));	/* TL */
+	ow_write_byte(&ow, CONFIG_RES_12BIT);
+	ow_reset_pulse(&ow);
+
+	obj->window_set = true;
+}
+
+/**
+ * Check if any device on the bus has alarm flag set.
+ *
+ * Only the first step of ALARM SEARCH algorithm is needed: if no device has
+ * alarm condition, both ROM bit and its complement are read as 1.
+ *
+ * @return true if temperature left TH/TL window or device didn't respond
+ */
+static bool ds18b20_alarm_search(void)
+{
+	uint8_t bits;
+
+	/* Bus reads as 1s without device too: don't take it as "no alarm" */
+	if (ow_reset_pulse(&ow))
+		return true;
+
+	ow_write_byte(&ow, CMD_ALARM_SEARCH);
+	bits = ow_read_bits(&ow, 2);
+	ow_reset_pulse(&ow); /* abort the search */
+
+	return bits != SEARCH_NO_DEVICES;
+}
+
+/**
+ * Read temperature register from DS18B20.
+ *
+ * @param obj 1-wire device object
+ * @return Parsed value
+ */
+struct ds18b20_temp ds18b20_read_temp(struct ds18b20 *obj)
+{
+	ds18b20_convert();
+	ds18b20_read_scratchpad(obj);
+
 	return obj->temp;
 }
 
+/**
+ * Start temperature conversion and return right away.
+ *
+ * The result can be read with ds18b20_update_temp() after DS18B20_CONV_TIME.
+ */
+void ds18b20_start_conversion(void)
+{
+	ow_reset_pulse(&ow);
+	ow_write_byte(&ow, CMD_SKIP_ROM);
+	ow_write_byte(&ow, CMD_CONVERT_T);
+}
+
+/**
+ * Take result of the conversion, reading it only if it left the alarm window.
+ *
+ * After each conversion DS18B20 compares the temperature against TH/TL
+ * registers. This function checks that with ALARM SEARCH command and skips
+ * the scratchpad read when temperature is still within the window. When new
+ * value is read, the window is re-programmed around it.
+ *
+ * The window only tracks whole degrees, while tenths are shown. So the value
+ * is read anyway each FORCED_READ_PERIOD conversions, which also re-arms TH/TL
+ * in case the sensor reloaded them from EEPROM after a power-on reset.
+ *
+ * @param obj 1-wire device object
+ * @return 1 if @p obj->temp was updated or 0 if temperature is unchanged
+ *
+ * @note Conversion must be started with ds18b20_start_conversion() at least
+ *       DS18B20_CONV_TIME before calling this function.
+ */
+int ds18b20_update_temp(struct ds18b20 *obj)
+{
+	if (obj->window_set && obj->skipped < FORCED_READ_PERIOD &&
+	    !ds18b20_alarm_search()) {
+		obj->skipped++;
+		return 0;
+	}
+
+	obj->skipped = 0;
+	if (ds18b20_read_scratchpad(obj)) {
+		obj->window_set = false;	/* re-arm once it's back */
+		return 0;
+	}
+	ds18b20_set_window(obj);
+
+	return 1;
+}
+
 /**
  * Convert temperature data into null-terminated string.
  *
@@ -125,6 +250,8 @@ char *ds18b20_temp2str(struct ds18b20_temp *obj, char str[])
 
 int ds18b20_init(struct ds18b20 *obj)
 {
+	obj->window_set = false;
+	obj->skipped = 0;
 	ow.port = obj->port;
 	ow.pin = obj->pin;
 
@@ -13,6 +13,7 @@
 #include <tools/tools.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/exti.h>
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,7 +29,11 @@
 #define DS3231_A1F		BIT(0)	/* Alarm 1 flag */
 #define DS3231_A1M		BIT(7)	/* Alarm 1 mask bit */
 #define DS3231_EN32KHz		BIT(3)	/* 32 kHz output */
+#define DS3231_OSF		BIT(7)	/* Oscillator stop flag */
+#define DS3231_12H		BIT(6)	/* 12-hour mode bit of hours register */
+#define DS3231_CENTURY		BIT(7)	/* Century bit of month register */
 #define DS3231_BUF_LEN		7
+#define DS3231_DUMP_LEN		(DS3231_SR + 1) /* all registers up to SR */
 #define ALARM1_BUF_LEN		4
 #define DS3231_TASK		"ds3231"
 #define MIN_TM_YEAR		0
@@ -79,8 +84,47 @@ static bool ds3231_regs2time(struct ds3231 *obj, const struct ds3231_regs *regs,
 	return true;
 }
 
+/* Check that register holds valid BCD number within [min, max] range */
+static bool ds3231_bcd_valid(uint8_t val, uint8_t min, uint8_t max)
+{
+	if ((val & 0x0f) > 9 || (val >> 4) > 9)
+		return false;
+
+	return bcd2dec(val) >= min && bcd2dec(val) <= max;
+}
+
+/**
+ * Check time registers read from DS3231.
+ *
+ * Garbage can be found there after the battery was replaced or the chip was
+ * reset in the middle of I2C transaction. Only 24-hour mode is supported.
+ *
+ * @param buf Seconds..year registers
+ * @return true if all registers hold valid values
+ */
+static bool ds3231_time_valid(const uint8_t *buf)
+{
+	return ds3231_bcd_valid(buf[0], 0, 59) &&
+	       ds3231_bcd_valid(buf[1], 0, 59) &&
+	       !(buf[2] & DS3231_12H) && ds3231_bcd_valid(buf[2], 0, 23) &&
+	       buf[3] >= 1 && buf[3] <= 7 &&
+	       ds3231_bcd_valid(buf[4], 1, 31) &&
+	       ds3231_bcd_valid(buf[5] & ~DS3231_CENTURY, 1, 12) &&
+	       ds3231_bcd_valid(buf[6], 0, 99);
+}
+
+/* Same for alarm 1 seconds, minutes and hours registers (mask bits off) */
+static bool ds3231_alarm_valid(const uint8_t *buf)
+{
+	return ds3231_bcd_valid(buf[0] & ~DS3231_A1M, 0, 59) &&
+	       ds3231_bcd_valid(buf[1] & ~DS3231_A1M, 0, 59) &&
+	       !(buf[2] & DS3231_12H) &&
+	       ds3231_bcd_valid(buf[2] & ~DS3231_A1M, 0, 23);
+}
+
 static void ds3231_exti_init(struct ds3231 *obj)
 {
+	nvic_set_priority(obj->device.irq, NVIC_PRIO(IRQ_PRIO_RTC));
 	nvic_enable_irq(obj->device.irq);
 	exti_select_source(obj->device.pin, obj->device.port);
 	exti_set_trigger(obj->device.pin, obj->device.trig);
@@ -206,6 +250,18 @@ int ds3231_set_time(struct ds3231 *obj, struct rtc_time *tm)
 	if (ret != 0)
 		return ret;
 
+	/* Time is valid from now on, see ds3231_restore() */
+	ret = i2c_read_single_byte_poll(obj->device.addr, DS3231_SR, buf);
+	if (ret != 0)
+		return ret;
+
+	if (buf[0] & DS3231_OSF) {
+		buf[0] &= ~DS3231_OSF;
+		ret = i2c_write_buf_poll(obj->device.addr, DS3231_SR, buf, 1);
+		if (ret != 0)
+			return ret;
+	}
+
 	return 0;
 }
 
@@ -312,6 +368,76 @@ int ds3231_read_alarm(struct ds3231 *obj)
 	return 0;
 }
 
+/**
+ * Take time and alarm kept by DS3231 across MCU reset.
+ *
+ * All registers are read in one I2C transaction and checked. Time is not
+ * trusted if the oscillator was stopped (e.g. the battery was out) or any
+ * time register holds invalid value. Alarm is restored along with the time:
+ * alarm 1 time, and its state from A1IE bit. Stale A1F flag is cleared, as
+ * it would keep INT line asserted and no more alarms would come.
+ *
+ * @param obj DS3231 device object
+ * @param[out] tm Restored time
+ * @return 0 on success, -EINVAL if RTC lost time (set it with
+ *         ds3231_set_time()) or other negative value on I2C error
+ */
+int ds3231_restore(struct ds3231 *obj, struct rtc_time *tm)
+{
+	int ret;
+	uint8_t buf[DS3231_DUMP_LEN];
+	uint8_t *alarm = &buf[DS3231_ALARM1];
+	uint8_t sr;
+
+	/* Discard first reading, see ds3231_read_time() */
+	ret = i2c_read_buf_poll(obj->device.addr, DS3231_SECONDS, buf,
+				DS3231_DUMP_LEN);
+	if (ret != 0)
+		return ret;
+
+	ret = i2c_read_buf_poll(obj->device.addr, DS3231_SECONDS, buf,
+				DS3231_DUMP_LEN);
+	if (ret != 0)
+		return ret;
+
+	sr = buf[DS3231_SR];
+	if (sr & DS3231_A1F) {
+		sr &= ~DS3231_A1F;
+		ret = i2c_write_buf_poll(obj->device.addr, DS3231_SR, &sr, 1);
+		if (ret != 0)
+			return ret;
+	}
+
+	obj->alarm.status = false;
+	if ((buf[DS3231_SR] & DS3231_OSF) || !ds3231_time_valid(buf))
+		return -EINVAL;
+
+	obj->regs.ss	= buf[0];
+	obj->regs.mm	= buf[1];
+	obj->regs.hh	= buf[2];
+	obj->regs.day	= buf[3];
+	obj->regs.date	= buf[4];
+	obj->regs.month	= buf[5] & ~DS3231_CENTURY;
+	obj->regs.year	= buf[6];
+
+	if (!ds3231_regs2time(obj, &obj->regs, tm))
+		return -EINVAL;
+
+	/* Alarm date is ignored; keep it in range for ds3231_set_alarm() */
+	obj->alarm.time = *tm;
+	obj->alarm.time.tm_sec = 0;
+	if (!ds3231_alarm_valid(alarm))
+		return 0;
+
+	obj->alarm.time.tm_sec = bcd2dec(alarm[0] & ~DS3231_A1M);
+	obj->alarm.time.tm_min = bcd2dec(alarm[1] & ~DS3231_A1M);
+	obj->alarm.time.tm_hour = bcd2dec(alarm[2] & ~DS3231_A1M);
+	obj->alarm.status = (buf[DS3231_CR] & DS3231_INTCN) &&
+			    (buf[DS3231_CR] & DS3231_A1IE);
+
+	return 0;
+}
+
 /**
  * Initialize real-time clock device.
  *
@@ -15,6 +15,7 @@
  */
 
 #include <drivers/i2c.h>
+#include <core/trace.h>
 #include <tools/common.h>
 #include <libopencm3/stm32/i2c.h>
 #include <libopencm3/stm32/rcc.h>
@@ -310,8 +311,8 @@ err_timeout:
  * @param len Buffer size, in bytes
  * @return 0 on success or negative value on failure
  */
-int i2c_write_buf_poll(uint8_t addr, uint8_t reg, const uint8_t *buf,
-		       uint16_t len)
+static int __i2c_write_buf_poll(uint8_t addr, uint8_t reg, const uint8_t *buf,
+				uint16_t len)
 {
 	int ret;
 
@@ -349,6 +350,18 @@ int i2c_write_buf_poll(uint8_t addr, uint8_t reg, const uint8_t *buf,
 	return 0;
 }
 
+int i2c_write_buf_poll(uint8_t addr, uint8_t reg, const uint8_t *buf,
+		       uint16_t len)
+{
+	int ret;
+
+	trace_begin(TRACE_I2C_WRITE, addr, reg);
+	ret = __i2c_write_buf_poll(addr, reg, buf, len);
+	trace_end(TRACE_I2C_WRITE, addr, ret);
+
+	return ret;
+}
+
 /**
  * Read single byte from I2C slave device using polling mode.
  *
@@ -357,7 +370,8 @@ int i2c_write_buf_poll(uint8_t addr, uint8_t reg, const uint8_t *buf,
  * @param[out] data Variable to store data
  * @return 0 on success or negative value on error
  */
-int i2c_read_single_byte_poll(uint8_t addr, uint8_t reg, uint8_t *data)
+static int __i2c_read_single_byte_poll(uint8_t addr, uint8_t reg,
+				       uint8_t *data)
 {
 	int ret;
 
@@ -422,6 +436,17 @@ err_timeout:
 	return -ETIMEDOUT;
 }
 
+int i2c_read_single_byte_poll(uint8_t addr, uint8_t reg, uint8_t *data)
+{
+	int ret;
+
+	trace_begin(TRACE_I2C_READ, addr, reg);
+	ret = __i2c_read_single_byte_poll(addr, reg, data);
+	trace_end(TRACE_I2C_READ, addr, ret);
+
+	return ret;
+}
+
 /**
  * Read 2 bytes of data into the buffer from I2C slave device using polling
  * mode (no DMA, no IRQ).
@@ -481,7 +506,8 @@ err_timeout:
  * @param len Buffer size, in bytes, should be more than 1 byte.
  * @return 0 on success or negative value on failure
  */
-int i2c_read_buf_poll(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len)
+static int __i2c_read_buf_poll(uint8_t addr, uint8_t reg, uint8_t *buf,
+			       uint16_t len)
 {
 	int ret;
 
@@ -525,6 +551,17 @@ int i2c_read_buf_poll(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len)
 	return 0;
 }
 
+int i2c_read_buf_poll(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len)
+{
+	int ret;
+
+	trace_begin(TRACE_I2C_READ, addr, reg);
+	ret = __i2c_read_buf_poll(addr, reg, buf, len);
+	trace_end(TRACE_I2C_READ, addr, ret);
+
+	return ret;
+}
+
 /**
  * Check if slave is present on the bus.
  *
@@ -7,171 +7,311 @@
 #include <drivers/kbd.h>
 #include <core/irq.h>
 #include <core/log.h>
+#include <core/sched.h>
 #include <core/swtimer.h>
+#include <core/systick.h>
 #include <tools/common.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/exti.h>
 #include <libopencm3/stm32/gpio.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 /* Calculate button number by current scan line and read line numbers */
 #define BTN_LOOKUP(i, j)	((j) + (i) * KBD_READ_LINES)
-/* Set period for timer in msec */
-#define KBD_TIM_PERIOD		10
-/* Set total number of keyboard buttons */
-#define KEYS			4
-/* Set number of irqs */
-#define KBD_IRQS		2
-
-static struct swtimer_sw_tim swtim;
+/* Period of scan step (one scan line), msec */
+#define KBD_TIM_PERIOD		5
+/* Period of the whole matrix scan, msec */
+#define KBD_SCAN_PERIOD		(KBD_TIM_PERIOD * KBD_SCAN_LINES)
+/* Debounce integrator limit: samples to change state if no bouncing */
+#define KBD_DEBOUNCE_MAX	3
+/* Hold time to issue long press event, msec */
+#define KBD_LONG_PRESS_TIME	1000
+/* Hold time before the first auto-repeat event, msec */
+#define KBD_REPEAT_DELAY	500
+/* Auto-repeat period: starts from KBD_REPEAT_START, then gets shorter */
+#define KBD_REPEAT_START	250
+#define KBD_REPEAT_MIN		50
+#define KBD_REPEAT_ACCEL	4	/* period -= period / KBD_REPEAT_ACCEL */
 
 static void kbd_exti_init(struct kbd *obj)
 {
-	size_t i;
+	int i;
 
-	for (i = 0; i < KBD_READ_LINES; i++) {
-		nvic_enable_irq(obj->gpio.irq[i]);
-		nvic_set_priority(obj->gpio.irq[i], 0);
-		exti_select_source(obj->gpio.read[i], obj->gpio.port);
-		exti_set_trigger(obj->gpio.read[i], obj->gpio.trigger);
-		exti_enable_request(obj->gpio.read[i]);
+	exti_select_source(obj->read_mask, obj->gpio.port);
+	exti_set_trigger(obj->read_mask, obj->gpio.trigger);
+	exti_enable_request(obj->read_mask);
+
+	for (i = 0; i < obj->irq_nr; i++) {
+		nvic_set_priority(obj->action[i].irq, NVIC_PRIO(IRQ_PRIO_KBD));
+		nvic_enable_irq(obj->action[i].irq);
 	}
 }
 
+/*
+ * Only exti lines are masked: NVIC IRQs can be shared with other keyboards
+ * (e.g. EXTI9_5), so they are kept enabled.
+ */
 static void kbd_disable_exti(struct kbd *obj)
 {
-	size_t i;
-
-	for (i = 0; i < KBD_READ_LINES; i++) {
-		exti_disable_request(obj->gpio.read[i]);
-		nvic_disable_irq(obj->gpio.irq[i]);
-	};
+	exti_disable_request(obj->read_mask);
 }
 
 static void kbd_enable_exti(struct kbd *obj)
 {
-	size_t i;
+	/* Drop edges caught while scanning */
+	exti_reset_request(obj->read_mask);
+	exti_enable_request(obj->read_mask);
+}
 
-	for (i = 0; i < KBD_READ_LINES; i++) {
-		nvic_enable_irq(obj->gpio.irq[i]);
-		exti_enable_request(obj->gpio.read[i]);
-	};
+/* Drive next scan line low, release the rest (open drain) */
+static void kbd_drive_line(struct kbd *obj, int line)
+{
+	gpio_set(obj->gpio.port, obj->scan_mask & ~obj->gpio.scan[line]);
+	gpio_clear(obj->gpio.port, obj->gpio.scan[line]);
+	obj->scan_line = line;
 }
 
 static void kbd_handle_interrupt(struct kbd *obj)
 {
 	if (!obj->scan_pending) {
-		obj->btn_alarm_cb();
-		swtimer_tim_start(swtim.id);
 		kbd_disable_exti(obj);
+		/* Lines need some time to settle, so read on next timer tick */
+		kbd_drive_line(obj, 0);
+		swtimer_tim_start(obj->swtim.id);
 		obj->scan_pending = true;
 	}
 }
 
 /*
- * Find out pressed button(s) and pass it to callback.
+ * Put button event to the queue and wake up the task handling it.
+ *
+ * Events are handled in separate task, so slow event handlers (e.g. screen
+ * redraw) don't delay the scanning and other software timers.
  */
-static void kbd_handle_btn(void *data)
+static void kbd_push_event(struct kbd *obj, int btn, enum kbd_event event)
+{
+	struct kbd_key_event *ev;
+	struct systick_time t;
+	uint8_t tail = obj->tail;
+
+	if ((uint8_t)(tail - READ_ONCE(obj->head)) == KBD_QUEUE_LEN) {
+		obj->dropped++;
+		return;
+	}
+
+	systick_get_time(&t);
+
+	ev = &obj->queue[tail % KBD_QUEUE_LEN];
+	ev->time = t.sec * 1000 + t.nsec / 1000000;
+	ev->button = btn;
+	ev->event = event;
+
+	WRITE_ONCE(obj->tail, tail + 1);
+	sched_set_ready(obj->btn_task_id);
+}
+
+/* Task: pass queued button events to user callback */
+static void kbd_task(void *data)
 {
 	struct kbd *obj = (struct kbd *)(data);
-	int btn;
-	size_t i;
-	uint16_t val;
-	int ret = -1;
-	bool pressed_now[KEYS];
+	uint8_t head = obj->head;
 
-	swtimer_tim_stop(swtim.id);
+	if (obj->dropped) {
+		pr_warn("Warning: kbd: %u events dropped\n", obj->dropped);
+		obj->dropped = 0;
+	}
 
-	/* Find out the state of each button */
-	for (i = 0; i < KBD_SCAN_LINES; ++i) {
-		size_t j;
+	while (head != READ_ONCE(obj->tail)) {
+		obj->btn_event_cb(&obj->queue[head % KBD_QUEUE_LEN]);
+		head++;
+		WRITE_ONCE(obj->head, head);
+	}
+}
 
-		/* Scan next line */
-		gpio_set(obj->gpio.port, obj->scan_mask);
-		gpio_clear(obj->gpio.port, obj->gpio.scan[i]);
-		udelay(CONFIG_GPIO_STAB_DELAY);
+/* Handle hold of debounced pressed button: long press and auto-repeat */
+static void kbd_hold_key(struct kbd *obj, int btn)
+{
+	struct kbd_key *key = &obj->keys[btn];
 
-		/* Read all read lines */
-		val = gpio_port_read(obj->gpio.port) & obj->read_mask;
-		for (j = 0; j < KBD_READ_LINES; ++j) {
-			btn = BTN_LOOKUP(i, j);
-			pressed_now[btn] = !(val & obj->gpio.read[j]);
-		}
+	if (key->hold_time < KBD_LONG_PRESS_TIME) {
+		key->hold_time += KBD_SCAN_PERIOD;
+		if (key->hold_time >= KBD_LONG_PRESS_TIME)
+			kbd_push_event(obj, btn, KBD_EVENT_LONG_PRESS);
 	}
 
-	gpio_clear(obj->gpio.port, obj->scan_mask);
-	udelay(CONFIG_GPIO_STAB_DELAY);
+	if (key->repeat_left > KBD_SCAN_PERIOD) {
+		key->repeat_left -= KBD_SCAN_PERIOD;
+		return;
+	}
 
-	obj->scan_pending = false;
-	kbd_enable_exti(obj);
-
-	/* Issue callback for each changed button state */
-	for (i = 0; i < KEYS; ++i) {
-		if (pressed_now[i] && !obj->pressed[i]) {
-			obj->btn_event_cb(i, true);
-			obj->pressed[i] = true;
-			ret = 0;
-		} else if (!pressed_now[i] && obj->pressed[i]) {
-			obj->btn_event_cb(i, false);
-			obj->pressed[i] = false;
-			ret = 0;
+	kbd_push_event(obj, btn, KBD_EVENT_REPEAT);
+
+	/* Accelerate auto-repeat */
+	key->repeat_left = key->repeat_period;
+	key->repeat_period -= key->repeat_period / KBD_REPEAT_ACCEL;
+	if (key->repeat_period < KBD_REPEAT_MIN)
+		key->repeat_period = KBD_REPEAT_MIN;
+}
+
+/*
+ * Debounce button using saturating integrator and issue its events.
+ *
+ * Integrator counts up on "pressed" samples and down on "released" ones,
+ * saturating at 0 and KBD_DEBOUNCE_MAX. Debounced state only changes when
+ * integrator reaches the opposite limit. Samples don't have to be consecutive:
+ * bounces just slow it down. For a clean edge it takes KBD_DEBOUNCE_MAX
+ * samples, and every opposite sample costs two more.
+ */
+static void kbd_update_key(struct kbd *obj, int btn, bool pressed_now)
+{
+	struct kbd_key *key = &obj->keys[btn];
+
+	if (pressed_now && key->integrator < KBD_DEBOUNCE_MAX)
+		key->integrator++;
+	else if (!pressed_now && key->integrator > 0)
+		key->integrator--;
+
+	if (!key->pressed) {
+		if (key->integrator == KBD_DEBOUNCE_MAX) {
+			key->pressed = true;
+			key->hold_time = 0;
+			key->repeat_left = KBD_REPEAT_DELAY;
+			key->repeat_period = KBD_REPEAT_START;
+			kbd_push_event(obj, btn, KBD_EVENT_PRESS);
 		}
+	} else if (key->integrator == 0) {
+		key->pressed = false;
+		kbd_push_event(obj, btn, KBD_EVENT_RELEASE);
+	} else {
+		kbd_hold_key(obj, btn);
 	}
-
-	if (ret == -1)
-		pr_warn("Warning: No button is pressed\n");
 }
 
-static irqreturn_t exti1_handler(int irq, void *data)
+/* Debounce sampled state of all buttons; go idle if nothing is pressed */
+static void kbd_handle_scan(struct kbd *obj)
 {
-	struct kbd *obj = (struct kbd *)(data);
+	bool active = false;
+	int i;
 
-	UNUSED(irq);
+	for (i = 0; i < KBD_KEYS; ++i) {
+		kbd_update_key(obj, i, obj->pressed_now[i]);
+		if (obj->keys[i].integrator)
+			active = true;
+	}
 
-	kbd_handle_interrupt(obj);
-	exti_reset_request(obj->gpio.read[0]);
+	if (!active) {
+		swtimer_tim_stop(obj->swtim.id);
+		/* Nothing is pressed, so read lines don't change here */
+		gpio_clear(obj->gpio.port, obj->scan_mask);
+		obj->scan_pending = false;
+		kbd_enable_exti(obj);
+	}
+}
 
-	return IRQ_HANDLED;
+/*
+ * Scan step: sample read lines for current scan line and drive the next one.
+ *
+ * Runs periodically (from software timer) after exti fired, while any button
+ * is pressed or bouncing. Each scan line is driven for the whole timer period
+ * before sampling, so no settle delay is needed. When all buttons are
+ * released, the keyboard goes back to idle state, waiting for exti.
+ */
+static void kbd_scan_step(void *data)
+{
+	struct kbd *obj = (struct kbd *)(data);
+	int line = obj->scan_line;
+	uint16_t val;
+	int j;
+
+	val = gpio_port_read(obj->gpio.port);
+	for (j = 0; j < KBD_READ_LINES; ++j)
+		obj->pressed_now[BTN_LOOKUP(line, j)] =
+			!(val & obj->gpio.read[j]);
+
+	if (++line == KBD_SCAN_LINES) {
+		line = 0;
+		kbd_handle_scan(obj);
+		if (!obj->scan_pending)
+			return;
+	}
+
+	kbd_drive_line(obj, line);
 }
 
-static irqreturn_t exti2_handler(int irq, void *data)
+/* Shared handler for all exti lines of the keyboard */
+static irqreturn_t kbd_exti_isr(int irq, void *data)
 {
 	struct kbd *obj = (struct kbd *)(data);
+	uint32_t flags;
 
 	UNUSED(irq);
 
+	flags = exti_get_flag_status(obj->read_mask);
+	if (!flags)
+		return IRQ_NONE;
+
+	exti_reset_request(flags);
 	kbd_handle_interrupt(obj);
-	exti_reset_request(obj->gpio.read[1]);
 
 	return IRQ_HANDLED;
 }
 
-/* Store irq objects */
-static struct irq_action a[KBD_IRQS] = {
-	{
-		.handler = exti1_handler,
-		.name = "kbd_scan1",
-	},
-	{
-		.handler = exti2_handler,
-		.name = "kbd_scan2",
+/* Request IRQ for each distinct exti vector used by read lines */
+static int kbd_request_irqs(struct kbd *obj)
+{
+	int i, k;
+	int ret;
+
+	obj->irq_nr = 0;
+	for (i = 0; i < KBD_READ_LINES; i++) {
+		struct irq_action *action = &obj->action[obj->irq_nr];
+
+		ret = gpio2irq(obj->gpio.read[i]);
+		if (ret < 0)
+			goto err;
+
+		for (k = 0; k < obj->irq_nr; k++) {
+			if (obj->action[k].irq == (unsigned int)ret)
+				break;
+		}
+		if (k < obj->irq_nr)
+			continue;
+
+		action->handler = kbd_exti_isr;
+		action->irq = ret;
+		action->name = obj->gpio.name;
+		action->data = obj;
+		ret = irq_request(action);
+		if (ret < 0)
+			goto err;
+		obj->irq_nr++;
 	}
-};
+
+	return 0;
+
+err:
+	while (obj->irq_nr--)
+		irq_free(&obj->action[obj->irq_nr]);
+	return -1;
+}
 
 /**
  * Initialize the keyboard driver.
  *
  * @param obj Driver's objects
  * @param[in] gpio GPIO port and lines where the keyboard is connected
- * @param cb Callback to call when some button is pressed
+ * @param btn_event_cb Callback to call on button events (from kbd task)
  * @return 0 or negative value on error
  *
  * @note Read lines should be configured with pull up resistor before
  *       running this function.
+ * @note Several keyboards can be used, if they don't share the pins. Each of
+ *       them must have unique name.
  */
 int kbd_init(struct kbd *obj, const struct kbd_gpio *gpio,
-	     kbd_btn_event_cb_t btn_event_cb, kbd_btn_alarm_cb_t btn_alarm_cb)
+	     kbd_btn_event_cb_t btn_event_cb)
 {
 	int ret;
 	size_t i;
@@ -179,7 +319,7 @@ int kbd_init(struct kbd *obj, const struct kbd_gpio *gpio,
 	cm3_assert(obj != NULL);
 	cm3_assert(gpio != NULL);
 	cm3_assert(btn_event_cb != NULL);
-	cm3_assert(btn_alarm_cb != NULL);
+	cm3_assert(gpio->name != NULL);
 
 	obj->gpio = *gpio;
 
@@ -190,53 +330,54 @@ int kbd_init(struct kbd *obj, const struct kbd_gpio *gpio,
 	for (i = 0; i < KBD_READ_LINES; ++i)
 		obj->read_mask |= gpio->read[i];
 
+	memset(obj->keys, 0, sizeof(obj->keys));
+	obj->scan_pending = false;
+	obj->head = 0;
+	obj->tail = 0;
+	obj->dropped = 0;
+
 	/* Register the callbacks */
 	obj->btn_event_cb = btn_event_cb;
-	obj->btn_alarm_cb = btn_alarm_cb;
 
-	/* Prepare irq values for external interrupts */
-	for (i = 0; i < KBD_READ_LINES; i++) {
-		ret = gpio2irq(gpio->read[i]);
-		if (ret < 0)
-			return -1;
-		obj->gpio.irq[i] = ret;
-	}
-
-	kbd_exti_init(obj);
+	ret = sched_add_task(gpio->name, kbd_task, obj, &obj->btn_task_id);
+	if (ret < 0)
+		return ret;
 
-	/* Register software timer */
-	swtim.cb = kbd_handle_btn;
-	swtim.data = obj;
-	swtim.period = KBD_TIM_PERIOD;
-
-	swtimer_tim_register(&swtim);
-	swtimer_tim_stop(swtim.id); /* timer should be triggered by exti */
-
-	/* Register interrupt handlers */
-	for (i = 0; i < KBD_IRQS; i++) {
-		a[i].data = (void *)obj;
-		a[i].irq = obj->gpio.irq[i];
-		ret = irq_request(&a[i]);
-		if (ret < 0)
-			return ret;
-	}
+	/* Register software timer; it's started by exti */
+	obj->swtim.cb = kbd_scan_step;
+	obj->swtim.data = obj;
+	obj->swtim.period = KBD_TIM_PERIOD;
+	ret = swtimer_tim_register(&obj->swtim);
+	if (ret < 0)
+		goto err_task;
+	swtimer_tim_stop(obj->swtim.id);
 
 	/* Scan lines should be in low state */
 	gpio_clear(obj->gpio.port, obj->scan_mask);
 
+	ret = kbd_request_irqs(obj);
+	if (ret < 0)
+		goto err_tim;
+
+	kbd_exti_init(obj);
+
 	return 0;
+
+err_tim:
+	swtimer_tim_del(obj->swtim.id);
+err_task:
+	sched_del_task(obj->btn_task_id);
+	return ret;
 }
 
 void kbd_exit(struct kbd *obj)
 {
-	size_t i;
-
-	swtimer_tim_del(obj->timer_id);
+	swtimer_tim_del(obj->swtim.id);
 	kbd_disable_exti(obj);
 
 	/* Remove interrupt handlers */
-	for (i = 0; i < KBD_IRQS; i++)
-		irq_free(&a[i]);
+	while (obj->irq_nr--)
+		irq_free(&obj->action[obj->irq_nr]);
 
-	UNUSED(obj);
+	sched_del_task(obj->btn_task_id);
 }
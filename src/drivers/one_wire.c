@@ -5,6 +5,7 @@
  */
 
 #include <drivers/one_wire.h>
+#include <core/trace.h>
 #include <tools/common.h>
 #include <libopencm3/stm32/gpio.h>
 #include <stddef.h>
@@ -20,26 +21,40 @@
 #define OW_WRITE_1_PAUSE		50
 #define OW_WRITE_1_TIME			10
 
-/* Write bit on 1-wire interface. Caller must disable interrupts*/
+/*
+ * Time slots are masked with PRIMASK, one at a time: they are timed in a few
+ * usec, so even the most urgent ISR would turn written 1 into 0 or make read
+ * sample too late. Recovery time between slots has no upper limit, so it runs
+ * with interrupts enabled.
+ */
+
+/* Write bit on 1-wire interface */
 static void ow_write_bit(struct ow *obj, uint8_t bit)
 {
+	unsigned long flags;
+
+	enter_critical(flags);
 	gpio_clear(obj->port, obj->pin);
 	udelay(bit ? OW_WRITE_1_TIME : OW_WRITE_0_TIME);
 	gpio_set(obj->port, obj->pin);
+	exit_critical(flags);
 	if (bit)
 		udelay(OW_WRITE_1_PAUSE);
 }
 
-/* Read bit on 1-wire interface. Caller must disable interrupts */
+/* Read bit on 1-wire interface */
 static uint16_t ow_read_bit(struct ow *obj)
 {
+	unsigned long flags;
 	uint16_t bit = 0;
 
+	enter_critical(flags);
 	gpio_clear(obj->port, obj->pin);
 	udelay(OW_READ_INIT_TIME);
 	gpio_set(obj->port, obj->pin);
 	udelay(OW_READ_SAMPLING_TIME);
 	bit = gpio_get(obj->port, obj->pin);
+	exit_critical(flags);
 	udelay(OW_READ_PAUSE);
 
 	return ((bit != 0) ? 1 : 0);
@@ -85,15 +100,22 @@ int ow_reset_pulse(struct ow *obj)
 	unsigned long flags;
 	int val;
 
-	enter_critical(flags);
+	trace_begin(TRACE_OW_RESET, 0, 0);
+
+	/* Only minimal time is specified for reset pulse and recovery */
 	gpio_clear(obj->port, obj->pin);
 	udelay(OW_RESET_TIME);
+
+	/* PRIMASK: presence pulse must be sampled while it's there */
+	enter_critical(flags);
 	gpio_set(obj->port, obj->pin);
 	udelay(OW_PRESENCE_WAIT_TIME);
 	val = gpio_get(obj->port, obj->pin);
-	udelay(OW_RESET_TIME);
 	exit_critical(flags);
 
+	udelay(OW_RESET_TIME);
+	trace_end(TRACE_OW_RESET, 0, !!val);
+
 	if (val)
 		return -1;
 
@@ -108,35 +130,50 @@ int ow_reset_pulse(struct ow *obj)
  */
 void ow_write_byte(struct ow *obj, uint8_t byte)
 {
-	unsigned long flags;
 	size_t i;
 
-	enter_critical(flags);
+	trace_begin(TRACE_OW_WRITE, 0, byte);
 	for (i = 0; i < 8; i++) {
 		ow_write_bit(obj, byte >> i & 1);
 		udelay(OW_SLOT_WINDOW);
 	}
-	exit_critical(flags);
+	trace_end(TRACE_OW_WRITE, 0, byte);
 }
 
 /**
- * Read byte of data.
+ * Read a few bits of data.
+ *
+ * Bits are read LSB first, like it's done for the whole byte. Useful for ROM
+ * search algorithms, where the master reads bit and its complement.
  *
  * @param obj Structure to store corresponding GPIOs
- * @return Byte read from scratchpad
+ * @param count Number of bits to read; 1..8
+ * @return Bits read from the bus
  */
-int8_t ow_read_byte(struct ow *obj)
+uint8_t ow_read_bits(struct ow *obj, size_t count)
 {
-	unsigned long flags;
-	int16_t byte = 0;
+	uint8_t bits = 0;
 	size_t i;
 
-	enter_critical(flags);
-	for (i = 0; i < 8; i++) {
-		byte |= ow_read_bit(obj) << i;
+	cm3_assert(count > 0 && count <= 8);
+
+	trace_begin(TRACE_OW_READ, 0, count);
+	for (i = 0; i < count; i++) {
+		bits |= ow_read_bit(obj) << i;
 		udelay(OW_SLOT_WINDOW);
 	}
-	exit_critical(flags);
+	trace_end(TRACE_OW_READ, 0, bits);
 
-	return (int8_t)byte;
+	return bits;
+}
+
+/**
+ * Read byte of data.
+ *
+ * @param obj Structure to store corresponding GPIOs
+ * @return Byte read from scratchpad
+ */
+int8_t ow_read_byte(struct ow *obj)
+{
+	return (int8_t)ow_read_bits(obj, 8);
 }
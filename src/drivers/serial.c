@@ -15,12 +15,16 @@
 #ifdef CONFIG_SERIAL_CONSOLE
 
 #include <drivers/serial.h>
+#include <core/irq.h>
 #include <tools/common.h>
+#include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/usart.h>
 #include <stdio.h>
 #include <errno.h>
 
 static uint32_t serial_usart; /* singleton object */
+static struct irq_action serial_rx_action;
+static serial_rx_callback_t serial_rx_cb;
 
 /* Forward declaration of "syscalls", to make GCC happy */
 int _write(int fd, char *ptr, int len);
@@ -38,15 +42,84 @@ int serial_init(struct serial_params *params)
 	usart_set_flow_control(serial_usart, params->flow_control);
 	usart_enable(serial_usart);
 
+	serial_rx_action.irq = params->irq;
+
 	return 0;
 }
 
 void serial_exit(void)
 {
+	if (serial_rx_cb) {
+		usart_disable_rx_interrupt(serial_usart);
+		nvic_disable_irq(serial_rx_action.irq);
+		irq_free(&serial_rx_action);
+		serial_rx_cb = NULL;
+	}
+
 	usart_disable(serial_usart);
 	serial_usart = 0;
 }
 
+static irqreturn_t serial_rx_isr(int irq, void *data)
+{
+	UNUSED(irq);
+	UNUSED(data);
+
+	if (!(USART_SR(serial_usart) & USART_SR_RXNE))
+		return IRQ_NONE;
+
+	serial_rx_cb((char)usart_recv(serial_usart));
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * Start receiving characters from serial console.
+ *
+ * Only one user can receive characters.
+ *
+ * @param cb Function to call for each received character; runs in ISR
+ * @return 0 on success or negative value on error
+ */
+int serial_set_rx_callback(serial_rx_callback_t cb)
+{
+	int ret;
+
+	if (serial_rx_cb)
+		return -EBUSY;
+
+	serial_rx_action.handler = serial_rx_isr;
+	serial_rx_action.name = "serial";
+	serial_rx_action.data = NULL;
+	ret = irq_request(&serial_rx_action);
+	if (ret)
+		return ret;
+
+	serial_rx_cb = cb;
+	usart_enable_rx_interrupt(serial_usart);
+	nvic_set_priority(serial_rx_action.irq, NVIC_PRIO(IRQ_PRIO_SERIAL));
+	nvic_enable_irq(serial_rx_action.irq);
+
+	return 0;
+}
+
+/**
+ * Send binary data to serial console as is.
+ *
+ * Unlike printf(), there is no '\n' -> "\r\n" conversion and zero bytes are
+ * sent too.
+ *
+ * @param buf Data to send
+ * @param len Data length, bytes
+ */
+void serial_write(const void *buf, size_t len)
+{
+	const uint8_t *ptr = buf;
+
+	while (len--)
+		usart_send_blocking(serial_usart, *ptr++);
+}
+
 /* write() syscall implementation for newlib */
 int _write(int fd, char *ptr, int len)
 {
@@ -0,0 +1,429 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Author: Mark Sungurov <mark.sungurov@gmail.com>
+ */
+
+/*
+ * Wavetable tone synthesizer.
+ *
+ * Samples are streamed to DAC by DMA, paced by timer update event, from the
+ * circular buffer of two halves: while DMA plays one half, DMA ISR renders
+ * the next block into the other one. Pitch is set by DDS: phase accumulator
+ * is incremented each sample and its upper bits index one period wavetable.
+ * Each note is shaped by attack/decay/release envelope, and all notes are
+ * scaled by master volume, which can be ramped up/down slowly (e.g. for
+ * gradually getting louder alarm).
+ */
+
+#include <drivers/synth.h>
+#include <tools/common.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dac.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SYNTH_DMA_NAME		"synth"
+
+#define MS_TO_SAMPLES(ms)	((ms) * SYNTH_SAMPLE_RATE / 1000)
+#define BLOCKS_PER_SEC		(SYNTH_SAMPLE_RATE / SYNTH_BLOCK_LEN)
+
+/* DDS: phase is 32-bit, sine table has 2^WAVE_BITS samples */
+#define WAVE_BITS		8
+#define WAVE_LEN		BIT(WAVE_BITS)
+#define PHASE_PER_HZ		((uint32_t)(0x100000000ULL / SYNTH_SAMPLE_RATE))
+
+/* Envelope: level is 0..ENV_MAX, then multiplied by volume */
+#define ENV_MAX			256
+#define ENV_SUSTAIN		160
+#define ATTACK_LEN		MS_TO_SAMPLES(10)
+#define DECAY_LEN		MS_TO_SAMPLES(150)
+#define RELEASE_LEN		MS_TO_SAMPLES(30)
+
+/* 12-bit DAC code for zero signal */
+#define DAC_MID			2048
+
+static const int16_t wave_sine[WAVE_LEN] = {
+	    0,    50,   100,   151,   201,   251,   300,   350,
+	  399,   449,   497,   546,   594,   642,   690,   737,
+	  783,   830,   875,   920,   965,  1009,  1052,  1095,
+	 1137,  1179,  1219,  1259,  1299,  1337,  1375,  1411,
+	 1447,  1483,  1517,  1550,  1582,  1614,  1644,  1674,
+	 1702,  1729,  1756,  1781,  1805,  1828,  1850,  1871,
+	 1891,  1910,  1927,  1944,  1959,  1973,  1986,  1997,
+	 2008,  2017,  2025,  2032,  2037,  2041,  2045,  2046,
+	 2047,  2046,  2045,  2041,  2037,  2032,  2025,  2017,
+	 2008,  1997,  1986,  1973,  1959,  1944,  1927,  1910,
+	 1891,  1871,  1850,  1828,  1805,  1781,  1756,  1729,
+	 1702,  1674,  1644,  1614,  1582,  1550,  1517,  1483,
+	 1447,  1411,  1375,  1337,  1299,  1259,  1219,  1179,
+	 1137,  1095,  1052,  1009,   965,   920,   875,   830,
+	  783,   737,   690,   642,   594,   546,   497,   449,
+	  399,   350,   300,   251,   201,   151,   100,    50,
+	    0,   -50,  -100,  -151,  -201,  -251,  -300,  -350,
+	 -399,  -449,  -497,  -546,  -594,  -642,  -690,  -737,
+	 -783,  -830,  -875,  -920,  -965, -1009, -1052, -1095,
+	-1137, -1179, -1219, -1259, -1299, -1337, -1375, -1411,
+	-1447, -1483, -1517, -1550, -1582, -1614, -1644, -1674,
+	-1702, -1729, -1756, -1781, -1805, -1828, -1850, -1871,
+	-1891, -1910, -1927, -1944, -1959, -1973, -1986, -1997,
+	-2008, -2017, -2025, -2032, -2037, -2041, -2045, -2046,
+	-2047, -2046, -2045, -2041, -2037, -2032, -2025, -2017,
+	-2008, -1997, -1986, -1973, -1959, -1944, -1927, -1910,
+	-1891, -1871, -1850, -1828, -1805, -1781, -1756, -1729,
+	-1702, -1674, -1644, -1614, -1582, -1550, -1517, -1483,
+	-1447, -1411, -1375, -1337, -1299, -1259, -1219, -1179,
+	-1137, -1095, -1052, -1009,  -965,  -920,  -875,  -830,
+	 -783,  -737,  -690,  -642,  -594,  -546,  -497,  -449,
+	 -399,  -350,  -300,  -251,  -201,  -151,  -100,   -50,
+};
+
+/* Square: indexed by the phase MSB; same RMS as sine, so same loudness */
+#define SQUARE_BITS		1
+static const int16_t wave_square[BIT(SQUARE_BITS)] = { 1448, -1448 };
+
+/**
+ * Calculate envelope level for specified sample of current note.
+ *
+ * Attack rises linearly to ENV_MAX, decay falls to ENV_SUSTAIN, and release
+ * fades the level out to 0 by the end of the note, so there is no click on
+ * note boundaries.
+ *
+ * @param obj Synth object
+ * @param pos Sample number since note start
+ * @return Envelope level, 0..ENV_MAX
+ */
+static uint32_t synth_env(const struct synth *obj, uint32_t pos)
+{
+	uint32_t env;
+
+	if (pos >= obj->len)
+		return 0;
+
+	if (pos < ATTACK_LEN)
+		env = ENV_MAX * pos / ATTACK_LEN;
+	else if (pos < ATTACK_LEN + DECAY_LEN)
+		env = ENV_MAX - (ENV_MAX - ENV_SUSTAIN) *
+		      (pos - ATTACK_LEN) / DECAY_LEN;
+	else
+		env = ENV_SUSTAIN;
+
+	if (obj->len - pos < RELEASE_LEN)
+		env = env * (obj->len - pos) / RELEASE_LEN;
+
+	return env;
+}
+
+/* Make one step of master volume ramp; called once per block */
+static void synth_ramp_step(struct synth *obj)
+{
+	if (obj->volume == obj->vol_target)
+		return;
+
+	if (--obj->vol_cnt)
+		return;
+
+	obj->vol_cnt = obj->vol_period;
+	if (obj->volume < obj->vol_target)
+		obj->volume++;
+	else
+		obj->volume--;
+}
+
+/**
+ * Render next block of samples.
+ *
+ * Gain (envelope * volume) is only calculated on block boundaries and is
+ * interpolated linearly in between, which keeps per-sample work down to one
+ * table lookup and one multiplication.
+ *
+ * @param obj Synth object
+ * @param buf Where to put SYNTH_BLOCK_LEN samples (DAC codes)
+ */
+static void synth_fill(struct synth *obj, uint16_t *buf)
+{
+	const uint32_t gain_start = obj->gain;
+	uint32_t gain_end;
+	int32_t gain, step;
+	int i;
+
+	if (obj->pos < obj->len)
+		obj->pos += SYNTH_BLOCK_LEN;
+	synth_ramp_step(obj);
+	gain_end = synth_env(obj, obj->pos) * obj->volume;
+
+	gain = gain_start;
+	step = ((int32_t)gain_end - (int32_t)gain_start) / SYNTH_BLOCK_LEN;
+	for (i = 0; i < SYNTH_BLOCK_LEN; ++i) {
+		const int32_t s = obj->wave[obj->phase >> obj->wave_shift];
+
+		buf[i] = DAC_MID + ((s * gain) >> 16);
+		obj->phase += obj->phase_inc;
+		gain += step;
+	}
+
+	obj->gain = gain_end;
+	if (gain_start == 0 && gain_end == 0 && obj->pos >= obj->len) {
+		if (obj->idle < 2)
+			obj->idle++;
+	} else {
+		obj->idle = 0;
+	}
+}
+
+/* Start streaming; must be called with synth IRQ masked */
+static void synth_start(struct synth *obj)
+{
+	obj->idle = 0;
+	synth_fill(obj, obj->buf);
+	synth_fill(obj, obj->buf + SYNTH_BLOCK_LEN);
+
+	dma_set_number_of_data(obj->hw.dma, obj->hw.channel,
+			       ARRAY_SIZE(obj->buf));
+	dma_enable_channel(obj->hw.dma, obj->hw.channel);
+	timer_enable_counter(obj->hw.tim);
+	obj->running = true;
+}
+
+/* Stop streaming; must be called with synth IRQ masked */
+static void synth_halt(struct synth *obj)
+{
+	timer_disable_counter(obj->hw.tim);
+	dma_disable_channel(obj->hw.dma, obj->hw.channel);
+	obj->running = false;
+	obj->gain = 0;
+}
+
+static irqreturn_t synth_dma_isr(int irq, void *data)
+{
+	struct synth *obj = (struct synth *)data;
+	uint16_t *buf;
+
+	UNUSED(irq);
+
+	if (dma_get_interrupt_flag(obj->hw.dma, obj->hw.channel, DMA_HTIF)) {
+		dma_clear_interrupt_flags(obj->hw.dma, obj->hw.channel,
+					  DMA_HTIF);
+		buf = obj->buf;
+	} else if (dma_get_interrupt_flag(obj->hw.dma, obj->hw.channel,
+					  DMA_TCIF)) {
+		dma_clear_interrupt_flags(obj->hw.dma, obj->hw.channel,
+					  DMA_TCIF);
+		buf = obj->buf + SYNTH_BLOCK_LEN;
+	} else {
+		return IRQ_NONE;
+	}
+
+	synth_fill(obj, buf);
+
+	/* Both buffer halves contain silence: no need to keep DMA running */
+	if (obj->idle >= 2)
+		synth_halt(obj);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * Select wave form used for next notes.
+ *
+ * @param obj Synth object
+ * @param wave Which wavetable to use
+ */
+void synth_set_wave(struct synth *obj, enum synth_wave wave)
+{
+	unsigned long flags;
+
+	enter_critical_prio(flags, IRQ_PRIO_SYNTH);
+	if (wave == SYNTH_WAVE_SQUARE) {
+		obj->wave = wave_square;
+		obj->wave_shift = 32 - SQUARE_BITS;
+	} else {
+		obj->wave = wave_sine;
+		obj->wave_shift = 32 - WAVE_BITS;
+	}
+	exit_critical_prio(flags);
+}
+
+/**
+ * Start playing the note and return right away.
+ *
+ * Note fades out by itself by the end of @p duration; new note may be started
+ * at any time, cutting off the previous one.
+ *
+ * @param obj Synth object
+ * @param freq Tone frequency, Hz; 0 means silence
+ * @param duration Note duration, msec
+ */
+void synth_play(struct synth *obj, uint16_t freq, uint16_t duration)
+{
+	unsigned long flags;
+
+	if (freq >= SYNTH_SAMPLE_RATE / 2)
+		freq = 0;
+
+	enter_critical_prio(flags, IRQ_PRIO_SYNTH);
+	if (freq) {
+		obj->phase_inc = freq * PHASE_PER_HZ;
+		obj->len = MS_TO_SAMPLES((uint32_t)duration);
+	} else {
+		obj->len = 0;
+	}
+	obj->pos = 0;
+	if (!obj->running && obj->len)
+		synth_start(obj);
+	exit_critical_prio(flags);
+}
+
+/**
+ * Stop playing right away.
+ *
+ * Prefer synth_play() with 0 frequency, which fades the sound out smoothly.
+ *
+ * @param obj Synth object
+ */
+void synth_stop(struct synth *obj)
+{
+	unsigned long flags;
+
+	enter_critical_prio(flags, IRQ_PRIO_SYNTH);
+	obj->len = 0;
+	if (obj->running)
+		synth_halt(obj);
+	exit_critical_prio(flags);
+}
+
+/**
+ * Set master volume; cancels volume ramp if it's in progress.
+ *
+ * @param obj Synth object
+ * @param volume New level, 0..SYNTH_VOLUME_MAX
+ */
+void synth_set_volume(struct synth *obj, uint8_t volume)
+{
+	unsigned long flags;
+
+	enter_critical_prio(flags, IRQ_PRIO_SYNTH);
+	obj->volume = volume;
+	obj->vol_target = volume;
+	exit_critical_prio(flags);
+}
+
+/**
+ * Change master volume gradually, in background.
+ *
+ * Volume only changes while the sound is playing, so pauses don't eat up the
+ * ramp time.
+ *
+ * @param obj Synth object
+ * @param volume Level to reach, 0..SYNTH_VOLUME_MAX
+ * @param time Ramp duration, msec
+ */
+void synth_ramp_volume(struct synth *obj, uint8_t volume, uint32_t time)
+{
+	unsigned long flags;
+	uint32_t steps, period;
+
+	enter_critical_prio(flags, IRQ_PRIO_SYNTH);
+	steps = volume > obj->volume ? volume - obj->volume :
+				       obj->volume - volume;
+	period = steps ? time * BLOCKS_PER_SEC / 1000 / steps : 1;
+	if (period == 0)
+		period = 1;
+	else if (period > UINT16_MAX)
+		period = UINT16_MAX;
+	obj->vol_period = period;
+	obj->vol_cnt = obj->vol_period;
+	obj->vol_target = volume;
+	exit_critical_prio(flags);
+}
+
+/**
+ * Initialize synthesizer.
+ *
+ * @param obj Synth object
+ * @param hw Timer, DMA channel and DAC channel to use
+ * @return 0 on success or negative number on error
+ *
+ * @note Timer, DMA and DAC clocks should be enabled and DAC pin should be
+ *       configured as analog input before calling this function.
+ * @note DAC trigger is left disabled: DMA writes data holding register, and
+ *       DAC output is updated right away.
+ */
+int synth_init(struct synth *obj, const struct synth_hw *hw)
+{
+	uint32_t clk, dhr;
+	int ret;
+
+	cm3_assert(obj != NULL);
+	cm3_assert(hw != NULL);
+
+	memset(obj, 0, sizeof(*obj));
+	obj->hw = *hw;
+	obj->wave = wave_sine;
+	obj->wave_shift = 32 - WAVE_BITS;
+	obj->volume = SYNTH_VOLUME_MAX;
+	obj->vol_target = SYNTH_VOLUME_MAX;
+
+	obj->action.handler = synth_dma_isr;
+	obj->action.irq = obj->hw.irq;
+	obj->action.name = SYNTH_DMA_NAME;
+	obj->action.data = obj;
+	ret = irq_request(&obj->action);
+	if (ret < 0)
+		return ret;
+
+	/* APB1 timers are clocked with x2 frequency if APB1 is divided */
+	clk = rcc_apb1_frequency;
+	if (rcc_apb1_frequency != rcc_ahb_frequency)
+		clk *= 2;
+
+	/* Timer: update event requests DMA once per sample */
+	rcc_periph_reset_pulse(obj->hw.tim_rst);
+	timer_continuous_mode(obj->hw.tim);
+	timer_set_prescaler(obj->hw.tim, 0);
+	timer_set_period(obj->hw.tim, clk / SYNTH_SAMPLE_RATE - 1);
+	timer_enable_irq(obj->hw.tim, TIM_DIER_UDE);
+
+	/* DAC: no trigger, output buffer is on to drive the amplifier */
+	if (obj->hw.dac_channel == DAC_CHANNEL1)
+		dhr = (uint32_t)&DAC_DHR12R1(DAC1);
+	else
+		dhr = (uint32_t)&DAC_DHR12R2(DAC1);
+	MMIO32(dhr) = DAC_MID;
+	dac_buffer_enable(DAC1, obj->hw.dac_channel);
+	dac_enable(DAC1, obj->hw.dac_channel);
+
+	/* DMA: circular buffer -> DAC data register, 16-bit samples */
+	dma_channel_reset(obj->hw.dma, obj->hw.channel);
+	dma_set_peripheral_address(obj->hw.dma, obj->hw.channel, dhr);
+	dma_set_memory_address(obj->hw.dma, obj->hw.channel,
+			       (uint32_t)obj->buf);
+	dma_set_read_from_memory(obj->hw.dma, obj->hw.channel);
+	dma_enable_memory_increment_mode(obj->hw.dma, obj->hw.channel);
+	dma_disable_peripheral_increment_mode(obj->hw.dma, obj->hw.channel);
+	dma_set_peripheral_size(obj->hw.dma, obj->hw.channel,
+				DMA_CCR_PSIZE_32BIT);
+	dma_set_memory_size(obj->hw.dma, obj->hw.channel, DMA_CCR_MSIZE_16BIT);
+	dma_set_priority(obj->hw.dma, obj->hw.channel, DMA_CCR_PL_MEDIUM);
+	dma_enable_circular_mode(obj->hw.dma, obj->hw.channel);
+	dma_enable_half_transfer_interrupt(obj->hw.dma, obj->hw.channel);
+	dma_enable_transfer_complete_interrupt(obj->hw.dma, obj->hw.channel);
+
+	nvic_set_priority(obj->hw.irq, NVIC_PRIO(IRQ_PRIO_SYNTH));
+	nvic_enable_irq(obj->hw.irq);
+
+	return 0;
+}
+
+/* Destroy object */
+void synth_exit(struct synth *obj)
+{
+	synth_stop(obj);
+	nvic_disable_irq(obj->hw.irq);
+	dma_channel_reset(obj->hw.dma, obj->hw.channel);
+	dac_disable(DAC1, obj->hw.dac_channel);
+	rcc_periph_reset_pulse(obj->hw.tim_rst);
+	irq_free(&obj->action);
+}
@@ -6,8 +6,13 @@
 
 #include <drivers/wh1602.h>
 #include <board.h>
+#include <core/trace.h>
 #include <tools/common.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/timer.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -17,6 +22,26 @@
 #define WAIT_TIME_DELAY			5000	/* usec */
 #define EXEC_TIME_DELAY			50	/* usec */
 #define DISPLAY_CLEAN_RETURN_DELAY	2000	/* usec */
+/* Time of one busy flag read: two EN pulses */
+#define BUSY_POLL_TIME			(4 * ENABLE_PULSE_DELAY) /* usec */
+
+/* DDRAM layout in 2-line mode */
+#define DDRAM_LINE_1_ADDR		0x00
+#define DDRAM_LINE_2_ADDR		0x40
+#define DDRAM_LINE_LEN			0x28
+/* Address counter value when it points to CGRAM (or is not known) */
+#define ADDR_UNKNOWN			0xff
+/* Max. unchanged cells to re-write instead of issuing SET_ADDRESS command */
+#define FB_MAX_GAP			1
+
+/* DMA engine: one BSRR word is written to GPIO port on each timer tick */
+#define DMA_TICK			1	/* usec */
+#define XFER_RS				BIT(0)	/* data (not command) byte */
+#define XFER_LONG_DELAY			BIT(1)	/* clear/home command */
+/* Max. wait for free queue slot; longest queued byte takes ~2 msec */
+#define QUEUE_WAIT_TIMEOUT		10000	/* usec */
+#define QUEUE_WAIT_STEP			10	/* usec */
+#define WH1602_DMA_NAME			"wh1602"
 
 /* Return corresponding GPIO lines for set bits in nibble */
 #define WH_LOOKUP_GPIO(obj, nibble)					\
@@ -30,6 +55,7 @@ enum wh1602_cmd_control_bit {
 	ENTRY_MODE_SET	 = BIT(2),
 	DISPLAY_CONTROL	 = BIT(3),
 	FUNC_SET	 = BIT(5),
+	SET_CGRAM_ADDRESS = BIT(6),
 	SET_ADDRESS	 = BIT(7),
 };
 
@@ -64,30 +90,260 @@ static void wh1602_write(struct wh1602 *obj, uint8_t nibble)
 	wh1602_en_pulse(obj);
 }
 
-static void wh1602_write_cmd(struct wh1602 *obj, uint8_t cmd,
-			     unsigned int delay_us)
+/* Start DMA transfer of @p len BSRR words to LCD GPIO port */
+static void wh1602_dma_start(struct wh1602 *obj, const uint32_t *buf,
+			     uint16_t len, bool inc)
+{
+	const uint32_t dma = obj->dma.dma;
+	const uint8_t ch = obj->dma.channel;
+
+	dma_set_memory_address(dma, ch, (uint32_t)buf);
+	dma_set_number_of_data(dma, ch, len);
+	if (inc)
+		dma_enable_memory_increment_mode(dma, ch);
+	else
+		dma_disable_memory_increment_mode(dma, ch);
+	dma_enable_channel(dma, ch);
+}
+
+/*
+ * Send next queued byte, or stop the engine if queue is empty.
+ *
+ * Each nibble takes 3 ticks: data and RS lines are set up first, then EN goes
+ * high and low, so all the setup/hold times are met with 1 usec tick.
+ *
+ * Must be called with interrupts disabled (or from DMA ISR).
+ */
+static void wh1602_dma_next(struct wh1602 *obj)
+{
+	const uint32_t en = obj->gpio.en;
+	struct wh1602_xfer x;
+	uint32_t rs;
+
+	if (obj->tail == READ_ONCE(obj->head)) {
+		timer_disable_counter(obj->dma.tim);
+		obj->busy = false;
+		if (obj->done_cb)
+			obj->done_cb(obj->done_data);
+		return;
+	}
+
+	x = obj->queue[obj->tail];
+	WRITE_ONCE(obj->tail, (obj->tail + 1) & (WH1602_QUEUE_LEN - 1));
+
+	rs = (x.flags & XFER_RS) ? obj->gpio.rs : (uint32_t)obj->gpio.rs << 16;
+	obj->words[0] = obj->bsrr_nibble[x.data >> 4] | rs;
+	obj->words[1] = en;
+	obj->words[2] = en << 16;
+	obj->words[3] = obj->bsrr_nibble[x.data & 0x0f];
+	obj->words[4] = en;
+	obj->words[5] = en << 16;
+	obj->pad_len = ((x.flags & XFER_LONG_DELAY) ?
+			DISPLAY_CLEAN_RETURN_DELAY : EXEC_TIME_DELAY) /
+		       DMA_TICK;
+
+	obj->pad = false;
+	wh1602_dma_start(obj, obj->words, WH1602_BYTE_WORDS, true);
+}
+
+static irqreturn_t wh1602_dma_isr(int irq, void *data)
+{
+	/* Writing 0 to BSRR doesn't change anything: use it as a delay */
+	static const uint32_t nop_word;
+	struct wh1602 *obj = (struct wh1602 *)(data);
+
+	UNUSED(irq);
+
+	if (!dma_get_interrupt_flag(obj->dma.dma, obj->dma.channel, DMA_TCIF))
+		return IRQ_NONE;
+
+	dma_clear_interrupt_flags(obj->dma.dma, obj->dma.channel, DMA_TCIF);
+	dma_disable_channel(obj->dma.dma, obj->dma.channel);
+
+	if (obj->pad) {
+		wh1602_dma_next(obj);
+	} else {
+		/* Byte is sent; wait for LCD to execute it */
+		obj->pad = true;
+		wh1602_dma_start(obj, &nop_word, obj->pad_len, false);
+	}
+
+	return IRQ_HANDLED;
+}
+
+/* Check if DMA ISR can preempt the caller, so it's fine to wait for it */
+static bool wh1602_dma_isr_live(void)
+{
+	uint32_t ipsr, primask, basepri;
+
+	__asm__ __volatile__ ("mrs %0, ipsr" : "=r" (ipsr));
+	__asm__ __volatile__ ("mrs %0, primask" : "=r" (primask));
+	__asm__ __volatile__ ("mrs %0, basepri" : "=r" (basepri));
+
+	/* ISRs (e.g. done_cb) are not checked for their priority: don't wait */
+	if (ipsr || primask)
+		return false;
+
+	return !basepri || basepri > NVIC_PRIO(IRQ_PRIO_LCD);
+}
+
+/*
+ * Put byte to DMA engine queue and kick the engine if it's idle.
+ *
+ * If queue is full, waits for DMA ISR to free some space, but only when the
+ * ISR can run (interrupts enabled, no BASEPRI ceiling at or above LCD level)
+ * and for QUEUE_WAIT_TIMEOUT at most.
+ *
+ * Returns 0 on success or -EBUSY if the byte wasn't queued.
+ */
+static int wh1602_queue(struct wh1602 *obj, uint8_t data, uint8_t flags)
+{
+	const uint8_t head = obj->head;
+	const uint8_t next = (head + 1) & (WH1602_QUEUE_LEN - 1);
+	unsigned long irq_flags;
+	unsigned int waited = 0;
+
+	while (next == READ_ONCE(obj->tail)) {
+		if (!wh1602_dma_isr_live() || waited >= QUEUE_WAIT_TIMEOUT)
+			return -EBUSY;
+		udelay(QUEUE_WAIT_STEP);
+		waited += QUEUE_WAIT_STEP;
+	}
+
+	obj->queue[head].data = data;
+	obj->queue[head].flags = flags;
+	WRITE_ONCE(obj->head, next);
+
+	enter_critical_prio(irq_flags, IRQ_PRIO_LCD);
+	if (!obj->busy) {
+		obj->busy = true;
+		timer_enable_counter(obj->dma.tim);
+		wh1602_dma_next(obj);
+	}
+	exit_critical_prio(irq_flags);
+
+	return 0;
+}
+
+/**
+ * Read busy flag.
+ *
+ * In 4-bit mode both nibbles must be clocked out, though only DB7 of the
+ * first one (busy flag) is of interest. Data lines must be configured as
+ * inputs, RS must be low and RW must be high.
+ *
+ * @note Caller must disable interrupts
+ */
+static bool wh1602_read_busy(struct wh1602 *obj)
+{
+	bool busy;
+
+	gpio_set(obj->gpio.port, obj->gpio.en);
+	udelay(ENABLE_PULSE_DELAY);
+	busy = gpio_get(obj->gpio.port, obj->gpio.db7);
+	gpio_clear(obj->gpio.port, obj->gpio.en);
+	udelay(ENABLE_PULSE_DELAY);
+	wh1602_en_pulse(obj);
+
+	return busy;
+}
+
+/**
+ * Wait for LCD to finish executing the last instruction.
+ *
+ * When RW line is connected, busy flag is polled, so that we don't wait longer
+ * than LCD actually needs. Otherwise (or if busy flag is not cleared in time)
+ * the worst-case @p delay_us is waited.
+ *
+ * @note Caller must disable interrupts
+ */
+static void wh1602_wait_ready(struct wh1602 *obj, unsigned int delay_us)
+{
+	unsigned int polls;
+
+	if (!obj->bf_enabled) {
+		udelay(delay_us);
+		return;
+	}
+
+	gpio_set_mode(obj->gpio.port, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT,
+		      obj->pin_mask);
+	gpio_clear(obj->gpio.port, obj->gpio.rs);
+	gpio_set(obj->gpio.port, obj->gpio.rw);
+
+	for (polls = delay_us / BUSY_POLL_TIME + 1; polls; polls--) {
+		if (!wh1602_read_busy(obj))
+			break;
+	}
+
+	gpio_clear(obj->gpio.port, obj->gpio.rw);
+	gpio_set_mode(obj->gpio.port, GPIO_MODE_OUTPUT_2_MHZ,
+		      GPIO_CNF_OUTPUT_PUSHPULL, obj->pin_mask);
+}
+
+/* Returns 0 on success or -EBUSY if DMA queue stays full */
+static int wh1602_write_cmd(struct wh1602 *obj, uint8_t cmd,
+			    unsigned int delay_us)
 {
 	unsigned long flags;
 
-	enter_critical(flags);
+	if (obj->dma_enabled)
+		return wh1602_queue(obj, cmd, delay_us > EXEC_TIME_DELAY ?
+				    XFER_LONG_DELAY : 0);
+
+	/*
+	 * HD44780 only has minimal timings: ISRs may stretch the transfer and
+	 * busy wait, so only task switches are masked here.
+	 */
+	enter_critical_prio(flags, IRQ_PRIO_TASKS);
 	gpio_clear(obj->gpio.port, obj->gpio.rs);
 	wh1602_write(obj, cmd >> 4);
 	wh1602_write(obj, cmd & 0x0f);
-	udelay(delay_us);
-	exit_critical(flags);
+	wh1602_wait_ready(obj, delay_us);
+	exit_critical_prio(flags);
+
+	return 0;
 }
 
-static void wh1602_write_data(struct wh1602 *obj, uint8_t data,
-			      unsigned int delay_us)
+/* Returns 0 on success or -EBUSY if DMA queue stays full */
+static int wh1602_write_data(struct wh1602 *obj, uint8_t data,
+			     unsigned int delay_us)
 {
 	unsigned long flags;
 
-	enter_critical(flags);
+	if (obj->dma_enabled)
+		return wh1602_queue(obj, data, XFER_RS);
+
+	/* Same as for command: keep ISRs live during busy wait */
+	enter_critical_prio(flags, IRQ_PRIO_TASKS);
 	gpio_set(obj->gpio.port, obj->gpio.rs);
 	wh1602_write(obj, data >> 4);
 	wh1602_write(obj, data & 0x0f);
-	udelay(delay_us);
-	exit_critical(flags);
+	wh1602_wait_ready(obj, delay_us);
+	exit_critical_prio(flags);
+
+	return 0;
+}
+
+/* Get shadow DDRAM cell for specified address, or NULL if it's not visible */
+static uint8_t *wh1602_ddram_cell(struct wh1602 *obj, uint8_t addr)
+{
+	if (addr >= DDRAM_LINE_2_ADDR) {
+		addr -= DDRAM_LINE_2_ADDR;
+		return addr < WH1602_COLS ? &obj->ddram[LINE_2][addr] : NULL;
+	}
+
+	return addr < WH1602_COLS ? &obj->ddram[LINE_1][addr] : NULL;
+}
+
+/* Advance address counter the same way LCD does after DDRAM write */
+static void wh1602_addr_inc(struct wh1602 *obj)
+{
+	obj->addr++;
+	if (obj->addr == DDRAM_LINE_1_ADDR + DDRAM_LINE_LEN)
+		obj->addr = DDRAM_LINE_2_ADDR;
+	else if (obj->addr == DDRAM_LINE_2_ADDR + DDRAM_LINE_LEN)
+		obj->addr = DDRAM_LINE_1_ADDR;
 }
 
 /**
@@ -103,6 +359,8 @@ static void wh1602_write_data(struct wh1602 *obj, uint8_t data,
 void wh1602_clear_display(struct wh1602 *obj)
 {
 	wh1602_write_cmd(obj, CLEAR_DISPLAY, DISPLAY_CLEAN_RETURN_DELAY);
+	memset(obj->ddram, ' ', sizeof(obj->ddram));
+	obj->addr = DDRAM_LINE_1_ADDR;
 }
 
 /**
@@ -118,6 +376,7 @@ void wh1602_clear_display(struct wh1602 *obj)
 void wh1602_return_home(struct wh1602 *obj)
 {
 	wh1602_write_cmd(obj, RETURN_HOME, DISPLAY_CLEAN_RETURN_DELAY);
+	obj->addr = DDRAM_LINE_1_ADDR;
 }
 
 /**
@@ -171,6 +430,10 @@ void wh1602_set_function(struct wh1602 *obj, int dl, int n, int f)
  * @param[out] obj WH1602B object
  * @param[in] gpio GPIO info where LCD is connected
  * @return 0 if success or -1 in the case of failure
+ *
+ * @note If @p gpio->rw is set, busy flag is polled instead of waiting for
+ *       worst-case execution time. Data lines are switched to inputs then, so
+ *       they must tolerate LCD output level (e.g. LCD is powered from 3.3V).
  */
 int wh1602_init(struct wh1602 *obj, const struct wh1602_gpio *gpio)
 {
@@ -183,9 +446,12 @@ int wh1602_init(struct wh1602 *obj, const struct wh1602_gpio *gpio)
 	obj->lookup[2] = obj->gpio.db5;
 	obj->lookup[4] = obj->gpio.db6;
 	obj->lookup[8] = obj->gpio.db7;
+	obj->bf_enabled = false;
+	obj->dma_enabled = false;
 
 	/* Init pins state */
-	gpio_clear(obj->gpio.port, obj->gpio.en | obj->gpio.rs | obj->pin_mask);
+	gpio_clear(obj->gpio.port, obj->gpio.en | obj->gpio.rs | obj->gpio.rw |
+		   obj->pin_mask);
 
 	/* Startup sequence by datasheet */
 	udelay(SET_POWER_DELAY);
@@ -195,18 +461,120 @@ int wh1602_init(struct wh1602 *obj, const struct wh1602_gpio *gpio)
 	udelay(WAIT_TIME_DELAY);
 	wh1602_set_function(obj, DATA_BUS_8, LCD_1_LINE_MODE, FONT_TYPE_5_8);
 	wh1602_set_function(obj, DATA_BUS_4, LCD_2_LINE_MODE, FONT_TYPE_5_8);
+
+	/* Busy flag can be read only after 4-bit interface is set */
+	obj->bf_enabled = obj->gpio.rw != 0;
+
 	wh1602_control_display(obj, LCD_OFF, CURSOR_OFF, CURSOR_BLINK_OFF);
 	wh1602_clear_display(obj);
 	wh1602_set_entry_mode(obj, CURSOR_MOVE_RIGHT, DISABLE_LCD_SHIFT);
 	wh1602_control_display(obj, LCD_ON, CURSOR_ON, CURSOR_BLINK_ON);
 
+	/* Display is clear now, so frame buffer matches DDRAM */
+	memset(obj->cgram, 0, sizeof(obj->cgram));
+	wh1602_fb_clear(obj);
+
 	return 0;
 }
 
+/**
+ * Switch LCD output to non-blocking DMA engine.
+ *
+ * Once called, all LCD operations only queue bytes and return immediately.
+ * Timer @p dma->tim is ticking each DMA_TICK usec and requests DMA, which
+ * writes precomputed BSRR words (data nibble + EN edges) to LCD GPIO port.
+ * Execution time of each command is waited by DMA as well, by writing
+ * no-op words.
+ *
+ * @param obj LCD object, initialized with @ref wh1602_init()
+ * @param dma Timer and DMA channel to use; timer update request must be
+ *            routed to specified DMA channel
+ * @param cb Function to call (from ISR) when all queued bytes are sent;
+ *           can be NULL
+ * @param cb_data User data for @p cb
+ * @return 0 on success or negative value on error
+ */
+int wh1602_dma_init(struct wh1602 *obj, const struct wh1602_dma *dma,
+		    wh1602_done_cb_t cb, void *cb_data)
+{
+	const uint32_t tick_cycles = rcc_apb1_frequency / 1000000 * DMA_TICK;
+	int ret;
+	int i;
+
+	obj->dma = *dma;
+	obj->done_cb = cb;
+	obj->done_data = cb_data;
+	obj->head = 0;
+	obj->tail = 0;
+	obj->busy = false;
+
+	for (i = 0; i < 16; ++i) {
+		const uint16_t set = WH_LOOKUP_GPIO(obj, i);
+
+		obj->bsrr_nibble[i] = set | (uint32_t)(obj->pin_mask & ~set) << 16;
+	}
+
+	obj->action.handler = wh1602_dma_isr;
+	obj->action.irq = obj->dma.irq;
+	obj->action.name = WH1602_DMA_NAME;
+	obj->action.data = obj;
+	ret = irq_request(&obj->action);
+	if (ret < 0)
+		return ret;
+
+	/* Timer: update event each DMA_TICK requests DMA */
+	rcc_periph_reset_pulse(obj->dma.tim_rst);
+	timer_continuous_mode(obj->dma.tim);
+	timer_set_prescaler(obj->dma.tim, 0);
+	timer_set_period(obj->dma.tim, tick_cycles - 1);
+	timer_enable_irq(obj->dma.tim, TIM_DIER_UDE);
+
+	/* DMA: memory -> GPIO BSRR, 32-bit words */
+	dma_channel_reset(obj->dma.dma, obj->dma.channel);
+	dma_set_peripheral_address(obj->dma.dma, obj->dma.channel,
+				   (uint32_t)&GPIO_BSRR(obj->gpio.port));
+	dma_set_read_from_memory(obj->dma.dma, obj->dma.channel);
+	dma_disable_peripheral_increment_mode(obj->dma.dma, obj->dma.channel);
+	dma_set_peripheral_size(obj->dma.dma, obj->dma.channel,
+				DMA_CCR_PSIZE_32BIT);
+	dma_set_memory_size(obj->dma.dma, obj->dma.channel,
+			    DMA_CCR_MSIZE_32BIT);
+	dma_set_priority(obj->dma.dma, obj->dma.channel, DMA_CCR_PL_HIGH);
+	dma_enable_transfer_complete_interrupt(obj->dma.dma, obj->dma.channel);
+
+	nvic_set_priority(obj->dma.irq, NVIC_PRIO(IRQ_PRIO_LCD));
+	nvic_enable_irq(obj->dma.irq);
+
+	obj->dma_enabled = true;
+
+	return 0;
+}
+
+/**
+ * Check if DMA engine still has bytes to send.
+ *
+ * @param obj LCD object
+ * @return true if LCD output is in progress
+ */
+bool wh1602_busy(struct wh1602 *obj)
+{
+	return READ_ONCE(obj->busy);
+}
+
 /* Destroy object */
 void wh1602_exit(struct wh1602 *obj)
 {
-	UNUSED(obj);
+	if (!obj->dma_enabled)
+		return;
+
+	while (wh1602_busy(obj))
+		;
+
+	nvic_disable_irq(obj->dma.irq);
+	dma_channel_reset(obj->dma.dma, obj->dma.channel);
+	timer_disable_counter(obj->dma.tim);
+	irq_free(&obj->action);
+	obj->dma_enabled = false;
 }
 
 /**
@@ -214,10 +582,18 @@ void wh1602_exit(struct wh1602 *obj)
  *
  * @param obj Structure whose fields should be filled previously by the caller
  * @param addr DDRAM address
+ * @return 0 on success or -EBUSY if DMA queue stays full
  */
-void wh1602_set_address(struct wh1602 *obj, uint8_t addr)
+int wh1602_set_address(struct wh1602 *obj, uint8_t addr)
 {
-	wh1602_write_cmd(obj, addr | SET_ADDRESS, EXEC_TIME_DELAY);
+	int ret;
+
+	ret = wh1602_write_cmd(obj, addr | SET_ADDRESS, EXEC_TIME_DELAY);
+	if (ret)
+		return ret;
+
+	obj->addr = addr;
+	return 0;
 }
 
 /**
@@ -225,10 +601,22 @@ void wh1602_set_address(struct wh1602 *obj, uint8_t addr)
  *
  * @param obj Structure whose fields should be filled previously by the caller
  * @param data Byte of data to be writen to RAM
+ * @return 0 on success or -EBUSY if DMA queue stays full
  */
-void wh1602_write_char(struct wh1602 *obj, uint8_t data)
+int wh1602_write_char(struct wh1602 *obj, uint8_t data)
 {
-	wh1602_write_data(obj, data, EXEC_TIME_DELAY);
+	uint8_t *cell;
+	int ret;
+
+	ret = wh1602_write_data(obj, data, EXEC_TIME_DELAY);
+	if (ret)
+		return ret;
+
+	cell = wh1602_ddram_cell(obj, obj->addr);
+	if (cell)
+		*cell = data;
+	wh1602_addr_inc(obj);
+	return 0;
 }
 
 /* Function to print string */
@@ -254,3 +642,179 @@ void wh1602_set_line(struct wh1602 *obj, int line)
 {
 	wh1602_set_address(obj, line == 0 ? 0x00 : 0x40);
 }
+
+/**
+ * Clear frame buffer.
+ *
+ * Only the frame buffer is filled with spaces; LCD is not touched until
+ * @ref wh1602_fb_flush() is called. This also starts the new frame for glyph
+ * manager: CGRAM slots not requested for the new frame can be re-used.
+ *
+ * @param obj LCD object
+ */
+void wh1602_fb_clear(struct wh1602 *obj)
+{
+	memset(obj->fb, ' ', sizeof(obj->fb));
+	obj->cgram_used = 0;
+}
+
+/**
+ * Put character into frame buffer.
+ *
+ * @param obj LCD object
+ * @param line LCD line to use (LINE_1 or LINE_2)
+ * @param col Column number, starting from 0
+ * @param c Character code
+ */
+void wh1602_fb_put_char(struct wh1602 *obj, int line, int col, uint8_t c)
+{
+	if (line < 0 || line >= WH1602_ROWS || col < 0 || col >= WH1602_COLS)
+		return;
+
+	obj->fb[line][col] = c;
+}
+
+/**
+ * Print string into frame buffer.
+ *
+ * The part of string which doesn't fit into the line is dropped.
+ *
+ * @param obj LCD object
+ * @param line LCD line to use (LINE_1 or LINE_2)
+ * @param col Column to start from
+ * @param str String to print
+ */
+void wh1602_fb_print_str(struct wh1602 *obj, int line, int col,
+			 const char *str)
+{
+	while (*str && col < WH1602_COLS)
+		wh1602_fb_put_char(obj, line, col++, *str++);
+}
+
+/**
+ * Send frame buffer changes to LCD.
+ *
+ * Only cells that differ from DDRAM contents are written. Address counter is
+ * set only when the next changed cell can't be reached by auto-increment
+ * cheaper: re-writing a short run of unchanged cells costs the same as
+ * SET_ADDRESS command. Display is never cleared.
+ *
+ * If DMA queue can't take more bytes, stops and returns -EBUSY: the cells
+ * not sent yet still differ from DDRAM, so the next call sends them.
+ *
+ * @param obj LCD object
+ * @return 0 on success or -EBUSY if only a part of changes was sent
+ */
+int wh1602_fb_flush(struct wh1602 *obj)
+{
+	static const uint8_t line_addr[WH1602_ROWS] = {
+		DDRAM_LINE_1_ADDR,
+		DDRAM_LINE_2_ADDR,
+	};
+	uint16_t queued = 0;
+	int line, col;
+	int ret = 0;
+
+	trace_begin(TRACE_LCD_FLUSH, 0, 0);
+
+	for (line = 0; line < WH1602_ROWS; ++line) {
+		for (col = 0; col < WH1602_COLS; ++col) {
+			const uint8_t addr = line_addr[line] + col;
+			int gap = addr - obj->addr;
+
+			if (obj->fb[line][col] == obj->ddram[line][col])
+				continue;
+
+			if (gap < 0 || gap > FB_MAX_GAP ||
+			    obj->addr < line_addr[line]) {
+				ret = wh1602_set_address(obj, addr);
+				if (ret)
+					goto out;
+			} else {
+				/* Cheaper to re-write cells in between */
+				while (obj->addr != addr) {
+					const uint8_t c = obj->fb[line]
+						[obj->addr - line_addr[line]];
+
+					ret = wh1602_write_char(obj, c);
+					if (ret)
+						goto out;
+					queued++;
+				}
+			}
+
+			ret = wh1602_write_char(obj, obj->fb[line][col]);
+			if (ret)
+				goto out;
+			queued++;
+		}
+	}
+
+out:
+	trace_end(TRACE_LCD_FLUSH, 0, queued);
+	return ret;
+}
+
+/* Find CGRAM slot for new glyph: prefer empty one, then any unused one */
+static int wh1602_glyph_find_slot(struct wh1602 *obj)
+{
+	int i;
+
+	for (i = 0; i < WH1602_CGRAM_SLOTS; ++i) {
+		if (!obj->cgram[i])
+			return i;
+	}
+
+	for (i = 0; i < WH1602_CGRAM_SLOTS; ++i) {
+		if (!(obj->cgram_used & BIT(i)))
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Get character code for custom glyph, uploading it to CGRAM if needed.
+ *
+ * Glyphs are identified by their address, so @p glyph must point to constant
+ * data. Uploaded glyphs stay resident in CGRAM, so the glyph is only sent to
+ * LCD when it's not there yet. Slots used by current frame (since last
+ * @ref wh1602_fb_clear()) are never replaced, as that would change the
+ * characters already put into frame buffer.
+ *
+ * @param obj LCD object
+ * @param glyph Bitmap of WH1602_GLYPH_ROWS rows, 5 LSBs each
+ * @return Character code (0..7) or -1 if all CGRAM slots are in use or DMA
+ *	   queue stays full
+ */
+int wh1602_glyph_get(struct wh1602 *obj, const uint8_t *glyph)
+{
+	int slot, ret;
+	int i;
+
+	for (slot = 0; slot < WH1602_CGRAM_SLOTS; ++slot) {
+		if (obj->cgram[slot] == glyph)
+			goto out;
+	}
+
+	slot = wh1602_glyph_find_slot(obj);
+	if (slot < 0)
+		return -1;
+
+	/* Address counter points to CGRAM now; next DDRAM write must set it */
+	obj->addr = ADDR_UNKNOWN;
+	obj->cgram[slot] = NULL;
+
+	ret = wh1602_write_cmd(obj, SET_CGRAM_ADDRESS |
+			       (slot * WH1602_GLYPH_ROWS), EXEC_TIME_DELAY);
+	for (i = 0; i < WH1602_GLYPH_ROWS && !ret; ++i)
+		ret = wh1602_write_data(obj, glyph[i], EXEC_TIME_DELAY);
+	if (ret)
+		return -1;	/* slot is left half-written, and empty */
+
+	obj->cgram[slot] = glyph;
+
+out:
+	obj->cgram_used |= BIT(slot);
+	return slot;
+}
@@ -5,116 +5,197 @@
 
 #include <logic.h>
 #include <board.h>
+#include <clock_face.h>
 #include <melody.h>
 #include <player.h>
 #include <core/irq.h>
 #include <core/log.h>
+#include <core/pt.h>
 #include <core/sched.h>
 #include <core/swtimer.h>
-#include <core/wdt.h>
 #include <drivers/buzzer.h>
 #include <drivers/ds18b20.h>
 #include <drivers/ds3231.h>
 #include <drivers/kbd.h>
+#include <drivers/synth.h>
 #include <drivers/wh1602.h>
 #include <tools/common.h>
+#include <tools/seqlock.h>
 #include <tools/tools.h>
 #include <libopencm3/stm32/gpio.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-#define ALARM_INDICATOR		0x2a
 #define ALARM_SYMBOL_POS	0x0f
+#define DATE_DISPLAY_ADDR	0x00	/* on LINE_2 */
 #define ALARM_TIMEOUT		60000	/* msec */
-#define BUF_LEN			25
+#define ALARM_VOLUME_START	32	/* alarm starts quiet... */
+#define ALARM_VOLUME_RAMP	30000	/* ...and gets loud in this time, msec */
 #define EPOCH_YEAR		2021	/* years */
 #define GET_TEMP_DELAY		5000	/* msec */
-#define MENU_NUM		3
+#define LOGIC_QUEUE_LEN		8	/* FSM events, power of 2 */
+#define MELODY_PREVIEW_TIME	5000	/* msec */
+#define MENU_NUM		4
 #define TEMPER_DISPLAY_ADDR	0x07
+#define TIME_DISPLAY_ADDR	0x00
 #define TIM_PERIOD		5000	/* msec */
 #define TM_DEFAULT_YEAR		(EPOCH_YEAR - TM_START_YEAR)
 
-static void logic_handle_btn(int btn, bool pressed);
+static void logic_handle_btn(const struct kbd_key_event *ev);
 static void logic_activate_alarm_sig(void);
 
-/* Keep 0 as undefined state */
+DECLARE_TASK(logic);
+DECLARE_TASK(rtc);
+DECLARE_TASK(temper);
+DECLARE_TASK(render);
+
+/* Keep 0 as undefined state: it means "no transition" in FSM table */
 enum logic_stage {
 	STAGE_UNDEFINED = 0,
-	STAGE_INIT,
 	STAGE_MAIN_SCREEN,
 	STAGE_MAIN_MENU,
 	STAGE_ALARM,
 	STAGE_ALARM_TRIG,
-	STAGE_ADJUSTMENT,
+	STAGE_MELODY,
 	STAGE_SET_HH,
 	STAGE_SET_MM,
 	STAGE_SET_WDAY,
 	STAGE_SET_MON,
 	STAGE_SET_MDAY,
 	STAGE_SET_YEAR,
+	STAGE_NR,
 };
 
+/* Button events must go first and match kbd button numbers */
 enum logic_event {
 	EVENT_LEFT,	/* left button */
 	EVENT_RIGHT,	/* right button */
 	EVENT_UP,	/* up button */
 	EVENT_DOWN,	/* down button */
+	EVENT_ALARM,	/* RTC alarm went off */
+	EVENT_TIMEOUT,	/* alarm melody played for too long */
+	EVENT_FACE,	/* right button held: toggle clock face */
+	EVENT_NR,
+};
+
+typedef void (*logic_action_t)(void);
+typedef bool (*logic_guard_t)(void);
+
+/* Actions run on entering and leaving the stage */
+struct logic_state {
+	logic_action_t entry;
+	logic_action_t exit;
+};
+
+struct logic_transition {
+	enum logic_stage next;	/* STAGE_UNDEFINED: event is ignored */
+	logic_guard_t guard;	/* if set, transition is taken only if true */
+	logic_action_t action;	/* run between exit and entry actions */
+};
+
+static void logic_post_event(enum logic_event event);
+
+/* Main screen fields, redrawn separately */
+enum logic_field {
+	FIELD_TIME	= BIT(0),
+	FIELD_DATE	= BIT(1),
+	FIELD_TEMPER	= BIT(2),
+	FIELD_ALARM	= BIT(3),
+	FIELD_ALL	= FIELD_TIME | FIELD_DATE | FIELD_TEMPER | FIELD_ALARM,
 };
 
-struct rtc_data {
-	/* Actual values */
-	char temper[BUF_LEN];
-	char date[BUF_LEN];
-	char time[BUF_LEN];
-	/* Cached values */
-	char ctemper[BUF_LEN];
-	char cdate[BUF_LEN];
-	char ctime[BUF_LEN];
+/* Values shown on main screen */
+struct main_screen {
+	uint8_t hour;
+	uint8_t min;
+	uint8_t wday;
+	uint8_t mday;
+	uint8_t mon;
+	uint8_t year;
+	struct ds18b20_temp temper;
+	bool temper_valid;		/* .temper was read from sensor */
+	bool alarm;
+	uint8_t dirty;			/* mask of fields to redraw */
+	bool flush_pending;		/* LCD queue was full on last flush */
+};
+
+/* Latest time read from RTC; published by "rtc" task */
+struct time_mailbox {
+	struct seqcount seq;			/* 0: nothing published yet */
+	struct rtc_time tm;
+};
+
+/* Latest temperature read from sensor; published by "temper" task */
+struct temper_mailbox {
+	struct seqcount seq;			/* 0: nothing published yet */
+	struct ds18b20_temp temp;
 };
 
 struct logic {
+	bool big_face;			/* show time with big digits */
 	bool ds18b20_presence_flag;
 	bool ds3231_presence_flag;
-	bool flag_stopped;
+	bool main_screen;		/* main screen is shown, render it */
 	enum logic_stage stage;		/* current state of FSM */
+	uint8_t queue[LOGIC_QUEUE_LEN];	/* FSM events to dispatch */
+	uint8_t head;			/* next event to dispatch */
+	uint8_t tail;			/* next free queue slot */
+	uint8_t dropped;		/* events lost due to full queue */
 	int alarm_counter;
+#ifdef CONFIG_SOUND_DAC
+	struct synth synth;
+#else
 	struct buzzer buzz;
+#endif
 	struct ds18b20 ts;
 	struct ds3231 rtc;
 	struct kbd kbd;
+	size_t melody;			/* index of alarm melody */
 	struct player pl;
-	struct rtc_data data;
-	struct rtc_time tm;
-	struct swtimer_sw_tim swtim;
+	struct main_screen ms;
+	struct time_mailbox time_box;
+	struct temper_mailbox temper_box;
+	struct rtc_time tm;		/* time being adjusted */
+	struct swtimer_sw_tim swtim;	/* main screen refresh */
+	struct pt temper_pt;		/* temperature measurement thread */
 	struct wh1602 wh;
 };
 
-static uint8_t menu_addr[MENU_NUM] = {
-	0x00,
-	0x0a,
-	0x40,
+static const struct {
+	int line;
+	int col;
+} menu_pos[MENU_NUM] = {
+	{ LINE_1, 0x00 },
+	{ LINE_1, 0x0a },
+	{ LINE_2, 0x00 },
+	{ LINE_2, 0x08 },
 };
 
 static const char * const menu_msg[MENU_NUM] = {
 	"U-Alarm",
 	"L-Back",
-	"D-Time settings",
+	"D-Time",
+	"R-Melody",
 };
 
 static struct logic logic;
 
+#ifdef CONFIG_SOUND_DAC
 static void logic_play_tone(uint16_t tone, uint16_t duration)
 {
-	buzzer_make_sound(&logic.buzz, tone,  duration);
+	synth_play(&logic.synth, tone, duration);
 }
-
-static void logic_break_alarm_signal(void)
+#else
+static void logic_play_tone(uint16_t tone, uint16_t duration)
 {
-	if (logic.stage == STAGE_ALARM_TRIG)
-		logic.flag_stopped = true;
+	UNUSED(duration);
+
+	buzzer_start_sound(&logic.buzz, tone);
 }
+#endif
 
 /* Initialize peripheral drivers */
 static void logic_init_drivers(void)
@@ -127,13 +208,38 @@ static void logic_init_drivers(void)
 	struct wh1602_gpio wh_gpio = {
 		.port = WH1602_GPIO_PORT,
 		.rs = WH1602_RS_PIN,
+		.rw = WH1602_RW_PIN,
 		.en = WH1602_EN_PIN,
 		.db4 = WH1602_DB4_PIN,
 		.db5 = WH1602_DB5_PIN,
 		.db6 = WH1602_DB6_PIN,
 		.db7 = WH1602_DB7_PIN,
 	};
+	const struct wh1602_dma wh_dma = {
+		.tim = WH1602_TIM_BASE,
+		.tim_rst = WH1602_TIM_RST,
+		.dma = WH1602_DMA_BASE,
+		.channel = WH1602_DMA_CHANNEL,
+		.irq = WH1602_DMA_IRQ,
+	};
+#ifdef CONFIG_SOUND_DAC
+	const struct synth_hw synth_hw = {
+		.tim = SYNTH_TIM_BASE,
+		.tim_rst = SYNTH_TIM_RST,
+		.dma = SYNTH_DMA_BASE,
+		.channel = SYNTH_DMA_CHANNEL,
+		.irq = SYNTH_DMA_IRQ,
+		.dac_channel = SYNTH_DAC_CHANNEL,
+	};
+#else
+	const struct buzzer_tim buzz_tim = {
+		.base = BUZZER_TIM_BASE,
+		.rst = BUZZER_TIM_RST,
+		.oc = BUZZER_TIM_OC,
+	};
+#endif
 	struct kbd_gpio kbd_gpio = {
+		.name = "kbd",
 		.port = KBD_GPIO_PORT,
 		.read[0] = KBD_GPIO_L1_PIN,
 		.read[1] = KBD_GPIO_L2_PIN,
@@ -150,8 +256,7 @@ static void logic_init_drivers(void)
 		.addr = DS3231_DEVICE_ADDR,
 	};
 
-	err = kbd_init(&logic.kbd, &kbd_gpio, logic_handle_btn,
-		       logic_break_alarm_signal);
+	err = kbd_init(&logic.kbd, &kbd_gpio, logic_handle_btn);
 	if (err) {
 		pr_emerg("Error: Can't initialize kbd: %d\n", err);
 		hang();
@@ -168,81 +273,209 @@ static void logic_init_drivers(void)
 		hang();
 	}
 
+	err = wh1602_dma_init(&logic.wh, &wh_dma, NULL, NULL);
+	if (err)
+		pr_warn("Warning: Can't initialize wh1602 DMA: %d\n", err);
+
 	err = ds3231_init(&logic.rtc, &device, EPOCH_YEAR,
 			  logic_activate_alarm_sig);
 	if (err)
 		pr_warn("Warning: Can't initialize ds3231: %d\n", err);
 	logic.ds3231_presence_flag = !err;
 
-	err = buzzer_init(&logic.buzz, BUZZER_GPIO_PORT, BUZZER_GPIO_PIN);
+#ifdef CONFIG_SOUND_DAC
+	err = synth_init(&logic.synth, &synth_hw);
+	if (err)
+		pr_warn("Warning: Can't initialize synth: %d\n", err);
+#else
+	err = buzzer_init(&logic.buzz, &buzz_tim);
 	if (err)
 		pr_warn("Warning: Can't initialize buzzer: %d\n", err);
+#endif
 
-	err = player_init(&logic.pl, melody_alarm, melody_alarm_len,
-			  logic_play_tone);
+	err = player_init(&logic.pl, &melodies[logic.melody], logic_play_tone);
 	if (err)
 		pr_warn("Warning: Can't initialize player: %d\n", err);
 }
 
+static void logic_publish_time(const struct rtc_time *tm)
+{
+	write_seqcount_begin(&logic.time_box.seq);
+	logic.time_box.tm = *tm;
+	write_seqcount_end(&logic.time_box.seq);
+}
+
 /**
- * Read data from temperature sensor and convert it to string.
+ * Take the latest time from mailbox.
  *
- * @param data User data (DS18B20 object)
- * @return Null-terminated string
+ * @param tm Where to copy the time to
+ * @return Mailbox sequence number; 0 if no time was published yet
  */
-static char *logic_read_temper(void *data)
+static uint32_t logic_fetch_time(struct rtc_time *tm)
 {
-	struct ds18b20 *obj = (struct ds18b20 *)(data);
-	char buf[BUF_LEN];
+	uint32_t seq;
 
-	obj->temp = ds18b20_read_temp(&logic.ts);
+	do {
+		seq = read_seqcount_begin(&logic.time_box.seq);
+		*tm = logic.time_box.tm;
+	} while (read_seqcount_retry(&logic.time_box.seq, seq));
 
-	while (obj->temp.frac > 9)
-		obj->temp.frac /= 10;
+	return seq;
+}
 
-	return ds18b20_temp2str(&obj->temp, buf);
+static void logic_publish_temper(const struct ds18b20_temp *temp)
+{
+	write_seqcount_begin(&logic.temper_box.seq);
+	logic.temper_box.temp = *temp;
+	write_seqcount_end(&logic.temper_box.seq);
 }
 
-/* Display new data on LCD screen */
-static void logic_display_data(struct logic *obj)
+/**
+ * Take the latest temperature from mailbox.
+ *
+ * @param temp Where to copy the temperature to
+ * @return Mailbox sequence number; 0 if no temperature was published yet
+ */
+static uint32_t logic_fetch_temper(struct ds18b20_temp *temp)
 {
-	wh1602_clear_display(&obj->wh);
+	uint32_t seq;
+
+	do {
+		seq = read_seqcount_begin(&logic.temper_box.seq);
+		*temp = logic.temper_box.temp;
+	} while (read_seqcount_retry(&logic.temper_box.seq, seq));
+
+	return seq;
+}
 
-	wh1602_set_line(&obj->wh, LINE_1);
-	wh1602_print_str(&obj->wh, obj->data.time);
+/**
+ * Take values to be shown on main screen from mailboxes.
+ *
+ * @param obj Logic object; fields which values changed are marked dirty
+ */
+static void logic_update_fields(struct logic *obj)
+{
+	struct main_screen *ms = &obj->ms;
+	struct rtc_time t;
+	struct ds18b20_temp temp;
+	bool temp_valid;
+
+	logic_fetch_time(&t);
+	temp_valid = logic_fetch_temper(&temp) != 0;
+
+	if (ms->hour != t.tm_hour || ms->min != t.tm_min) {
+		ms->hour = t.tm_hour;
+		ms->min = t.tm_min;
+		ms->dirty |= FIELD_TIME;
+	}
 
-	wh1602_set_line(&obj->wh, LINE_2);
-	wh1602_print_str(&obj->wh, obj->data.date);
+	if (ms->wday != t.tm_wday || ms->mday != t.tm_mday ||
+	    ms->mon != t.tm_mon || ms->year != t.tm_year) {
+		ms->wday = t.tm_wday;
+		ms->mday = t.tm_mday;
+		ms->mon = t.tm_mon;
+		ms->year = t.tm_year;
+		ms->dirty |= FIELD_DATE;
+	}
 
-	wh1602_set_address(&obj->wh, TEMPER_DISPLAY_ADDR);
-	wh1602_write_char(&obj->wh, 't');
-	wh1602_print_str(&obj->wh, obj->data.temper);
+	if (ms->temper_valid != temp_valid ||
+	    ms->temper.integer != temp.integer ||
+	    ms->temper.frac != temp.frac || ms->temper.sign != temp.sign) {
+		ms->temper = temp;
+		ms->temper_valid = temp_valid;
+		ms->dirty |= FIELD_TEMPER;
+	}
 
-	if (obj->rtc.alarm.status) {
-		wh1602_set_address(&obj->wh, ALARM_SYMBOL_POS);
-		wh1602_write_char(&obj->wh, ALARM_INDICATOR);
+	if (ms->alarm != obj->rtc.alarm.status) {
+		ms->alarm = obj->rtc.alarm.status;
+		ms->dirty |= FIELD_ALARM;
 	}
 }
 
-/* Display cached data on LCD screen */
-static void logic_display_cdata(struct logic *obj)
+/* Draw temperature field: "t+23.5", degree sign, blanks till alarm icon */
+static void logic_render_temper(struct logic *obj)
+{
+	struct ds18b20_temp temp = obj->ms.temper;
+	char buf[WH1602_COLS + 1];
+	int col;
+
+	if (obj->ds18b20_presence_flag && obj->ms.temper_valid)
+		ds18b20_temp2str(&temp, buf);
+	else
+		strcpy(buf, "xx");
+
+	for (col = TEMPER_DISPLAY_ADDR; col < ALARM_SYMBOL_POS; col++)
+		wh1602_fb_put_char(&obj->wh, LINE_1, col, ' ');
+
+	wh1602_fb_put_char(&obj->wh, LINE_1, TEMPER_DISPLAY_ADDR, 't');
+	wh1602_fb_print_str(&obj->wh, LINE_1, TEMPER_DISPLAY_ADDR + 1, buf);
+	clock_face_put_icon(&obj->wh, LINE_1,
+			    TEMPER_DISPLAY_ADDR + 1 + strlen(buf), ICON_DEGREE);
+}
+
+/**
+ * Redraw changed fields of main screen and flush them to LCD.
+ *
+ * Each field has fixed position and width, so unchanged fields are not
+ * touched at all.
+ *
+ * @param obj Logic object
+ */
+static void logic_render_main_screen(struct logic *obj)
 {
-	wh1602_clear_display(&obj->wh);
+	struct main_screen *ms = &obj->ms;
+	struct tm t;
+	char buf[WH1602_COLS + 1];
 
-	wh1602_set_line(&obj->wh, LINE_1);
-	wh1602_print_str(&obj->wh, obj->data.ctime);
+	if (!ms->dirty && !ms->flush_pending)
+		return;
 
-	wh1602_set_line(&obj->wh, LINE_2);
-	wh1602_print_str(&obj->wh, obj->data.cdate);
+	memset(&t, 0, sizeof(t));
+	t.tm_hour = ms->hour;
+	t.tm_min = ms->min;
+	t.tm_wday = ms->wday;
+	t.tm_mday = ms->mday;
+	t.tm_mon = ms->mon;
+	t.tm_year = ms->year;
+
+	if (obj->big_face) {
+		if (ms->dirty & FIELD_TIME)
+			clock_face_big_time(&obj->wh, 0, ms->hour, ms->min);
+	} else {
+		if (ms->dirty & FIELD_TIME) {
+			if (obj->ds3231_presence_flag)
+				time2str(&t, buf);
+			else
+				strcpy(buf, "00 00");
+			wh1602_fb_print_str(&obj->wh, LINE_1,
+					    TIME_DISPLAY_ADDR, buf);
+		}
 
-	wh1602_set_address(&obj->wh, TEMPER_DISPLAY_ADDR);
-	wh1602_write_char(&obj->wh, 't');
-	wh1602_print_str(&obj->wh, obj->data.ctemper);
+		if (ms->dirty & FIELD_DATE) {
+			if (obj->ds3231_presence_flag)
+				date2str(&t, buf);
+			else
+				strcpy(buf, "00 000 0000");
+			wh1602_fb_print_str(&obj->wh, LINE_2,
+					    DATE_DISPLAY_ADDR, buf);
+		}
+
+		if (ms->dirty & FIELD_TEMPER)
+			logic_render_temper(obj);
+	}
 
-	if (obj->rtc.alarm.status) {
-		wh1602_set_address(&obj->wh, ALARM_SYMBOL_POS);
-		wh1602_write_char(&obj->wh, ALARM_INDICATOR);
+	if (ms->dirty & FIELD_ALARM) {
+		if (ms->alarm)
+			clock_face_put_icon(&obj->wh, LINE_1, ALARM_SYMBOL_POS,
+					    ICON_BELL);
+		else
+			wh1602_fb_put_char(&obj->wh, LINE_1, ALARM_SYMBOL_POS,
+					   ' ');
 	}
+
+	ms->dirty = 0;
+	/* Cells not sent are still in frame buffer: send them on next tick */
+	ms->flush_pending = wh1602_fb_flush(&obj->wh) == -EBUSY;
 }
 
 /* Control alarm */
@@ -284,30 +517,83 @@ static void logic_incr_alarm_mm(void)
 	t->tm_sec = 0;
 }
 
+/* Show time/date being adjusted and put cursor to the field being edited */
 static void logic_show_adjustment_screen(void)
 {
+	static const uint8_t field_addr[] = {
+		[STAGE_SET_HH - STAGE_SET_HH]	= 0x01,
+		[STAGE_SET_MM - STAGE_SET_HH]	= 0x04,
+		[STAGE_SET_WDAY - STAGE_SET_HH]	= 0x40,
+		[STAGE_SET_MON - STAGE_SET_HH]	= 0x47,
+		[STAGE_SET_MDAY - STAGE_SET_HH]	= 0x44,
+		[STAGE_SET_YEAR - STAGE_SET_HH]	= 0x4b,
+	};
 	struct tm *t;
-	char time[BUF_LEN];
-	char date[BUF_LEN];
+	char time[WH1602_COLS + 1];
+	char date[WH1602_COLS + 1];
 
 	t = (struct tm *)(&logic.tm);
 
 	time2str(t, time);
 	date2str(t, date);
 
-	wh1602_clear_display(&logic.wh);
-	wh1602_set_line(&logic.wh, LINE_1);
-	wh1602_print_str(&logic.wh, time);
-	wh1602_set_line(&logic.wh, LINE_2);
-	wh1602_print_str(&logic.wh, date);
+	wh1602_fb_clear(&logic.wh);
+	wh1602_fb_print_str(&logic.wh, LINE_1, 0, time);
+	wh1602_fb_print_str(&logic.wh, LINE_2, 0, date);
+	wh1602_fb_flush(&logic.wh);
+
+	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_ON);
+	wh1602_set_address(&logic.wh, field_addr[logic.stage - STAGE_SET_HH]);
 }
 
-static void logic_set_new_time(void)
+/* Read current time to be adjusted */
+static void logic_read_adjust_time(void)
 {
 	int err;
-	struct tm *t;
 
-	t = (struct tm *)(&logic.tm);
+	err = ds3231_read_time(&logic.rtc, &logic.tm);
+	if (err) {
+		pr_emerg("Error: Can't read time: %d\n", err);
+		hang();
+	}
+}
+
+/* Increment time/date field being edited */
+static void logic_incr_field(void)
+{
+	struct rtc_time *t = &logic.tm;
+
+	switch (logic.stage) {
+	case STAGE_SET_HH:
+		t->tm_hour = (t->tm_hour + 1) % 24;
+		break;
+	case STAGE_SET_MM:
+		t->tm_min = (t->tm_min + 1) % 60;
+		break;
+	case STAGE_SET_WDAY:
+		t->tm_wday = (t->tm_wday + 1) % 7;
+		break;
+	case STAGE_SET_MON:
+		t->tm_mon = (t->tm_mon + 1) % 12;
+		break;
+	case STAGE_SET_MDAY:
+		t->tm_mday = (t->tm_mday + 1) % 32;
+		if (t->tm_mday == 0)
+			t->tm_mday++;
+		break;
+	case STAGE_SET_YEAR:
+		t->tm_year++;
+		if (t->tm_year > TM_DEFAULT_YEAR + 10)
+			t->tm_year = TM_DEFAULT_YEAR;
+		break;
+	default:
+		break;
+	}
+}
+
+static void logic_set_new_time(void)
+{
+	int err;
 
 	err = ds3231_set_time(&logic.rtc, &logic.tm);
 	if (err) {
@@ -315,399 +601,453 @@ static void logic_set_new_time(void)
 		hang();
 	}
 
-	date2str(t, logic.data.date);
-	time2str(t, logic.data.time);
+	logic_publish_time(&logic.tm);
 }
 
-static void logic_handle_stage_main_screen(void)
+/* Draw the last published values right away, then ask RTC for fresh time */
+static void logic_enter_main_screen(void)
 {
 	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_OFF, CURSOR_BLINK_OFF);
+	wh1602_fb_clear(&logic.wh);
+	logic_update_fields(&logic);
+	logic.ms.dirty = FIELD_ALL;
+	logic_render_main_screen(&logic);
+
+	logic.main_screen = true;
 	swtimer_tim_start(logic.swtim.id);
+	sched_set_ready(TASK_ID(rtc));
+}
 
-	if (strcmp(logic.data.temper, logic.data.ctemper) ||
-	    strcmp(logic.data.time, logic.data.ctime))
-		logic_display_data(&logic);
-	else
-		logic_display_cdata(&logic);
+static void logic_exit_main_screen(void)
+{
+	swtimer_tim_stop(logic.swtim.id);
+	logic.main_screen = false;
+}
+
+static void logic_toggle_face(void)
+{
+	logic.big_face = !logic.big_face;
 }
 
-static void logic_handle_stage_main_menu(void)
+static void logic_enter_main_menu(void)
 {
 	size_t i;
 
-	swtimer_tim_stop(logic.swtim.id);
-	wh1602_clear_display(&logic.wh);
+	wh1602_fb_clear(&logic.wh);
 
-	for (i = 0; i < MENU_NUM; i++) {
-		wh1602_set_address(&logic.wh, menu_addr[i]);
-		wh1602_print_str(&logic.wh, menu_msg[i]);
-	}
+	for (i = 0; i < MENU_NUM; i++)
+		wh1602_fb_print_str(&logic.wh, menu_pos[i].line,
+				    menu_pos[i].col, menu_msg[i]);
+
+	wh1602_fb_flush(&logic.wh);
 }
 
-static void logic_handle_stage_alarm(void)
+static void logic_enter_alarm(void)
 {
-	char alarm_time[BUF_LEN];
+	char alarm_time[WH1602_COLS + 1];
 	char *flag;
 	struct tm *t;
 
-	/* HACK: Brute kicking user back to main menu to disallow RTC ops */
-	if (!logic.ds3231_presence_flag) {
-		logic.stage = STAGE_MAIN_MENU;
-		return;
-	}
-
 	t = (struct tm *)(&logic.rtc.alarm.time);
 	time2str(t, alarm_time);
 
 	flag = (logic.rtc.alarm.status == true) ? "Alarm ON" : "Alarm OFF";
 
-	wh1602_clear_display(&logic.wh);
-	wh1602_set_line(&logic.wh, LINE_1);
-	wh1602_print_str(&logic.wh, alarm_time);
-	wh1602_set_line(&logic.wh, LINE_2);
-	wh1602_print_str(&logic.wh, flag);
+	wh1602_fb_clear(&logic.wh);
+	wh1602_fb_print_str(&logic.wh, LINE_1, 0, alarm_time);
+	wh1602_fb_print_str(&logic.wh, LINE_2, 0, flag);
+	wh1602_fb_flush(&logic.wh);
 }
 
-static void logic_handle_stage_adjustment(void)
+static void logic_enter_melody(void)
 {
-	int err;
-
-	if (!logic.ds3231_presence_flag) {
-		logic.stage = STAGE_MAIN_MENU;
-		return;
-	}
-
-	err = ds3231_read_time(&logic.rtc, &logic.tm);
-	if (err) {
-		pr_emerg("Error: Can't read time: %d\n", err);
-		hang();
-	}
-
-	logic_show_adjustment_screen();
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_ON);
-	wh1602_set_address(&logic.wh, 0x0f);
+	wh1602_fb_clear(&logic.wh);
+	wh1602_fb_print_str(&logic.wh, LINE_1, 0, "Melody:");
+	wh1602_fb_print_str(&logic.wh, LINE_2, 0, melodies[logic.melody].name);
+	wh1602_fb_flush(&logic.wh);
 }
 
-static void logic_handle_stage_set_hh(void)
+static void logic_exit_melody(void)
 {
-	logic.tm.tm_hour = (logic.tm.tm_hour + 1) % 24;
-
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x01);
+	player_stop(&logic.pl);
 }
 
-static void logic_handle_stage_set_mm(void)
+/* Select next alarm melody and play it for a while */
+static void logic_next_melody(void)
 {
-	logic.tm.tm_min = (logic.tm.tm_min + 1) % 60;
-
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x04);
+	logic.melody = (logic.melody + 1) % melodies_nr;
+	player_set_melody(&logic.pl, &melodies[logic.melody]);
+#ifdef CONFIG_SOUND_DAC
+	synth_set_volume(&logic.synth, SYNTH_VOLUME_MAX);
+#endif
+	player_start(&logic.pl, MELODY_PREVIEW_TIME, NULL, NULL);
 }
 
-static void logic_handle_stage_set_wday(void)
+/* Main screen timer: wake up RTC reader, it wakes up renderer */
+static void logic_main_screen_tick(void *data)
 {
-	logic.tm.tm_wday = (logic.tm.tm_wday + 1) % 7;
+	UNUSED(data);
 
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x40);
+	sched_set_ready(TASK_ID(rtc));
 }
 
-static void logic_handle_stage_set_mon(void)
+/* Task: read time from RTC and publish it */
+static void logic_rtc_task(void *data)
 {
-	logic.tm.tm_mon = (logic.tm.tm_mon + 1) % 12;
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x47);
-}
+	struct rtc_time tm;
+	int err;
 
-static void logic_handle_stage_set_mday(void)
-{
-	logic.tm.tm_mday = (logic.tm.tm_mday + 1) % 32;
-	if (logic.tm.tm_mday == 0)
-		logic.tm.tm_mday++;
+	UNUSED(data);
 
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x44);
-}
+	if (!logic.ds3231_presence_flag)
+		return;
 
-static void logic_handle_stage_set_year(void)
-{
-	logic.tm.tm_year++;
-	if (logic.tm.tm_year > TM_DEFAULT_YEAR + 10)
-		logic.tm.tm_year = TM_DEFAULT_YEAR;
+	err = ds3231_read_time(&logic.rtc, &tm);
+	if (err) {
+		pr_emerg("Error: Can't read time: %d\n", err);
+		hang();
+	}
 
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_ON, CURSOR_BLINK_OFF);
-	logic_show_adjustment_screen();
-	wh1602_set_address(&logic.wh, 0x4b);
+	logic_publish_time(&tm);
+	sched_set_ready(TASK_ID(render));
 }
 
+DEFINE_TASK(rtc, logic_rtc_task, NULL);
+
 /**
- * Renew displayed data on LCD screen.
+ * Task (protothread): measure temperature each GET_TEMP_DELAY and publish it.
  *
- * It's being called when software timer triggers.
+ * Sleeps while the sensor converts, so other tasks run meanwhile. Only started
+ * when the sensor is present.
  *
  * @param data User data
  */
-static void logic_show_main_screen(void *data)
+static void logic_temper_task(void *data)
 {
-	int err;
-	struct tm *t;
+	struct pt *pt = &logic.temper_pt;
+	struct ds18b20_temp temp;
 
 	UNUSED(data);
 
-	if (logic.ds3231_presence_flag) {
-		err = ds3231_read_time(&logic.rtc, &logic.tm);
-		if (err) {
-			pr_emerg("Error: Can't read time: %d\n", err);
-			hang();
+	PT_BEGIN(pt);
+	for (;;) {
+		ds18b20_start_conversion();
+		PT_SLEEP_MS(pt, DS18B20_CONV_TIME);
+
+		if (ds18b20_update_temp(&logic.ts)) {
+			temp = logic.ts.temp;
+			while (temp.frac > 9)
+				temp.frac /= 10;
+			logic_publish_temper(&temp);
+			sched_set_ready(TASK_ID(render));
 		}
 
-		t = (struct tm *)(&logic.tm);
-		date2str(t, logic.data.date);
-		time2str(t, logic.data.time);
-	} else {
-		strcpy(logic.data.date, "00 000 0000");
-		strcpy(logic.data.time, "00 00");
-	}
-
-	if (logic.ds18b20_presence_flag)
-		strcpy(logic.data.temper, logic_read_temper(&logic.ts));
-	else
-		strcpy(logic.data.temper, "xx");
-
-	if (strcmp(logic.data.temper, logic.data.ctemper) ||
-	    strcmp(logic.data.time, logic.data.ctime)) {
-		logic_display_data(&logic);
-		strcpy(logic.data.ctime, logic.data.time);
-		strcpy(logic.data.cdate, logic.data.date);
-		strcpy(logic.data.ctemper, logic.data.temper);
+		PT_SLEEP_MS(pt, GET_TEMP_DELAY - DS18B20_CONV_TIME);
 	}
+	PT_END(pt);
 }
 
-static void logic_handle_stage_init(void)
-{
-	int ret;
+DEFINE_TASK(temper, logic_temper_task, NULL);
 
-	logic.swtim.cb = logic_show_main_screen;
-	logic.swtim.data = &logic.rtc;
-	logic.swtim.period = TIM_PERIOD;
+/* Task: redraw main screen fields changed in mailboxes */
+static void logic_render_task(void *data)
+{
+	UNUSED(data);
 
-	logic_init_drivers();
+	if (!logic.main_screen)
+		return;
 
-	ret = swtimer_tim_register(&logic.swtim);
-	if (ret < 0) {
-		pr_emerg("Error: Can't register timer: %d\n", ret);
-		hang();
-	}
+	logic_update_fields(&logic);
+	logic_render_main_screen(&logic);
+}
 
-	if (logic.ds3231_presence_flag) {
-		/* Year count should start from beginning the epoch */
-		logic.tm.tm_year = TM_DEFAULT_YEAR;
-		logic.rtc.alarm.time.tm_year = TM_DEFAULT_YEAR;
+DEFINE_TASK(render, logic_render_task, NULL);
 
-		ret = ds3231_set_time(&logic.rtc, &logic.tm);
-		if (ret != 0) {
-			pr_emerg("Error: Unable to set year inside ds3231 "
-				 "timekeeping register\n");
-			hang();
-		}
-	}
+static void logic_alarm_timeout(void *data)
+{
+	UNUSED(data);
 
-	wh1602_control_display(&logic.wh, LCD_ON, CURSOR_OFF, CURSOR_BLINK_OFF);
-	logic.stage = STAGE_MAIN_SCREEN;
+	logic_post_event(EVENT_TIMEOUT);
 }
 
 /**
  * Play melody.
  *
- * The melody sounds till either of two events occurs:
+ * The melody sounds in background till either of two events occurs:
  * - one minute timeout;
  * - push button.
- * When melody stopped the firmware keeps running as usual.
+ * The firmware keeps running as usual while melody is playing. With DAC
+ * sound, the melody starts quiet and gets louder gradually.
  */
-static void logic_play_melody(void)
+static void logic_enter_alarm_trig(void)
 {
-	struct systick_time start_ts, end_ts;
-	uint64_t elapsed = 0;
+	logic_enter_main_screen();
+#ifdef CONFIG_SOUND_DAC
+	synth_set_volume(&logic.synth, ALARM_VOLUME_START);
+	synth_ramp_volume(&logic.synth, SYNTH_VOLUME_MAX, ALARM_VOLUME_RAMP);
+#endif
+	player_start(&logic.pl, ALARM_TIMEOUT, logic_alarm_timeout, NULL);
+}
+
+/* Stop alarm melody; main screen stays */
+static void logic_exit_alarm_trig(void)
+{
+	player_stop(&logic.pl);
+	logic.rtc.alarm.status = false;
+	logic_exit_main_screen();
+}
 
-	systick_get_time(&start_ts);
-	while (elapsed < ALARM_TIMEOUT) {
-		systick_get_time(&end_ts);
-		elapsed = systick_calc_diff(&start_ts, &end_ts);
-		elapsed /= 1000000UL;
+/* Alarm and time settings need RTC */
+static bool logic_rtc_present(void)
+{
+	return logic.ds3231_presence_flag;
+}
 
-		if (logic.flag_stopped) {
-			logic.flag_stopped = false;
-			break;
-		}
+static const struct logic_state logic_states[STAGE_NR] = {
+	[STAGE_MAIN_SCREEN] = { logic_enter_main_screen,
+				logic_exit_main_screen },
+	[STAGE_MAIN_MENU]   = { logic_enter_main_menu, NULL },
+	[STAGE_ALARM]	    = { logic_enter_alarm, NULL },
+	[STAGE_ALARM_TRIG]  = { logic_enter_alarm_trig,
+				logic_exit_alarm_trig },
+	[STAGE_MELODY]	    = { logic_enter_melody, logic_exit_melody },
+	[STAGE_SET_HH]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MM]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_WDAY]    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MON]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MDAY]    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_YEAR]    = { logic_show_adjustment_screen, NULL },
+};
 
-		player_play_next_note(&logic.pl);
-		wdt_reset();
+/* Time/date field editor: RIGHT selects next field, UP increments it */
+#define SET_FIELD(field, next_field)					\
+	{								\
+		[EVENT_LEFT]  = { STAGE_MAIN_SCREEN, NULL,		\
+				  logic_set_new_time },			\
+		[EVENT_RIGHT] = { next_field, NULL, NULL },		\
+		[EVENT_UP]    = { field, NULL, logic_incr_field },	\
+		[EVENT_ALARM] = { STAGE_ALARM_TRIG, NULL, NULL },	\
 	}
 
-	player_stop(&logic.pl);
-	logic.rtc.alarm.status = false;
-	logic.stage = STAGE_MAIN_SCREEN;
+/*
+ * Transitions: [current stage][event]. Missing entries (STAGE_UNDEFINED)
+ * mean the event is ignored in that stage. Self-transitions run exit and
+ * entry actions too, so the screen gets redrawn after the action.
+ */
+static const struct logic_transition logic_fsm[STAGE_NR][EVENT_NR] = {
+	[STAGE_MAIN_SCREEN] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_DOWN]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+		[EVENT_FACE]	= { STAGE_MAIN_SCREEN, NULL,
+				    logic_toggle_face },
+	},
+	[STAGE_MAIN_MENU] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MELODY, NULL, NULL },
+		[EVENT_UP]	= { STAGE_ALARM, logic_rtc_present, NULL },
+		[EVENT_DOWN]	= { STAGE_SET_HH, logic_rtc_present,
+				    logic_read_adjust_time },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+		/* Press of held button has opened the menu already */
+		[EVENT_FACE]	= { STAGE_MAIN_SCREEN, NULL,
+				    logic_toggle_face },
+	},
+	[STAGE_ALARM] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_ALARM, NULL, logic_config_alarm },
+		[EVENT_UP]	= { STAGE_ALARM, NULL, logic_incr_alarm_hh },
+		[EVENT_DOWN]	= { STAGE_ALARM, NULL, logic_incr_alarm_mm },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+	},
+	[STAGE_ALARM_TRIG] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_DOWN]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_TIMEOUT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+	},
+	[STAGE_MELODY] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MELODY, NULL, logic_next_melody },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+	},
+	[STAGE_SET_HH]		= SET_FIELD(STAGE_SET_HH, STAGE_SET_MM),
+	[STAGE_SET_MM]		= SET_FIELD(STAGE_SET_MM, STAGE_SET_WDAY),
+	[STAGE_SET_WDAY]	= SET_FIELD(STAGE_SET_WDAY, STAGE_SET_MON),
+	[STAGE_SET_MON]		= SET_FIELD(STAGE_SET_MON, STAGE_SET_MDAY),
+	[STAGE_SET_MDAY]	= SET_FIELD(STAGE_SET_MDAY, STAGE_SET_YEAR),
+	[STAGE_SET_YEAR]	= SET_FIELD(STAGE_SET_YEAR, STAGE_SET_HH),
+};
+
+/**
+ * Run transition for the event in current stage.
+ *
+ * Order: exit action of current stage, transition action, entry action of
+ * new stage. Events posted by actions are queued and dispatched after this
+ * transition is complete.
+ *
+ * @param event What happened
+ */
+static void logic_dispatch(enum logic_event event)
+{
+	const struct logic_transition *t = &logic_fsm[logic.stage][event];
+
+	if (t->next == STAGE_UNDEFINED)
+		return;
+	if (t->guard && !t->guard())
+		return;
+
+	if (logic_states[logic.stage].exit)
+		logic_states[logic.stage].exit();
+	if (t->action)
+		t->action();
+	logic.stage = t->next;
+	if (logic_states[logic.stage].entry)
+		logic_states[logic.stage].entry();
 }
 
-static void logic_handle_stage(enum logic_stage stage)
+/**
+ * Put event to FSM queue and wake up the task handling it.
+ *
+ * Must be called from task context (button, RTC and timer callbacks are).
+ *
+ * @param event What happened
+ */
+static void logic_post_event(enum logic_event event)
 {
-	switch (stage) {
-	case STAGE_UNDEFINED:
-		logic_handle_stage(STAGE_INIT);
-		break;
-	case STAGE_INIT:
-		logic_handle_stage_init();
-		break;
-	case STAGE_MAIN_SCREEN:
-		logic_handle_stage_main_screen();
-		break;
-	case STAGE_MAIN_MENU:
-		logic_handle_stage_main_menu();
-		break;
+	uint8_t tail = logic.tail;
+
+	if ((uint8_t)(tail - logic.head) == LOGIC_QUEUE_LEN) {
+		logic.dropped++;
+		return;
+	}
+
+	logic.queue[tail % LOGIC_QUEUE_LEN] = event;
+	logic.tail = tail + 1;
+	sched_set_ready(TASK_ID(logic));
+}
+
+/* Task: dispatch queued events to FSM one by one */
+static void logic_task(void *data)
+{
+	UNUSED(data);
+
+	if (logic.dropped) {
+		pr_warn("Warning: logic: %u events dropped\n", logic.dropped);
+		logic.dropped = 0;
+	}
+
+	while (logic.head != logic.tail) {
+		enum logic_event event = logic.queue[logic.head %
+						     LOGIC_QUEUE_LEN];
+
+		logic.head++;
+		logic_dispatch(event);
+	}
+}
+
+DEFINE_TASK(logic, logic_task, NULL);
+
+static void logic_activate_alarm_sig(void)
+{
+	logic_post_event(EVENT_ALARM);
+}
+
+/* Check if holding the button should repeat its action in current stage */
+static bool logic_key_repeatable(enum logic_event event)
+{
+	switch (logic.stage) {
 	case STAGE_ALARM:
-		logic_handle_stage_alarm();
-		break;
-	case STAGE_ALARM_TRIG:
-		logic_play_melody();
-		break;
-	case STAGE_ADJUSTMENT:
-		logic_handle_stage_adjustment();
-		break;
+		return event == EVENT_UP || event == EVENT_DOWN;
 	case STAGE_SET_HH:
-		logic_handle_stage_set_hh();
-		break;
 	case STAGE_SET_MM:
-		logic_handle_stage_set_mm();
-		break;
 	case STAGE_SET_WDAY:
-		logic_handle_stage_set_wday();
-		break;
 	case STAGE_SET_MON:
-		logic_handle_stage_set_mon();
-		break;
 	case STAGE_SET_MDAY:
-		logic_handle_stage_set_mday();
-		break;
 	case STAGE_SET_YEAR:
-		logic_handle_stage_set_year();
-		break;
+		return event == EVENT_UP;
 	default:
-		pr_warn("Stage doesn't exist\n");
+		return false;
 	}
 }
 
-static void logic_handle_key_press(enum logic_event event)
-{
-	/* Current stage of fsm */
-	enum logic_stage stage = logic.stage;
-	enum logic_stage new_stage = STAGE_UNDEFINED;
-
-	switch (event) {
-	case EVENT_LEFT:
-		if (stage == STAGE_MAIN_SCREEN) {
-			logic_handle_stage(STAGE_MAIN_MENU);
-			new_stage = STAGE_MAIN_MENU;
-		} else if (stage == STAGE_MAIN_MENU ||
-			   stage == STAGE_ALARM) {
-			logic_handle_stage(STAGE_MAIN_SCREEN);
-			new_stage = STAGE_MAIN_SCREEN;
-		} else {
-			logic_set_new_time();
-			logic_handle_stage(STAGE_MAIN_SCREEN);
-			new_stage = STAGE_MAIN_SCREEN;
-		}
-		break;
-	case EVENT_RIGHT:
-		if (stage == STAGE_MAIN_SCREEN) {
-			logic_handle_stage(STAGE_MAIN_MENU);
-			new_stage = STAGE_MAIN_MENU;
-		} else if (stage == STAGE_ALARM) {
-			logic_config_alarm();
-			logic_handle_stage(STAGE_ALARM);
-			new_stage = STAGE_ALARM;
-		} else if (stage == STAGE_SET_HH) {
-			new_stage = STAGE_SET_MM;
-		} else if (stage == STAGE_SET_MM) {
-			new_stage = STAGE_SET_WDAY;
-		} else if (stage == STAGE_SET_WDAY) {
-			new_stage = STAGE_SET_MON;
-		} else if (stage == STAGE_SET_MON) {
-			new_stage = STAGE_SET_MDAY;
-		} else if (stage == STAGE_SET_MDAY) {
-			new_stage = STAGE_SET_YEAR;
-		} else if (stage == STAGE_SET_YEAR) {
-			new_stage = STAGE_SET_HH;
-		}
-		break;
-	case EVENT_UP:
-		if (stage == STAGE_MAIN_SCREEN) {
-			logic_handle_stage(STAGE_MAIN_MENU);
-			new_stage = STAGE_MAIN_MENU;
-		} else if (stage == STAGE_MAIN_MENU) {
-			logic_handle_stage(STAGE_ALARM);
-			new_stage = STAGE_ALARM;
-		} else if (stage == STAGE_ALARM) {
-			logic_incr_alarm_hh();
-			logic_handle_stage(STAGE_ALARM);
-			new_stage = STAGE_ALARM;
-		} else if (stage == STAGE_SET_HH) {
-			logic_handle_stage(STAGE_SET_HH);
-			new_stage = STAGE_SET_HH;
-		} else if (stage == STAGE_SET_MM) {
-			logic_handle_stage(STAGE_SET_MM);
-			new_stage = STAGE_SET_MM;
-		} else if (stage == STAGE_SET_WDAY) {
-			logic_handle_stage(STAGE_SET_WDAY);
-			new_stage = STAGE_SET_WDAY;
-		} else if (stage == STAGE_SET_MON) {
-			logic_handle_stage(STAGE_SET_MON);
-			new_stage = STAGE_SET_MON;
-		} else if (stage == STAGE_SET_MDAY) {
-			logic_handle_stage(STAGE_SET_MDAY);
-			new_stage = STAGE_SET_MDAY;
-		} else if (stage == STAGE_SET_YEAR) {
-			logic_handle_stage(STAGE_SET_YEAR);
-			new_stage = STAGE_SET_YEAR;
-		}
-		break;
-	case EVENT_DOWN:
-		if (stage == STAGE_MAIN_SCREEN) {
-			logic_handle_stage(STAGE_MAIN_MENU);
-			new_stage = STAGE_MAIN_MENU;
-		} else if (stage == STAGE_ALARM) {
-			logic_incr_alarm_mm();
-			logic_handle_stage(STAGE_ALARM);
-			new_stage = STAGE_ALARM;
-		} else if (stage == STAGE_MAIN_MENU) {
-			logic_handle_stage(STAGE_ADJUSTMENT);
-			new_stage = STAGE_SET_HH;
-		}
-		break;
-	}
+static void logic_handle_btn(const struct kbd_key_event *ev)
+{
+	enum logic_event event = ev->button;
 
-	logic.stage = new_stage;
+	if (ev->event == KBD_EVENT_PRESS ||
+	    (ev->event == KBD_EVENT_REPEAT && logic_key_repeatable(event)))
+		logic_post_event(event);
+	else if (ev->event == KBD_EVENT_LONG_PRESS && event == EVENT_RIGHT)
+		logic_post_event(EVENT_FACE);
 }
 
-static void logic_activate_alarm_sig(void)
+/**
+ * Take time and alarm from RTC, so that reset doesn't affect them.
+ *
+ * Only if RTC lost the time (e.g. its battery is dead), it's set to the
+ * beginning of the epoch.
+ */
+static void logic_restore_time(void)
 {
-	logic.stage = STAGE_ALARM_TRIG;
-	logic_handle_stage(STAGE_ALARM_TRIG);
+	int err;
+
+	err = ds3231_restore(&logic.rtc, &logic.tm);
+	if (err == -EINVAL) {
+		pr_warn("Warning: RTC lost time, setting default one\n");
+		memset(&logic.tm, 0, sizeof(logic.tm));
+		logic.tm.tm_mday = 1;
+		logic.tm.tm_wday = 5;	/* 1 Jan 2021 is Friday */
+		logic.tm.tm_year = TM_DEFAULT_YEAR;
+		logic.rtc.alarm.time = logic.tm;
+		err = ds3231_set_time(&logic.rtc, &logic.tm);
+	}
+	if (err) {
+		pr_emerg("Error: Can't restore RTC time: %d\n", err);
+		hang();
+	}
+
+	logic_publish_time(&logic.tm);
 }
 
-static void logic_handle_btn(int button, bool pressed)
+/* Prepare tasks producing and consuming main screen data */
+static void logic_init_tasks(void)
 {
-	enum logic_event event = button;
+	int ret;
 
-	if (pressed)
-		logic_handle_key_press(event);
+	ret = pt_init(&logic.temper_pt, TASK_ID(temper));
+	if (ret < 0) {
+		pr_emerg("Error: Can't init temper thread: %d\n", ret);
+		hang();
+	}
 }
 
 void logic_start(void)
 {
-	logic_handle_stage(STAGE_INIT);
+	int ret;
+
+	logic.swtim.cb = logic_main_screen_tick;
+	logic.swtim.data = NULL;
+	logic.swtim.period = TIM_PERIOD;
+
+	logic_init_tasks();
+	logic_init_drivers();
+
+	ret = swtimer_tim_register(&logic.swtim);
+	if (ret < 0) {
+		pr_emerg("Error: Can't register timer: %d\n", ret);
+		hang();
+	}
+
+	if (logic.ds3231_presence_flag)
+		logic_restore_time();
+
+	if (logic.ds18b20_presence_flag)
+		sched_set_ready(TASK_ID(temper));
+
+	logic.stage = STAGE_MAIN_SCREEN;
+	logic_states[STAGE_MAIN_SCREEN].entry();
 }
@@ -4,12 +4,14 @@
  */
 
 #include <board.h>
+#include <core/crit_profile.h>
 #include <core/irq.h>
 #include <core/log.h>
 #include <core/reset.h>
 #include <core/sched.h>
 #include <core/swtimer.h>
 #include <core/systick.h>
+#include <core/trace.h>
 #include <core/wdt.h>
 #include <drivers/serial.h>
 #include <logic.h>
@@ -62,6 +64,7 @@ static void init_core(void)
 	};
 	struct serial_params serial = {
 		.uart = SERIAL_USART,
+		.irq = SERIAL_USART_IRQ,
 		.baud = CONFIG_SERIAL_SPEED,
 		.bits = 8,
 		.stopbits = USART_STOPBITS_1,
@@ -85,11 +88,19 @@ static void init_core(void)
 		hang();
 	}
 
+	err = crit_profile_init();
+	if (err)
+		pr_warn("Warning: Can't initialize crit profiler: %d\n", err);
+
 	board_init();
 	serial_init(&serial);
 	init_reset();
 	sched_init();
 
+	err = trace_init();
+	if (err)
+		pr_warn("Warning: Can't initialize trace: %d\n", err);
+
 	err = swtimer_init(&hw_tim);
 	if (err) {
 		pr_emerg("Error: Can't initialize swtimer\n");
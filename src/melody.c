@@ -4,36 +4,62 @@
  */
 
 #include <melody.h>
+#include <note.h>
 #include <tools/common.h>
+#include <stdint.h>
 
-/* The note frequency given in Hz */
-#define A4		440
-#define A5		880
-#define B4		494
-#define B5		988
-#define C5		523
-#define D4		294
-#define D5		587
-
-/* Note duration in msec */
-#define BPM		480		/* Bits per minute */
-#define CROTCHET	(60000 / BPM)	/* Quarter note */
-#define QUAVER		(CROTCHET / 2)	/* Eighth note */
-#define MINIM		(CROTCHET * 2)	/* Half note */
-#define NO_TONE		0
-
-const struct note melody_alarm[] = {
-	{ D4, QUAVER },
-	{ A5, CROTCHET },
-	{ A4, QUAVER },
-	{ B5, QUAVER },
-	{ C5, QUAVER },
-	{ B4, QUAVER },
-	{ NO_TONE, QUAVER },
-	{ C5, CROTCHET },
-	{ D5, QUAVER },
-	{ A5, QUAVER },
-	{ D4, MINIM },
+#define MELODY(_name, _notes, _whole, _octave)				\
+	{								\
+		.name = (_name),					\
+		.notes = (_notes),					\
+		.len = sizeof(_notes),					\
+		.whole = (_whole),					\
+		.octave = (_octave),					\
+	}
+
+/*
+ * Below is generated with:
+ *     scripts/rtttl2c.py scripts/melodies.rtttl
+ */
+
+/* Beep */
+static const uint8_t melody_beep[] = {
+	0xb2, 0x04, 0x29, 0xb9, 0x04, 0x3b, 0x30, 0xbb,
+	0x04, 0x3f, 0x20, 0x32, 0x39, 0x92, 0x04,
+};
+
+/* Fur Elise */
+static const uint8_t melody_fur_elise[] = {
+	0x5f, 0xb4, 0x06, 0xb3, 0x06, 0xb4, 0x06, 0xb3,
+	0x06, 0xb4, 0x06, 0x3b, 0xb2, 0x06, 0xb0, 0x06,
+	0xa9, 0x0d, 0x5f, 0x30, 0x34, 0x39, 0xab, 0x0d,
+	0x5f, 0x34, 0x38, 0x3b, 0xa0, 0x0e, 0x5f, 0x34,
+	0xb4, 0x06, 0xb3, 0x06, 0xb4, 0x06, 0xb3, 0x06,
+	0xb4, 0x06, 0x3b, 0xb2, 0x06, 0xb0, 0x06, 0xa9,
+	0x0d, 0x5f, 0x30, 0x34, 0x39, 0xab, 0x0d, 0x5f,
+	0x32, 0xb0, 0x06, 0x3b, 0x19,
+};
+
+/* Ode to Joy */
+static const uint8_t melody_ode_to_joy[] = {
+	0x24, 0x24, 0x25, 0x27, 0x27, 0x25, 0x24, 0x22,
+	0x20, 0x20, 0x22, 0x24, 0xa4, 0x0d, 0x32, 0x12,
+	0x24, 0x24, 0x25, 0x27, 0x27, 0x25, 0x24, 0x22,
+	0x20, 0x20, 0x22, 0x24, 0xa2, 0x0d, 0x30, 0x10,
+};
+
+/* Westminster */
+static const uint8_t melody_westminster[] = {
+	0x24, 0x20, 0x22, 0x97, 0x04, 0xa7, 0x04, 0x22,
+	0x24, 0x10, 0x24, 0x22, 0x20, 0x97, 0x04, 0xa7,
+	0x04, 0x22, 0x24, 0x10,
+};
+
+const struct melody melodies[] = {
+	MELODY("Beep", melody_beep, 500, 5),
+	MELODY("Fur Elise", melody_fur_elise, 1920, 5),
+	MELODY("Ode to Joy", melody_ode_to_joy, 1714, 5),
+	MELODY("Westminster", melody_westminster, 2400, 5),
 };
 
-const size_t melody_alarm_len = ARRAY_SIZE(melody_alarm);
+const size_t melodies_nr = ARRAY_SIZE(melodies);
@@ -5,25 +5,105 @@
 
 #include <note.h>
 #include <player.h>
+#include <core/swtimer.h>
 #include <tools/common.h>
 #include <stddef.h>
 #include <string.h>
 
+/* Octave of note_freq[] table */
+#define NOTE_FREQ_OCTAVE	7
+
+/* Equal temperament frequencies (A4 = 440 Hz) of the 7th octave, Hz */
+static const uint16_t note_freq[12] = {
+	2093, 2217, 2349, 2489, 2637, 2794,	/* C7 .. F7 */
+	2960, 3136, 3322, 3520, 3729, 3951,	/* F#7 .. B7 */
+};
+
+/* Unpack next note of the melody; see note.h for the format */
+static void player_decode_note(struct player *obj, struct note *note)
+{
+	const struct melody *m = obj->melody;
+	uint8_t b = m->notes[obj->pos++];
+	uint8_t pitch = b & NOTE_PITCH_MASK;
+	uint8_t octave = m->octave;
+	bool dotted = false;
+
+	if (b & NOTE_EXT) {
+		uint8_t ext = m->notes[obj->pos++];
+
+		octave = ext & NOTE_OCTAVE_MASK;
+		dotted = ext & NOTE_DOTTED;
+	}
+
+	note->duration = m->whole >> ((b >> NOTE_DUR_SHIFT) & NOTE_DUR_MASK);
+	if (dotted)
+		note->duration += note->duration / 2;
+
+	/* Codes 12..14 are not used by the format: play them as a pause */
+	if (pitch == NOTE_REST || pitch >= ARRAY_SIZE(note_freq))
+		note->tone = 0;
+	else
+		note->tone = note_freq[pitch] >> (NOTE_FREQ_OCTAVE - octave);
+
+	if (obj->pos >= m->len)
+		obj->pos = 0;
+}
+
+/*
+ * Start playing next note of the melody and arm the timer to expire when the
+ * note ends.
+ */
+static void player_play_next_note(struct player *obj)
+{
+	struct note note;
+
+	player_decode_note(obj, &note);
+	obj->play_note_cb(note.tone, note.duration);
+	swtimer_tim_set_period(obj->swtim.id, note.duration);
+	obj->elapsed += note.duration;
+}
+
+/* Timer callback: current note is over */
+static void player_note_end(void *data)
+{
+	struct player *obj = (struct player *)(data);
+
+	if (obj->timeout && obj->elapsed >= obj->timeout) {
+		player_stop(obj);
+		if (obj->done_cb)
+			obj->done_cb(obj->done_data);
+		return;
+	}
+
+	player_play_next_note(obj);
+}
+
 /**
- * Play note.
+ * Start playing melody.
  *
- * When function is called, plays one note and returns. Every
- * subsequent call plays following note of the melody.
+ * Melody is played in background (from software timer), over and over again,
+ * until @ref player_stop() is called or @p timeout expires.
  *
  * @param obj Player object
+ * @param timeout Time to stop playing after, msec; 0 to play until stopped
+ * @param done_cb Function to call when @p timeout expires (can be NULL)
+ * @param done_data User data for @p done_cb
  */
-void player_play_next_note(struct player *obj)
+void player_start(struct player *obj, uint32_t timeout,
+		  player_done_cb_t done_cb, void *done_data)
 {
-	const struct note *note = &obj->melody[obj->pos];
+	if (obj->playing)
+		player_stop(obj);
 
-	obj->play_note_cb(note->tone, note->duration);
-	obj->pos++;
-	obj->pos %= obj->melody_len;
+	obj->timeout = timeout;
+	obj->done_cb = done_cb;
+	obj->done_data = done_data;
+	obj->elapsed = 0;
+	obj->playing = true;
+
+	player_play_next_note(obj);
+	swtimer_tim_reset(obj->swtim.id);
+	swtimer_tim_start(obj->swtim.id);
 }
 
 /**
@@ -33,30 +113,59 @@ void player_play_next_note(struct player *obj)
  */
 void player_stop(struct player *obj)
 {
+	swtimer_tim_stop(obj->swtim.id);
+	if (obj->playing)
+		obj->play_note_cb(0, 0);
+	obj->playing = false;
 	obj->pos = 0;
 }
 
+/**
+ * Change the melody to play.
+ *
+ * If some melody is playing, it's stopped.
+ *
+ * @param obj Player object
+ * @param melody Music theme to play
+ */
+void player_set_melody(struct player *obj, const struct melody *melody)
+{
+	player_stop(obj);
+	obj->melody = melody;
+}
+
 /**
  * Initialize player module.
  *
  * @param obj Player object
- * @param melody Music theme (array of notes) to play
- * @param melody_len Number of notes in @p melody array
- * @param play_note_cb Function to play note
+ * @param melody Music theme to play
+ * @param play_note_cb Function to start playing note
  * @return 0 on success or negative number on error
  */
-int player_init(struct player *obj, const struct note *melody,
-		size_t melody_len, player_play_note_cb_t play_note_cb)
+int player_init(struct player *obj, const struct melody *melody,
+		player_play_note_cb_t play_note_cb)
 {
+	int ret;
+
 	obj->play_note_cb = play_note_cb;
 	obj->melody = melody;
-	obj->melody_len = melody_len;
 	obj->pos = 0;
+	obj->playing = false;
+
+	obj->swtim.cb = player_note_end;
+	obj->swtim.data = obj;
+	obj->swtim.period = SWTIMER_HW_OVERFLOW;
+	ret = swtimer_tim_register(&obj->swtim);
+	if (ret < 0)
+		return ret;
+	swtimer_tim_stop(obj->swtim.id);
 
 	return 0;
 }
 
 void player_exit(struct player *obj)
 {
+	player_stop(obj);
+	swtimer_tim_del(obj->swtim.id);
 	memset(obj, 0, sizeof(*obj));
 }
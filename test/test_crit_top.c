@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof(a[0]))
+
+#define CRIT_TOP_NR		5	/* sites to report */
+
+struct crit_site {
+	const char *func;		/* function containing the section */
+	uint16_t line;			/* enter_critical() line */
+	bool registered;		/* site is in the list of sites */
+	uint32_t count;			/* times IRQs were masked here */
+	uint32_t max;			/* longest masked time, CPU cycles */
+	uint64_t sum;			/* total masked time, CPU cycles */
+	struct crit_site *next;
+};
+
+/* ------------------------------------------------------------------------- */
+
+/* Same as in crit_profile_report(), without locking */
+static int crit_top(struct crit_site *sites, struct crit_site *top)
+{
+	struct crit_site *site;
+	int nr = 0;
+	int i;
+
+	for (site = sites; site; site = site->next) {
+		if (!site->count)
+			continue;
+		for (i = nr; i > 0 && top[i - 1].max < site->max; --i) {
+			if (i < CRIT_TOP_NR)
+				top[i] = top[i - 1];
+		}
+		if (i < CRIT_TOP_NR) {
+			top[i] = *site;
+			if (nr < CRIT_TOP_NR)
+				nr++;
+		}
+	}
+
+	return nr;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct crit_site *make_list(struct crit_site *sites, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		sites[i].next = i + 1 < n ? &sites[i + 1] : NULL;
+
+	return n ? &sites[0] : NULL;
+}
+
+bool test_top_order(void)
+{
+	static const uint32_t max[] = { 30, 10, 70, 50, 20, 90, 60, 40, 80 };
+	static const uint32_t expected[] = { 90, 80, 70, 60, 50 };
+	struct crit_site sites[ARRAY_SIZE(max)] = { { 0 } };
+	struct crit_site top[CRIT_TOP_NR];
+	size_t i;
+	int nr;
+
+	printf("%s\n", __func__);
+
+	for (i = 0; i < ARRAY_SIZE(max); i++) {
+		sites[i].count = 1;
+		sites[i].max = max[i];
+	}
+
+	nr = crit_top(make_list(sites, ARRAY_SIZE(sites)), top);
+	if (nr != CRIT_TOP_NR)
+		goto err;
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		if (top[i].max != expected[i])
+			goto err;
+	}
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	return false;
+}
+
+bool test_few_sites(void)
+{
+	struct crit_site sites[3] = { { 0 } };
+	struct crit_site top[CRIT_TOP_NR];
+	int nr;
+
+	printf("%s\n", __func__);
+
+	/* Section being executed right now is not counted yet */
+	sites[0].count = 2;
+	sites[0].max = 5;
+	sites[1].count = 0;
+	sites[2].count = 1;
+	sites[2].max = 7;
+
+	nr = crit_top(make_list(sites, ARRAY_SIZE(sites)), top);
+	if (nr != 2 || top[0].max != 7 || top[1].max != 5)
+		goto err;
+
+	nr = crit_top(make_list(sites, 0), top);
+	if (nr != 0)
+		goto err;
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	return false;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_top_order();
+	if (!res)
+		return EXIT_FAILURE;
+
+	res = test_few_sites();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
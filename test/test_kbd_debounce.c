@@ -0,0 +1,196 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS			1
+#define KBD_SCAN_PERIOD		10
+#define KBD_DEBOUNCE_MAX	3
+#define KBD_LONG_PRESS_TIME	1000
+#define KBD_REPEAT_DELAY	500
+#define KBD_REPEAT_START	250
+#define KBD_REPEAT_MIN		50
+#define KBD_REPEAT_ACCEL	4
+
+enum kbd_event {
+	KBD_EVENT_PRESS,
+	KBD_EVENT_RELEASE,
+	KBD_EVENT_LONG_PRESS,
+	KBD_EVENT_REPEAT,
+};
+
+typedef void (*kbd_btn_event_cb_t)(int button, enum kbd_event event);
+
+struct kbd_key {
+	uint8_t integrator;
+	bool pressed;
+	uint16_t hold_time;
+	uint16_t repeat_left;
+	uint16_t repeat_period;
+};
+
+struct kbd {
+	kbd_btn_event_cb_t btn_event_cb;
+	struct kbd_key keys[KEYS];
+};
+
+static void kbd_push_event(struct kbd *obj, int btn, enum kbd_event event)
+{
+	obj->btn_event_cb(btn, event);
+}
+
+/* Code under test (copied from src/drivers/kbd.c) */
+static void kbd_hold_key(struct kbd *obj, int btn)
+{
+	struct kbd_key *key = &obj->keys[btn];
+
+	if (key->hold_time < KBD_LONG_PRESS_TIME) {
+		key->hold_time += KBD_SCAN_PERIOD;
+		if (key->hold_time >= KBD_LONG_PRESS_TIME)
+			kbd_push_event(obj, btn, KBD_EVENT_LONG_PRESS);
+	}
+
+	if (key->repeat_left > KBD_SCAN_PERIOD) {
+		key->repeat_left -= KBD_SCAN_PERIOD;
+		return;
+	}
+
+	kbd_push_event(obj, btn, KBD_EVENT_REPEAT);
+
+	/* Accelerate auto-repeat */
+	key->repeat_left = key->repeat_period;
+	key->repeat_period -= key->repeat_period / KBD_REPEAT_ACCEL;
+	if (key->repeat_period < KBD_REPEAT_MIN)
+		key->repeat_period = KBD_REPEAT_MIN;
+}
+
+static void kbd_update_key(struct kbd *obj, int btn, bool pressed_now)
+{
+	struct kbd_key *key = &obj->keys[btn];
+
+	if (pressed_now && key->integrator < KBD_DEBOUNCE_MAX)
+		key->integrator++;
+	else if (!pressed_now && key->integrator > 0)
+		key->integrator--;
+
+	if (!key->pressed) {
+		if (key->integrator == KBD_DEBOUNCE_MAX) {
+			key->pressed = true;
+			key->hold_time = 0;
+			key->repeat_left = KBD_REPEAT_DELAY;
+			key->repeat_period = KBD_REPEAT_START;
+			kbd_push_event(obj, btn, KBD_EVENT_PRESS);
+		}
+	} else if (key->integrator == 0) {
+		key->pressed = false;
+		kbd_push_event(obj, btn, KBD_EVENT_RELEASE);
+	} else {
+		kbd_hold_key(obj, btn);
+	}
+}
+
+/* Test harness */
+#define EVENTS_MAX		64
+
+static int events[EVENTS_MAX];	/* scan number of each event */
+static enum kbd_event types[EVENTS_MAX];
+static int events_nr;
+static int scan_nr;
+
+static void event_cb(int button, enum kbd_event event)
+{
+	(void)button;
+
+	if (events_nr < EVENTS_MAX) {
+		events[events_nr] = scan_nr;
+		types[events_nr] = event;
+	}
+	events_nr++;
+}
+
+static void run(struct kbd *obj, const char *samples)
+{
+	for (; *samples; ++samples, ++scan_nr)
+		kbd_update_key(obj, 0, *samples == '1');
+}
+
+static int count(enum kbd_event type)
+{
+	int i, n = 0;
+
+	for (i = 0; i < events_nr && i < EVENTS_MAX; ++i)
+		n += types[i] == type;
+
+	return n;
+}
+
+static bool test_bounce(void)
+{
+	struct kbd obj = { .btn_event_cb = event_cb };
+
+	/* Bouncing press, short hold, bouncing release */
+	events_nr = scan_nr = 0;
+	run(&obj, "1010110111111111110100100000000");
+
+	return events_nr == 2 && types[0] == KBD_EVENT_PRESS &&
+	       types[1] == KBD_EVENT_RELEASE && !obj.keys[0].integrator;
+}
+
+static bool test_glitch(void)
+{
+	struct kbd obj = { .btn_event_cb = event_cb };
+
+	/* Short spikes never reach integrator limit */
+	events_nr = scan_nr = 0;
+	run(&obj, "1000100011000110010100000");
+
+	return events_nr == 0;
+}
+
+static bool test_hold(void)
+{
+	struct kbd obj = { .btn_event_cb = event_cb };
+	char samples[3000 / KBD_SCAN_PERIOD + 1];
+	int last_period = KBD_REPEAT_DELAY;
+	int i, prev;
+
+	/* Hold for 3 sec */
+	memset(samples, '1', sizeof(samples) - 1);
+	samples[sizeof(samples) - 1] = '\0';
+	events_nr = scan_nr = 0;
+	run(&obj, samples);
+
+	if (count(KBD_EVENT_PRESS) != 1 || count(KBD_EVENT_LONG_PRESS) != 1)
+		return false;
+
+	/* Repeat periods should never grow and stay above the minimum */
+	prev = 0;
+	for (i = 0; i < events_nr && i < EVENTS_MAX; ++i) {
+		int period;
+
+		if (types[i] != KBD_EVENT_REPEAT)
+			continue;
+		if (prev) {
+			period = (events[i] - prev) * KBD_SCAN_PERIOD;
+			if (period > last_period || period < KBD_REPEAT_MIN)
+				return false;
+			last_period = period;
+		}
+		prev = events[i];
+	}
+
+	return count(KBD_EVENT_REPEAT) > 3000 / KBD_REPEAT_START;
+}
+
+int main(void)
+{
+	if (!test_bounce() || !test_glitch() || !test_hold()) {
+		printf("[FAIL]\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("[SUCCESS]\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,417 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNUSED(x)		((void)x)
+#define pr_warn(...)
+#define LOGIC_QUEUE_LEN		8
+
+/* Keep 0 as undefined state: it means "no transition" in FSM table */
+enum logic_stage {
+	STAGE_UNDEFINED = 0,
+	STAGE_MAIN_SCREEN,
+	STAGE_MAIN_MENU,
+	STAGE_ALARM,
+	STAGE_ALARM_TRIG,
+	STAGE_MELODY,
+	STAGE_SET_HH,
+	STAGE_SET_MM,
+	STAGE_SET_WDAY,
+	STAGE_SET_MON,
+	STAGE_SET_MDAY,
+	STAGE_SET_YEAR,
+	STAGE_NR,
+};
+
+/* Button events must go first and match kbd button numbers */
+enum logic_event {
+	EVENT_LEFT,	/* left button */
+	EVENT_RIGHT,	/* right button */
+	EVENT_UP,	/* up button */
+	EVENT_DOWN,	/* down button */
+	EVENT_ALARM,	/* RTC alarm went off */
+	EVENT_TIMEOUT,	/* alarm melody played for too long */
+	EVENT_FACE,	/* right button held: toggle clock face */
+	EVENT_NR,
+};
+
+typedef void (*logic_action_t)(void);
+typedef bool (*logic_guard_t)(void);
+
+/* Actions run on entering and leaving the stage */
+struct logic_state {
+	logic_action_t entry;
+	logic_action_t exit;
+};
+
+struct logic_transition {
+	enum logic_stage next;	/* STAGE_UNDEFINED: event is ignored */
+	logic_guard_t guard;	/* if set, transition is taken only if true */
+	logic_action_t action;	/* run between exit and entry actions */
+};
+
+struct logic {
+	bool ds3231_presence_flag;
+	enum logic_stage stage;
+	uint8_t queue[LOGIC_QUEUE_LEN];
+	uint8_t head;
+	uint8_t tail;
+	uint8_t dropped;
+	int task_id;
+};
+
+static struct logic logic;
+
+/* Stubs: record action calls */
+static char trace[1024];
+static bool post_left_on_next_melody;
+
+static void sched_set_ready(int task_id)
+{
+	UNUSED(task_id);
+}
+
+#define STUB(name)							\
+static void logic_##name(void)						\
+{									\
+	strcat(trace, #name ";");					\
+}
+
+STUB(enter_main_screen)
+STUB(exit_main_screen)
+STUB(toggle_face)
+STUB(enter_main_menu)
+STUB(enter_alarm)
+STUB(enter_alarm_trig)
+STUB(exit_alarm_trig)
+STUB(enter_melody)
+STUB(exit_melody)
+STUB(show_adjustment_screen)
+STUB(set_new_time)
+STUB(read_adjust_time)
+STUB(incr_field)
+STUB(config_alarm)
+STUB(incr_alarm_hh)
+STUB(incr_alarm_mm)
+
+static void logic_post_event(enum logic_event event);
+
+static void logic_next_melody(void)
+{
+	strcat(trace, "next_melody;");
+	if (post_left_on_next_melody)
+		logic_post_event(EVENT_LEFT);
+}
+
+static bool logic_rtc_present(void)
+{
+	return logic.ds3231_presence_flag;
+}
+
+/* Code under test (copied from src/logic.c) */
+static const struct logic_state logic_states[STAGE_NR] = {
+	[STAGE_MAIN_SCREEN] = { logic_enter_main_screen,
+				logic_exit_main_screen },
+	[STAGE_MAIN_MENU]   = { logic_enter_main_menu, NULL },
+	[STAGE_ALARM]	    = { logic_enter_alarm, NULL },
+	[STAGE_ALARM_TRIG]  = { logic_enter_alarm_trig,
+				logic_exit_alarm_trig },
+	[STAGE_MELODY]	    = { logic_enter_melody, logic_exit_melody },
+	[STAGE_SET_HH]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MM]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_WDAY]    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MON]	    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_MDAY]    = { logic_show_adjustment_screen, NULL },
+	[STAGE_SET_YEAR]    = { logic_show_adjustment_screen, NULL },
+};
+
+/* Time/date field editor: RIGHT selects next field, UP increments it */
+#define SET_FIELD(field, next_field)					\
+	{								\
+		[EVENT_LEFT]  = { STAGE_MAIN_SCREEN, NULL,		\
+				  logic_set_new_time },			\
+		[EVENT_RIGHT] = { next_field, NULL, NULL },		\
+		[EVENT_UP]    = { field, NULL, logic_incr_field },	\
+		[EVENT_ALARM] = { STAGE_ALARM_TRIG, NULL, NULL },	\
+	}
+
+/*
+ * Transitions: [current stage][event]. Missing entries (STAGE_UNDEFINED)
+ * mean the event is ignored in that stage. Self-transitions run exit and
+ * entry actions too, so the screen gets redrawn after the action.
+ */
+static const struct logic_transition logic_fsm[STAGE_NR][EVENT_NR] = {
+	[STAGE_MAIN_SCREEN] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_DOWN]	= { STAGE_MAIN_MENU, NULL, NULL },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+		[EVENT_FACE]	= { STAGE_MAIN_SCREEN, NULL,
+				    logic_toggle_face },
+	},
+	[STAGE_MAIN_MENU] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MELODY, NULL, NULL },
+		[EVENT_UP]	= { STAGE_ALARM, logic_rtc_present, NULL },
+		[EVENT_DOWN]	= { STAGE_SET_HH, logic_rtc_present,
+				    logic_read_adjust_time },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+		/* Press of held button has opened the menu already */
+		[EVENT_FACE]	= { STAGE_MAIN_SCREEN, NULL,
+				    logic_toggle_face },
+	},
+	[STAGE_ALARM] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_ALARM, NULL, logic_config_alarm },
+		[EVENT_UP]	= { STAGE_ALARM, NULL, logic_incr_alarm_hh },
+		[EVENT_DOWN]	= { STAGE_ALARM, NULL, logic_incr_alarm_mm },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+	},
+	[STAGE_ALARM_TRIG] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_RIGHT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_DOWN]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_TIMEOUT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+	},
+	[STAGE_MELODY] = {
+		[EVENT_LEFT]	= { STAGE_MAIN_SCREEN, NULL, NULL },
+		[EVENT_UP]	= { STAGE_MELODY, NULL, logic_next_melody },
+		[EVENT_ALARM]	= { STAGE_ALARM_TRIG, NULL, NULL },
+	},
+	[STAGE_SET_HH]		= SET_FIELD(STAGE_SET_HH, STAGE_SET_MM),
+	[STAGE_SET_MM]		= SET_FIELD(STAGE_SET_MM, STAGE_SET_WDAY),
+	[STAGE_SET_WDAY]	= SET_FIELD(STAGE_SET_WDAY, STAGE_SET_MON),
+	[STAGE_SET_MON]		= SET_FIELD(STAGE_SET_MON, STAGE_SET_MDAY),
+	[STAGE_SET_MDAY]	= SET_FIELD(STAGE_SET_MDAY, STAGE_SET_YEAR),
+	[STAGE_SET_YEAR]	= SET_FIELD(STAGE_SET_YEAR, STAGE_SET_HH),
+};
+
+/**
+ * Run transition for the event in current stage.
+ *
+ * Order: exit action of current stage, transition action, entry action of
+ * new stage. Events posted by actions are queued and dispatched after this
+ * transition is complete.
+ *
+ * @param event What happened
+ */
+static void logic_dispatch(enum logic_event event)
+{
+	const struct logic_transition *t = &logic_fsm[logic.stage][event];
+
+	if (t->next == STAGE_UNDEFINED)
+		return;
+	if (t->guard && !t->guard())
+		return;
+
+	if (logic_states[logic.stage].exit)
+		logic_states[logic.stage].exit();
+	if (t->action)
+		t->action();
+	logic.stage = t->next;
+	if (logic_states[logic.stage].entry)
+		logic_states[logic.stage].entry();
+}
+
+/**
+ * Put event to FSM queue and wake up the task handling it.
+ *
+ * Must be called from task context (button, RTC and timer callbacks are).
+ *
+ * @param event What happened
+ */
+static void logic_post_event(enum logic_event event)
+{
+	uint8_t tail = logic.tail;
+
+	if ((uint8_t)(tail - logic.head) == LOGIC_QUEUE_LEN) {
+		logic.dropped++;
+		return;
+	}
+
+	logic.queue[tail % LOGIC_QUEUE_LEN] = event;
+	logic.tail = tail + 1;
+	sched_set_ready(logic.task_id);
+}
+
+/* Task: dispatch queued events to FSM one by one */
+static void logic_task(void *data)
+{
+	UNUSED(data);
+
+	if (logic.dropped) {
+		pr_warn("Warning: logic: %u events dropped\n", logic.dropped);
+		logic.dropped = 0;
+	}
+
+	while (logic.head != logic.tail) {
+		enum logic_event event = logic.queue[logic.head %
+						     LOGIC_QUEUE_LEN];
+
+		logic.head++;
+		logic_dispatch(event);
+	}
+}
+
+/* Test harness */
+#define MAIN		STAGE_MAIN_SCREEN
+#define MENU		STAGE_MAIN_MENU
+#define TRIG		STAGE_ALARM_TRIG
+
+/* Expected stage after each event; 0 - event is ignored */
+static const enum logic_stage expected[STAGE_NR][EVENT_NR] = {
+	/*		     LEFT  RIGHT	 UP		  DOWN */
+	[MAIN]		 = { MENU, MENU,	 MENU,		  MENU,
+			     TRIG, 0, MAIN },
+	[MENU]		 = { MAIN, STAGE_MELODY, STAGE_ALARM,	  STAGE_SET_HH,
+			     TRIG, 0, MAIN },
+	[STAGE_ALARM]	 = { MAIN, STAGE_ALARM,	 STAGE_ALARM,	  STAGE_ALARM,
+			     TRIG, 0 },
+	[TRIG]		 = { MAIN, MAIN,	 MAIN,		  MAIN,
+			     0,	   MAIN },
+	[STAGE_MELODY]	 = { MAIN, 0,		 STAGE_MELODY,	  0,
+			     TRIG, 0 },
+	[STAGE_SET_HH]	 = { MAIN, STAGE_SET_MM,   STAGE_SET_HH,   0,
+			     TRIG, 0 },
+	[STAGE_SET_MM]	 = { MAIN, STAGE_SET_WDAY, STAGE_SET_MM,   0,
+			     TRIG, 0 },
+	[STAGE_SET_WDAY] = { MAIN, STAGE_SET_MON,  STAGE_SET_WDAY, 0,
+			     TRIG, 0 },
+	[STAGE_SET_MON]	 = { MAIN, STAGE_SET_MDAY, STAGE_SET_MON,  0,
+			     TRIG, 0 },
+	[STAGE_SET_MDAY] = { MAIN, STAGE_SET_YEAR, STAGE_SET_MDAY, 0,
+			     TRIG, 0 },
+	[STAGE_SET_YEAR] = { MAIN, STAGE_SET_HH,   STAGE_SET_YEAR, 0,
+			     TRIG, 0 },
+};
+
+/* Exact action sequences for some transitions */
+static const struct {
+	enum logic_stage stage;
+	enum logic_event event;
+	const char *trace;
+} traces[] = {
+	{ MAIN, EVENT_RIGHT, "exit_main_screen;enter_main_menu;" },
+	{ MAIN, EVENT_FACE, "exit_main_screen;toggle_face;enter_main_screen;" },
+	{ MENU, EVENT_FACE, "toggle_face;enter_main_screen;" },
+	{ MAIN, EVENT_ALARM, "exit_main_screen;enter_alarm_trig;" },
+	{ MENU, EVENT_RIGHT, "enter_melody;" },
+	{ MENU, EVENT_DOWN, "read_adjust_time;show_adjustment_screen;" },
+	{ STAGE_ALARM, EVENT_RIGHT, "config_alarm;enter_alarm;" },
+	{ STAGE_ALARM, EVENT_DOWN, "incr_alarm_mm;enter_alarm;" },
+	{ TRIG, EVENT_UP, "exit_alarm_trig;enter_main_screen;" },
+	{ TRIG, EVENT_TIMEOUT, "exit_alarm_trig;enter_main_screen;" },
+	{ STAGE_MELODY, EVENT_UP, "exit_melody;next_melody;enter_melody;" },
+	{ STAGE_MELODY, EVENT_LEFT, "exit_melody;enter_main_screen;" },
+	{ STAGE_SET_MON, EVENT_UP, "incr_field;show_adjustment_screen;" },
+	{ STAGE_SET_YEAR, EVENT_LEFT, "set_new_time;enter_main_screen;" },
+};
+
+static void run(enum logic_stage stage, enum logic_event event)
+{
+	logic.stage = stage;
+	trace[0] = '\0';
+	logic_post_event(event);
+	logic_task(NULL);
+}
+
+/* Walk every transition */
+static bool test_transitions(void)
+{
+	int s, e;
+	size_t i;
+
+	logic.ds3231_presence_flag = true;
+
+	for (s = STAGE_UNDEFINED + 1; s < STAGE_NR; s++) {
+		for (e = 0; e < EVENT_NR; e++) {
+			enum logic_stage next = expected[s][e];
+
+			run(s, e);
+			if (logic.stage != (next ? next : s) ||
+			    (!next && trace[0])) {
+				fprintf(stderr, "%d/%d: stage %d, trace %s\n",
+					s, e, logic.stage, trace);
+				return false;
+			}
+		}
+	}
+
+	for (i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+		run(traces[i].stage, traces[i].event);
+		if (strcmp(trace, traces[i].trace)) {
+			fprintf(stderr, "%d/%d: trace %s\n", traces[i].stage,
+				traces[i].event, trace);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Alarm and time settings are not reachable without RTC */
+static bool test_guards(void)
+{
+	logic.ds3231_presence_flag = false;
+
+	run(MENU, EVENT_UP);
+	if (logic.stage != MENU || trace[0])
+		return false;
+	run(MENU, EVENT_DOWN);
+	if (logic.stage != MENU || trace[0])
+		return false;
+
+	logic.ds3231_presence_flag = true;
+	return true;
+}
+
+/* Event posted by an action is handled after current transition is over */
+static bool test_run_to_completion(void)
+{
+	post_left_on_next_melody = true;
+	run(STAGE_MELODY, EVENT_UP);
+	post_left_on_next_melody = false;
+
+	return logic.stage == MAIN &&
+	       !strcmp(trace, "exit_melody;next_melody;enter_melody;"
+		       "exit_melody;enter_main_screen;");
+}
+
+/* Events are queued in order; overflow drops new events */
+static bool test_queue(void)
+{
+	int i;
+
+	logic.stage = MAIN;
+	logic_post_event(EVENT_ALARM);
+	logic_post_event(EVENT_LEFT);
+	logic_task(NULL);
+	if (logic.stage != MAIN)
+		return false;
+
+	for (i = 0; i < LOGIC_QUEUE_LEN + 2; i++)
+		logic_post_event(EVENT_RIGHT);
+	if (logic.dropped != 2)
+		return false;
+	trace[0] = '\0';
+	logic_task(NULL);
+
+	return logic.dropped == 0 && logic.head == logic.tail;
+}
+
+int main(void)
+{
+	if (!test_transitions() || !test_guards() ||
+	    !test_run_to_completion() || !test_queue()) {
+		printf("[FAIL]\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("[SUCCESS]\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BIT(n)			(1 << (n))
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+#define NOTE_EXT		BIT(7)
+#define NOTE_DUR_SHIFT		4
+#define NOTE_DUR_MASK		0x7
+#define NOTE_PITCH_MASK		0xf
+#define NOTE_REST		0xf
+#define NOTE_DOTTED		BIT(3)
+#define NOTE_OCTAVE_MASK	0x7
+
+struct note {
+	uint16_t tone;
+	uint16_t duration;
+};
+
+struct melody {
+	const char *name;
+	const uint8_t *notes;
+	uint16_t len;
+	uint16_t whole;
+	uint8_t octave;
+};
+
+struct player {
+	const struct melody *melody;
+	size_t pos;
+};
+
+/* Code under test (copied from src/player.c) */
+#define NOTE_FREQ_OCTAVE	7
+
+static const uint16_t note_freq[12] = {
+	2093, 2217, 2349, 2489, 2637, 2794,	/* C7 .. F7 */
+	2960, 3136, 3322, 3520, 3729, 3951,	/* F#7 .. B7 */
+};
+
+static void player_decode_note(struct player *obj, struct note *note)
+{
+	const struct melody *m = obj->melody;
+	uint8_t b = m->notes[obj->pos++];
+	uint8_t pitch = b & NOTE_PITCH_MASK;
+	uint8_t octave = m->octave;
+	bool dotted = false;
+
+	if (b & NOTE_EXT) {
+		uint8_t ext = m->notes[obj->pos++];
+
+		octave = ext & NOTE_OCTAVE_MASK;
+		dotted = ext & NOTE_DOTTED;
+	}
+
+	note->duration = m->whole >> ((b >> NOTE_DUR_SHIFT) & NOTE_DUR_MASK);
+	if (dotted)
+		note->duration += note->duration / 2;
+
+	/* Codes 12..14 are not used by the format: play them as a pause */
+	if (pitch == NOTE_REST || pitch >= ARRAY_SIZE(note_freq))
+		note->tone = 0;
+	else
+		note->tone = note_freq[pitch] >> (NOTE_FREQ_OCTAVE - octave);
+
+	if (obj->pos >= m->len)
+		obj->pos = 0;
+}
+
+/* Test data: "Beep" from src/melody.c vs. the old unpacked melody */
+static const uint8_t melody_beep[] = {
+	0xb2, 0x04, 0x29, 0xb9, 0x04, 0x3b, 0x30, 0xbb,
+	0x04, 0x3f, 0x20, 0x32, 0x39, 0x92, 0x04,
+};
+
+static const struct note beep_expected[] = {
+	{ 294, 62 }, { 880, 125 }, { 440, 62 }, { 988, 62 },
+	{ 523, 62 }, { 494, 62 }, { 0, 62 }, { 523, 125 },
+	{ 587, 62 }, { 880, 62 }, { 294, 250 },
+};
+
+/* Dotted note, octave change and wrap-around */
+static const uint8_t melody_misc[] = {
+	0xa9, 0x0e,	/* 4a.6 */
+	0x40,		/* 16c */
+};
+
+static const struct note misc_expected[] = {
+	{ 1760, 375 }, { 523, 62 }, { 1760, 375 },
+};
+
+/* Invalid pitch codes (12..14) decode as a pause, not past the table */
+static const uint8_t melody_bad[] = {
+	0x2c,		/* 4, pitch 12 */
+	0x3d,		/* 8, pitch 13 */
+	0xae, 0x05,	/* 4, pitch 14, ext */
+	0x2b,		/* 4b */
+};
+
+static const struct note bad_expected[] = {
+	{ 0, 250 }, { 0, 125 }, { 0, 250 }, { 988, 250 },
+};
+
+static bool check(const uint8_t *notes, size_t len, uint16_t whole,
+		  const struct note *expected, size_t nr)
+{
+	const struct melody m = { "test", notes, len, whole, 5 };
+	struct player pl = { &m, 0 };
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct note n;
+		int diff;
+
+		player_decode_note(&pl, &n);
+		diff = n.tone - expected[i].tone;
+		/* Table is 1 Hz off from rounded values in some octaves */
+		if (diff < -1 || diff > 1 || n.duration != expected[i].duration) {
+			fprintf(stderr, "Note %zu: %u Hz %u ms\n", i, n.tone,
+				n.duration);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	if (!check(melody_beep, sizeof(melody_beep), 500, beep_expected,
+		   ARRAY_SIZE(beep_expected)) ||
+	    !check(melody_misc, sizeof(melody_misc), 1000, misc_expected,
+		   ARRAY_SIZE(misc_expected)) ||
+	    !check(melody_bad, sizeof(melody_bad), 1000, bad_expected,
+		   ARRAY_SIZE(bad_expected))) {
+		printf("[FAIL]\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("[SUCCESS]\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Scheduler and swtimer stubs */
+static bool task_ready;
+static int sleep_msec;
+
+struct swtimer_sw_tim {
+	bool active;
+};
+
+static void sched_set_ready(int task_id)
+{
+	(void)task_id;
+	task_ready = true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Same as in core/pt.h */
+struct pt {
+	void *lc;			/* where to resume; NULL: from start */
+	bool yielded;			/* PT_YIELD() returned already */
+	int task_id;			/* task running the thread */
+	struct swtimer_sw_tim tim;	/* wakes the task after PT_SLEEP_MS() */
+};
+
+#define __PT_LABEL2(line)	pt_resume_##line
+#define __PT_LABEL(line)	__PT_LABEL2(line)
+
+#define __PT_SET(pt)							\
+do {									\
+	__PT_LABEL(__LINE__):						\
+	(pt)->lc = &&__PT_LABEL(__LINE__);				\
+} while (0)
+
+#define PT_BEGIN(pt)							\
+do {									\
+	if ((pt)->lc)							\
+		goto *(pt)->lc;						\
+} while (0)
+
+#define PT_END(pt)							\
+do {									\
+	(pt)->lc = NULL;						\
+	return;								\
+} while (0)
+
+#define PT_WAIT_UNTIL(pt, cond)						\
+do {									\
+	__PT_SET(pt);							\
+	if (!(cond))							\
+		return;							\
+} while (0)
+
+#define PT_YIELD(pt)							\
+do {									\
+	(pt)->yielded = false;						\
+	__PT_SET(pt);							\
+	if (!(pt)->yielded) {						\
+		(pt)->yielded = true;					\
+		sched_set_ready((pt)->task_id);				\
+		return;							\
+	}								\
+} while (0)
+
+#define PT_SLEEP_MS(pt, msec)						\
+do {									\
+	pt_sleep(pt, msec);						\
+	PT_WAIT_UNTIL(pt, !pt_sleeping(pt));				\
+} while (0)
+
+static void pt_sleep(struct pt *pt, int msec)
+{
+	pt->tim.active = true;
+	sleep_msec = msec;
+}
+
+static bool pt_sleeping(const struct pt *pt)
+{
+	return pt->tim.active;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct thread {
+	struct pt pt;
+	bool event;
+	int step;			/* last reached step */
+	int i;
+};
+
+static void thread_func(void *data)
+{
+	struct thread *t = data;
+
+	PT_BEGIN(&t->pt);
+	t->step = 1;
+	PT_YIELD(&t->pt);
+	t->step = 2;
+	PT_WAIT_UNTIL(&t->pt, t->event);
+	t->step = 3;
+	for (t->i = 0; t->i < 2; t->i++)
+		PT_SLEEP_MS(&t->pt, 100 + t->i);
+	t->step = 4;
+	PT_END(&t->pt);
+}
+
+/* Run thread once, like scheduler does for ready task */
+static void run(struct thread *t)
+{
+	task_ready = false;
+	thread_func(t);
+}
+
+bool test_resume(void)
+{
+	struct thread t = { { NULL } };
+
+	printf("%s\n", __func__);
+
+	/* Yield: stops and asks to be run again */
+	run(&t);
+	if (t.step != 1 || !task_ready)
+		goto err;
+
+	/* Wait: nothing happens until the event */
+	run(&t);
+	if (t.step != 2 || task_ready)
+		goto err;
+	run(&t);
+	if (t.step != 2)
+		goto err;
+	t.event = true;
+
+	/* Sleep in loop: loop state is kept in object */
+	run(&t);
+	if (t.step != 3 || sleep_msec != 100)
+		goto err;
+	run(&t);			/* spurious wakeup */
+	if (t.step != 3 || sleep_msec != 100)
+		goto err;
+	t.pt.tim.active = false;	/* timer expired */
+	run(&t);
+	if (t.step != 3 || sleep_msec != 101)
+		goto err;
+	t.pt.tim.active = false;
+	run(&t);
+	if (t.step != 4 || t.pt.lc != NULL)
+		goto err;
+
+	/* Thread is finished: starts over on next run */
+	run(&t);
+	if (t.step != 1 || !task_ready)
+		goto err;
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	return false;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_resume();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
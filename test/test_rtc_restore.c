@@ -0,0 +1,155 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof(a[0]))
+#define BIT(n)		(1 << (n))
+
+#define DS3231_A1M		BIT(7)	/* Alarm 1 mask bit */
+#define DS3231_12H		BIT(6)	/* 12-hour mode bit of hours register */
+#define DS3231_CENTURY		BIT(7)	/* Century bit of month register */
+
+struct test_data {
+	uint8_t regs[7];		/* seconds..year registers */
+	bool valid;
+};
+
+static struct test_data time_data[] = {
+	/* 00:00:00, Sun 1 Jan 2021 */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00 }, true },
+	/* 23:59:59, Sat 31 Dec 2120 */
+	{ { 0x59, 0x59, 0x23, 0x07, 0x31, 0x12, 0x99 }, true },
+	/* century bit is ignored */
+	{ { 0x30, 0x15, 0x12, 0x03, 0x15, 0x86, 0x05 }, true },
+	/* all registers are 0xff: no battery */
+	{ { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, false },
+	/* seconds: not BCD */
+	{ { 0x0a, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00 }, false },
+	/* minutes: 60 */
+	{ { 0x00, 0x60, 0x00, 0x01, 0x01, 0x01, 0x00 }, false },
+	/* hours: 24 */
+	{ { 0x00, 0x00, 0x24, 0x01, 0x01, 0x01, 0x00 }, false },
+	/* hours: 12-hour mode */
+	{ { 0x00, 0x00, 0x41, 0x01, 0x01, 0x01, 0x00 }, false },
+	/* day of week: 0 */
+	{ { 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00 }, false },
+	/* day of week: 8 */
+	{ { 0x00, 0x00, 0x00, 0x08, 0x01, 0x01, 0x00 }, false },
+	/* date: 0 */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00 }, false },
+	/* date: 32 */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x32, 0x01, 0x00 }, false },
+	/* month: 0 */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00 }, false },
+	/* month: 13 */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x01, 0x13, 0x00 }, false },
+	/* year: not BCD */
+	{ { 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x1f }, false },
+};
+
+static struct test_data alarm_data[] = {
+	/* 07:30:00, date is masked */
+	{ { 0x00, 0x30, 0x07 }, true },
+	/* mask bits are ignored */
+	{ { 0x80, 0x80 | 0x45, 0x80 | 0x23 }, true },
+	{ { 0x00, 0x60, 0x07 }, false },
+	{ { 0x00, 0x30, 0x24 }, false },
+	{ { 0x00, 0x30, 0x47 }, false },
+	{ { 0xff, 0xff, 0xff }, false },
+};
+
+/* ------------------------------------------------------------------------- */
+
+static uint8_t bcd2dec(uint8_t val)
+{
+	return (val & 0x0f) + (val >> 4) * 10;
+}
+
+static bool ds3231_bcd_valid(uint8_t val, uint8_t min, uint8_t max)
+{
+	if ((val & 0x0f) > 9 || (val >> 4) > 9)
+		return false;
+
+	return bcd2dec(val) >= min && bcd2dec(val) <= max;
+}
+
+static bool ds3231_time_valid(const uint8_t *buf)
+{
+	return ds3231_bcd_valid(buf[0], 0, 59) &&
+	       ds3231_bcd_valid(buf[1], 0, 59) &&
+	       !(buf[2] & DS3231_12H) && ds3231_bcd_valid(buf[2], 0, 23) &&
+	       buf[3] >= 1 && buf[3] <= 7 &&
+	       ds3231_bcd_valid(buf[4], 1, 31) &&
+	       ds3231_bcd_valid(buf[5] & ~DS3231_CENTURY, 1, 12) &&
+	       ds3231_bcd_valid(buf[6], 0, 99);
+}
+
+static bool ds3231_alarm_valid(const uint8_t *buf)
+{
+	return ds3231_bcd_valid(buf[0] & ~DS3231_A1M, 0, 59) &&
+	       ds3231_bcd_valid(buf[1] & ~DS3231_A1M, 0, 59) &&
+	       !(buf[2] & DS3231_12H) &&
+	       ds3231_bcd_valid(buf[2] & ~DS3231_A1M, 0, 23);
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool test_time_valid(void)
+{
+	size_t i;
+
+	printf("%s\n", __func__);
+
+	for (i = 0; i < ARRAY_SIZE(time_data); i++) {
+		if (ds3231_time_valid(time_data[i].regs) != time_data[i].valid)
+			goto err;
+	}
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	fprintf(stderr, "Error inside %lu entry\n", i);
+	return false;
+}
+
+bool test_alarm_valid(void)
+{
+	size_t i;
+
+	printf("%s\n", __func__);
+
+	for (i = 0; i < ARRAY_SIZE(alarm_data); i++) {
+		if (ds3231_alarm_valid(alarm_data[i].regs) !=
+		    alarm_data[i].valid)
+			goto err;
+	}
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	fprintf(stderr, "Error inside %lu entry\n", i);
+	return false;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_time_valid();
+	if (!res)
+		return EXIT_FAILURE;
+
+	res = test_alarm_valid();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
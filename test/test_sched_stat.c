@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof(a[0]))
+
+#define SCHED_HIST_NR			16
+
+struct sched_stat {
+	uint32_t count;
+	uint32_t min;			/* nsec */
+	uint32_t max;			/* nsec */
+	uint64_t sum;			/* nsec */
+	uint16_t hist[SCHED_HIST_NR];	/* last bucket takes all longer ones */
+};
+
+struct test_data {
+	uint64_t ns;
+	int bucket;
+};
+
+static struct test_data test_data[] = {
+	{ 0, 0 },
+	{ 999, 0 },
+	{ 1000, 1 },		/* 1 usec */
+	{ 1999, 1 },
+	{ 2000, 2 },		/* 2..3 usec */
+	{ 3999, 2 },
+	{ 4000, 3 },		/* 4..7 usec */
+	{ 100000, 7 },		/* 100 usec: 64..127 */
+	{ 16383000, 14 },	/* 8192..16383 usec */
+	{ 16384000, 15 },	/* last bucket */
+	{ 900000000, 15 },
+	{ 10000000000ULL, 15 },	/* doesn't fit into 32 bits */
+};
+
+/* ------------------------------------------------------------------------- */
+
+static void sched_stat_add(struct sched_stat *st, uint64_t diff_ns)
+{
+	const uint32_t ns = diff_ns > UINT32_MAX ? UINT32_MAX : diff_ns;
+	const uint32_t us = ns / 1000;
+	int bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	if (bucket >= SCHED_HIST_NR)
+		bucket = SCHED_HIST_NR - 1;
+
+	if (!st->count || ns < st->min)
+		st->min = ns;
+	if (ns > st->max)
+		st->max = ns;
+	st->count++;
+	st->sum += ns;
+	if (st->hist[bucket] < UINT16_MAX)
+		st->hist[bucket]++;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool test_hist_buckets(void)
+{
+	struct sched_stat st;
+	size_t i;
+	int j;
+
+	printf("%s\n", __func__);
+
+	for (i = 0; i < ARRAY_SIZE(test_data); i++) {
+		memset(&st, 0, sizeof(st));
+		sched_stat_add(&st, test_data[i].ns);
+
+		for (j = 0; j < SCHED_HIST_NR; j++) {
+			if (st.hist[j] != (j == test_data[i].bucket))
+				goto err;
+		}
+	}
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	fprintf(stderr, "Error inside %lu entry\n", i);
+	return false;
+}
+
+bool test_min_max_mean(void)
+{
+	struct sched_stat st;
+
+	printf("%s\n", __func__);
+
+	memset(&st, 0, sizeof(st));
+	sched_stat_add(&st, 5000);
+	sched_stat_add(&st, 1000);
+	sched_stat_add(&st, 9000);
+
+	if (st.count != 3 || st.min != 1000 || st.max != 9000 ||
+	    st.sum / st.count != 5000) {
+		printf("[FAIL]\n");
+		fprintf(stderr, "count %u, min %u, max %u, sum %llu\n",
+			st.count, st.min, st.max, (unsigned long long)st.sum);
+		return false;
+	}
+
+	printf("[SUCCESS]\n");
+
+	return true;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_hist_buckets();
+	if (!res)
+		return EXIT_FAILURE;
+
+	res = test_min_max_mean();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TASK_NR			3
+#define SCHED_STATIC_NR		0
+#define SWTIMER_HW_OVERFLOW	5
+#define READ_ONCE(x)		(x)
+
+struct task {
+	int period;			/* msec; 0 if task is not periodic */
+	int remaining;			/* msec till periodic task is ready */
+};
+
+static struct task task_list[TASK_NR];
+static int ready_count[TASK_NR];
+
+static void sched_set_ready(int task_id)
+{
+	ready_count[task_id - 1]++;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Same as in core/sched.c */
+static void sched_tick(int msec)
+{
+	int i;
+
+	for (i = SCHED_STATIC_NR; i < TASK_NR; ++i) {
+		struct task *task = &task_list[i];
+		int period = READ_ONCE(task->period);
+
+		if (!period)
+			continue;
+
+		task->remaining -= msec;
+		if (task->remaining > 0)
+			continue;
+
+		/* Keep the phase: don't drift by the late part of the tick */
+		task->remaining += period;
+		if (task->remaining <= 0)
+			task->remaining = period;
+		sched_set_ready(i + 1);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Run @p ticks; return ready count of task @p idx and its first ready tick */
+static int run_ticks(int ticks, int idx, int *first)
+{
+	int i;
+
+	*first = 0;
+	for (i = 1; i <= ticks; ++i) {
+		int before = ready_count[idx];
+
+		sched_tick(SWTIMER_HW_OVERFLOW);
+		if (!*first && ready_count[idx] != before)
+			*first = i;
+	}
+
+	return ready_count[idx];
+}
+
+bool test_period_phase(void)
+{
+	int first;
+
+	printf("%s\n", __func__);
+
+	/* 100 msec, no phase: at 5 (first tick), 100, 200, ... 1000 msec */
+	task_list[0].period = 100;
+	task_list[0].remaining = 0;
+	/* 100 msec, 50 msec phase: at 50, 150, ... 950 msec */
+	task_list[1].period = 100;
+	task_list[1].remaining = 50;
+	/* Shorter than tick: each tick */
+	task_list[2].period = 3;
+	task_list[2].remaining = 0;
+
+	if (run_ticks(200, 0, &first) != 11 || first != 1)
+		goto err;
+	if (ready_count[1] != 10)
+		goto err;
+	if (ready_count[2] != 200)
+		goto err;
+
+	/* Task 1 phase is kept: 10 ticks till the next run of it */
+	if (task_list[1].remaining != 50)
+		goto err;
+
+	/* Not periodic anymore: never set ready */
+	task_list[0].period = 0;
+	if (run_ticks(100, 0, &first) != 11 || first != 0)
+		goto err;
+
+	printf("[SUCCESS]\n");
+
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	return false;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_period_phase();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
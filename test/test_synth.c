@@ -0,0 +1,263 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BIT(n)			(1 << (n))
+
+#define SYNTH_SAMPLE_RATE	16000	/* Hz */
+#define SYNTH_BLOCK_LEN		32	/* samples per DMA half-buffer */
+#define SYNTH_VOLUME_MAX	255
+
+#define MS_TO_SAMPLES(ms)	((ms) * SYNTH_SAMPLE_RATE / 1000)
+#define BLOCKS_PER_SEC		(SYNTH_SAMPLE_RATE / SYNTH_BLOCK_LEN)
+#define WAVE_BITS		8
+#define WAVE_LEN		BIT(WAVE_BITS)
+#define PHASE_PER_HZ		((uint32_t)(0x100000000ULL / SYNTH_SAMPLE_RATE))
+#define ENV_MAX			256
+#define ENV_SUSTAIN		160
+#define ATTACK_LEN		MS_TO_SAMPLES(10)
+#define DECAY_LEN		MS_TO_SAMPLES(150)
+#define RELEASE_LEN		MS_TO_SAMPLES(30)
+#define DAC_MID			2048
+
+/* Max. 2nd difference of samples (click detector); 880 Hz sine gives ~245 */
+#define MAX_CURVE		300
+
+struct synth {
+	const int16_t *wave;
+	uint8_t wave_shift;
+	uint32_t phase;
+	uint32_t phase_inc;
+	uint32_t pos;
+	uint32_t len;
+	uint32_t gain;
+	uint8_t volume;
+	uint8_t vol_target;
+	uint16_t vol_period;
+	uint16_t vol_cnt;
+	uint8_t idle;
+};
+
+/* Code under test (copied from src/drivers/synth.c) */
+static const int16_t wave_sine[WAVE_LEN] = {
+	    0,    50,   100,   151,   201,   251,   300,   350,
+	  399,   449,   497,   546,   594,   642,   690,   737,
+	  783,   830,   875,   920,   965,  1009,  1052,  1095,
+	 1137,  1179,  1219,  1259,  1299,  1337,  1375,  1411,
+	 1447,  1483,  1517,  1550,  1582,  1614,  1644,  1674,
+	 1702,  1729,  1756,  1781,  1805,  1828,  1850,  1871,
+	 1891,  1910,  1927,  1944,  1959,  1973,  1986,  1997,
+	 2008,  2017,  2025,  2032,  2037,  2041,  2045,  2046,
+	 2047,  2046,  2045,  2041,  2037,  2032,  2025,  2017,
+	 2008,  1997,  1986,  1973,  1959,  1944,  1927,  1910,
+	 1891,  1871,  1850,  1828,  1805,  1781,  1756,  1729,
+	 1702,  1674,  1644,  1614,  1582,  1550,  1517,  1483,
+	 1447,  1411,  1375,  1337,  1299,  1259,  1219,  1179,
+	 1137,  1095,  1052,  1009,   965,   920,   875,   830,
+	  783,   737,   690,   642,   594,   546,   497,   449,
+	  399,   350,   300,   251,   201,   151,   100,    50,
+	    0,   -50,  -100,  -151,  -201,  -251,  -300,  -350,
+	 -399,  -449,  -497,  -546,  -594,  -642,  -690,  -737,
+	 -783,  -830,  -875,  -920,  -965, -1009, -1052, -1095,
+	-1137, -1179, -1219, -1259, -1299, -1337, -1375, -1411,
+	-1447, -1483, -1517, -1550, -1582, -1614, -1644, -1674,
+	-1702, -1729, -1756, -1781, -1805, -1828, -1850, -1871,
+	-1891, -1910, -1927, -1944, -1959, -1973, -1986, -1997,
+	-2008, -2017, -2025, -2032, -2037, -2041, -2045, -2046,
+	-2047, -2046, -2045, -2041, -2037, -2032, -2025, -2017,
+	-2008, -1997, -1986, -1973, -1959, -1944, -1927, -1910,
+	-1891, -1871, -1850, -1828, -1805, -1781, -1756, -1729,
+	-1702, -1674, -1644, -1614, -1582, -1550, -1517, -1483,
+	-1447, -1411, -1375, -1337, -1299, -1259, -1219, -1179,
+	-1137, -1095, -1052, -1009,  -965,  -920,  -875,  -830,
+	 -783,  -737,  -690,  -642,  -594,  -546,  -497,  -449,
+	 -399,  -350,  -300,  -251,  -201,  -151,  -100,   -50,
+};
+
+static uint32_t synth_env(const struct synth *obj, uint32_t pos)
+{
+	uint32_t env;
+
+	if (pos >= obj->len)
+		return 0;
+
+	if (pos < ATTACK_LEN)
+		env = ENV_MAX * pos / ATTACK_LEN;
+	else if (pos < ATTACK_LEN + DECAY_LEN)
+		env = ENV_MAX - (ENV_MAX - ENV_SUSTAIN) *
+		      (pos - ATTACK_LEN) / DECAY_LEN;
+	else
+		env = ENV_SUSTAIN;
+
+	if (obj->len - pos < RELEASE_LEN)
+		env = env * (obj->len - pos) / RELEASE_LEN;
+
+	return env;
+}
+
+static void synth_ramp_step(struct synth *obj)
+{
+	if (obj->volume == obj->vol_target)
+		return;
+
+	if (--obj->vol_cnt)
+		return;
+
+	obj->vol_cnt = obj->vol_period;
+	if (obj->volume < obj->vol_target)
+		obj->volume++;
+	else
+		obj->volume--;
+}
+
+static void synth_fill(struct synth *obj, uint16_t *buf)
+{
+	const uint32_t gain_start = obj->gain;
+	uint32_t gain_end;
+	int32_t gain, step;
+	int i;
+
+	if (obj->pos < obj->len)
+		obj->pos += SYNTH_BLOCK_LEN;
+	synth_ramp_step(obj);
+	gain_end = synth_env(obj, obj->pos) * obj->volume;
+
+	gain = gain_start;
+	step = ((int32_t)gain_end - (int32_t)gain_start) / SYNTH_BLOCK_LEN;
+	for (i = 0; i < SYNTH_BLOCK_LEN; ++i) {
+		const int32_t s = obj->wave[obj->phase >> obj->wave_shift];
+
+		buf[i] = DAC_MID + ((s * gain) >> 16);
+		obj->phase += obj->phase_inc;
+		gain += step;
+	}
+
+	obj->gain = gain_end;
+	if (gain_start == 0 && gain_end == 0 && obj->pos >= obj->len) {
+		if (obj->idle < 2)
+			obj->idle++;
+	} else {
+		obj->idle = 0;
+	}
+}
+
+/* Test harness */
+static uint16_t last = DAC_MID;
+static int last_diff;
+static int crossings;
+
+static void play(struct synth *obj, uint16_t freq, uint16_t duration)
+{
+	obj->phase_inc = freq * PHASE_PER_HZ;
+	obj->len = freq ? MS_TO_SAMPLES((uint32_t)duration) : 0;
+	obj->pos = 0;
+}
+
+/* Render @p ms of sound, checking DAC codes range and clicks */
+static bool render(struct synth *obj, uint32_t ms)
+{
+	uint16_t buf[SYNTH_BLOCK_LEN];
+	uint32_t blocks = MS_TO_SAMPLES(ms) / SYNTH_BLOCK_LEN;
+	int i;
+
+	while (blocks--) {
+		synth_fill(obj, buf);
+		for (i = 0; i < SYNTH_BLOCK_LEN; ++i) {
+			const int diff = buf[i] - last;
+
+			if (buf[i] > 4095 || abs(diff - last_diff) > MAX_CURVE) {
+				fprintf(stderr, "Bad sample: %u after %u\n",
+					buf[i], last);
+				return false;
+			}
+			last_diff = diff;
+			if (last < DAC_MID && buf[i] >= DAC_MID)
+				crossings++;
+			last = buf[i];
+		}
+	}
+
+	return true;
+}
+
+static bool test_notes(void)
+{
+	struct synth obj = {
+		.wave = wave_sine,
+		.wave_shift = 32 - WAVE_BITS,
+		.volume = SYNTH_VOLUME_MAX,
+		.vol_target = SYNTH_VOLUME_MAX,
+	};
+
+	/* 440 Hz for 200 ms: 88 periods */
+	play(&obj, 440, 200);
+	crossings = 0;
+	if (!render(&obj, 200))
+		return false;
+	if (crossings < 87 || crossings > 89) {
+		fprintf(stderr, "440 Hz: %d periods\n", crossings);
+		return false;
+	}
+
+	/* Next note cuts off the current one in the middle */
+	play(&obj, 880, 500);
+	if (!render(&obj, 100))
+		return false;
+	play(&obj, 660, 100);
+	if (!render(&obj, 100))
+		return false;
+
+	/* Note is over: output rests at mid-scale and engine goes idle */
+	if (!render(&obj, 10))
+		return false;
+	if (obj.idle < 2 || last != DAC_MID) {
+		fprintf(stderr, "Not idle: %u, last %u\n", obj.idle, last);
+		return false;
+	}
+
+	/* Silence request fades the note out */
+	play(&obj, 440, 1000);
+	if (!render(&obj, 300))
+		return false;
+	play(&obj, 0, 0);
+	if (!render(&obj, 10))
+		return false;
+
+	return obj.idle == 2 && last == DAC_MID;
+}
+
+static bool test_ramp(void)
+{
+	struct synth obj = {
+		.wave = wave_sine,
+		.wave_shift = 32 - WAVE_BITS,
+		.volume = 32,
+		.vol_target = SYNTH_VOLUME_MAX,
+	};
+	uint32_t period = 1000 * BLOCKS_PER_SEC / 1000 /
+			  (SYNTH_VOLUME_MAX - 32);
+
+	/* Ramp 32 -> 255 in 1 sec */
+	obj.vol_period = period;
+	obj.vol_cnt = period;
+	play(&obj, 440, 2000);
+	if (!render(&obj, 800) || obj.volume == SYNTH_VOLUME_MAX)
+		return false;
+	if (!render(&obj, 200) || obj.volume != SYNTH_VOLUME_MAX)
+		return false;
+
+	return true;
+}
+
+int main(void)
+{
+	if (!test_notes() || !test_ramp()) {
+		printf("[FAIL]\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("[SUCCESS]\n");
+	return EXIT_SUCCESS;
+}
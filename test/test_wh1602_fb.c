@@ -0,0 +1,306 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_1			0
+#define LINE_2			0x1
+#define WH1602_ROWS		2
+#define WH1602_COLS		16
+#define DDRAM_LINE_1_ADDR	0x00
+#define DDRAM_LINE_2_ADDR	0x40
+#define DDRAM_LINE_LEN		0x28
+#define FB_MAX_GAP		1
+
+struct wh1602 {
+	uint8_t addr;
+	uint8_t ddram[WH1602_ROWS][WH1602_COLS];
+	uint8_t fb[WH1602_ROWS][WH1602_COLS];
+};
+
+/* Emulated LCD controller */
+static uint8_t lcd_ddram[0x80];
+static uint8_t lcd_ac;
+static int lcd_cmds;
+static int lcd_writes;
+static int lcd_room = -1;	/* bytes DMA queue can take; -1: unlimited */
+
+static int lcd_queue(void)
+{
+	if (lcd_room == 0)
+		return -EBUSY;
+	if (lcd_room > 0)
+		lcd_room--;
+	return 0;
+}
+
+static int lcd_set_address(uint8_t addr)
+{
+	if (lcd_queue())
+		return -EBUSY;
+	lcd_ac = addr;
+	lcd_cmds++;
+	return 0;
+}
+
+static int lcd_write(uint8_t data)
+{
+	if (lcd_queue())
+		return -EBUSY;
+	lcd_ddram[lcd_ac++] = data;
+	if (lcd_ac == DDRAM_LINE_1_ADDR + DDRAM_LINE_LEN)
+		lcd_ac = DDRAM_LINE_2_ADDR;
+	else if (lcd_ac == DDRAM_LINE_2_ADDR + DDRAM_LINE_LEN)
+		lcd_ac = DDRAM_LINE_1_ADDR;
+	lcd_writes++;
+	return 0;
+}
+
+/* Code under test (copied from src/drivers/wh1602.c) */
+static uint8_t *wh1602_ddram_cell(struct wh1602 *obj, uint8_t addr)
+{
+	if (addr >= DDRAM_LINE_2_ADDR) {
+		addr -= DDRAM_LINE_2_ADDR;
+		return addr < WH1602_COLS ? &obj->ddram[LINE_2][addr] : NULL;
+	}
+
+	return addr < WH1602_COLS ? &obj->ddram[LINE_1][addr] : NULL;
+}
+
+static void wh1602_addr_inc(struct wh1602 *obj)
+{
+	obj->addr++;
+	if (obj->addr == DDRAM_LINE_1_ADDR + DDRAM_LINE_LEN)
+		obj->addr = DDRAM_LINE_2_ADDR;
+	else if (obj->addr == DDRAM_LINE_2_ADDR + DDRAM_LINE_LEN)
+		obj->addr = DDRAM_LINE_1_ADDR;
+}
+
+static int wh1602_set_address(struct wh1602 *obj, uint8_t addr)
+{
+	int ret;
+
+	ret = lcd_set_address(addr);
+	if (ret)
+		return ret;
+
+	obj->addr = addr;
+	return 0;
+}
+
+static int wh1602_write_char(struct wh1602 *obj, uint8_t data)
+{
+	uint8_t *cell;
+	int ret;
+
+	ret = lcd_write(data);
+	if (ret)
+		return ret;
+
+	cell = wh1602_ddram_cell(obj, obj->addr);
+	if (cell)
+		*cell = data;
+	wh1602_addr_inc(obj);
+	return 0;
+}
+
+static int wh1602_fb_flush(struct wh1602 *obj)
+{
+	static const uint8_t line_addr[WH1602_ROWS] = {
+		DDRAM_LINE_1_ADDR,
+		DDRAM_LINE_2_ADDR,
+	};
+	int line, col;
+	int ret = 0;
+
+	for (line = 0; line < WH1602_ROWS; ++line) {
+		for (col = 0; col < WH1602_COLS; ++col) {
+			const uint8_t addr = line_addr[line] + col;
+			int gap = addr - obj->addr;
+
+			if (obj->fb[line][col] == obj->ddram[line][col])
+				continue;
+
+			if (gap < 0 || gap > FB_MAX_GAP ||
+			    obj->addr < line_addr[line]) {
+				ret = wh1602_set_address(obj, addr);
+				if (ret)
+					goto out;
+			} else {
+				while (obj->addr != addr) {
+					const uint8_t c = obj->fb[line]
+						[obj->addr - line_addr[line]];
+
+					ret = wh1602_write_char(obj, c);
+					if (ret)
+						goto out;
+				}
+			}
+
+			ret = wh1602_write_char(obj, obj->fb[line][col]);
+			if (ret)
+				goto out;
+		}
+	}
+
+out:
+	return ret;
+}
+
+/* Test harness */
+struct test_data {
+	const char *old[WH1602_ROWS];
+	const char *new[WH1602_ROWS];
+	int cmds;	/* expected number of SET_ADDRESS commands */
+	int writes;	/* expected number of data writes */
+};
+
+static struct test_data test_data[] = {
+	{ /* nothing changed */
+	  { "12:34  t+23.5  *", "MON 19 JUL 2021 " },
+	  { "12:34  t+23.5  *", "MON 19 JUL 2021 " },
+	  0, 0 },
+	{ /* one digit changed */
+	  { "12:34  t+23.5  *", "MON 19 JUL 2021 " },
+	  { "12:35  t+23.5  *", "MON 19 JUL 2021 " },
+	  1, 1 },
+	{ /* two cells with 1 unchanged cell in between: single run */
+	  { "12:59           ", "                " },
+	  { "13:09           ", "                " },
+	  1, 3 },
+	{ /* two cells far apart: two SET_ADDRESS */
+	  { "12:34  t+23.5   ", "                " },
+	  { "12:35  t+23.6   ", "                " },
+	  2, 2 },
+	{ /* both lines changed */
+	  { "23:59           ", "MON 19 JUL 2021 " },
+	  { "00:00           ", "TUE 20 JUL 2021 " },
+	  2, 11 },
+	{ /* full redraw from blank screen */
+	  { "                ", "                " },
+	  { "ABCDEFGHIJKLMNOP", "abcdefghijklmnop" },
+	  2, 32 },
+};
+
+static void fill(uint8_t buf[WH1602_ROWS][WH1602_COLS], const char **lines)
+{
+	int i;
+
+	for (i = 0; i < WH1602_ROWS; ++i)
+		memcpy(buf[i], lines[i], WH1602_COLS);
+}
+
+static bool test_wh1602_fb(void)
+{
+	struct wh1602 obj;
+	size_t i;
+	int line;
+
+	for (i = 0; i < sizeof(test_data) / sizeof(test_data[0]); i++) {
+		struct test_data *t = &test_data[i];
+
+		/* Display shows old frame */
+		memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+		for (line = 0; line < WH1602_ROWS; ++line)
+			memcpy(lcd_ddram + line * DDRAM_LINE_2_ADDR,
+			       t->old[line], WH1602_COLS);
+		fill(obj.ddram, t->old);
+		obj.addr = lcd_ac = DDRAM_LINE_1_ADDR + WH1602_COLS;
+		lcd_cmds = lcd_writes = 0;
+
+		fill(obj.fb, t->new);
+		wh1602_fb_flush(&obj);
+
+		for (line = 0; line < WH1602_ROWS; ++line) {
+			if (memcmp(lcd_ddram + line * DDRAM_LINE_2_ADDR,
+				   t->new[line], WH1602_COLS))
+				goto err;
+			if (memcmp(obj.ddram[line], t->new[line],
+				   WH1602_COLS))
+				goto err;
+		}
+
+		if (lcd_cmds != t->cmds || lcd_writes != t->writes)
+			goto err;
+	}
+
+	printf("[SUCCESS]\n");
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	fprintf(stderr, "Test case %zu: cmds = %d, writes = %d\n", i,
+		lcd_cmds, lcd_writes);
+	return false;
+}
+
+/* Queue gets full in the middle of flush: next flush sends the rest */
+static bool test_wh1602_fb_busy(void)
+{
+	static const char *old[WH1602_ROWS] = {
+		"12:34  t+23.5   ", "MON 19 JUL 2021 "
+	};
+	static const char *new[WH1602_ROWS] = {
+		"13:45  t+24.6  *", "TUE 20 JUL 2021 "
+	};
+	struct wh1602 obj;
+	int line, ret;
+
+	printf("%s\n", __func__);
+
+	memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+	for (line = 0; line < WH1602_ROWS; ++line)
+		memcpy(lcd_ddram + line * DDRAM_LINE_2_ADDR, old[line],
+		       WH1602_COLS);
+	fill(obj.ddram, old);
+	obj.addr = lcd_ac = DDRAM_LINE_1_ADDR + WH1602_COLS;
+	fill(obj.fb, new);
+
+	lcd_room = 5;
+	ret = wh1602_fb_flush(&obj);
+	if (ret != -EBUSY)
+		goto err;
+
+	/* Shadow DDRAM must only have what was actually sent */
+	for (line = 0; line < WH1602_ROWS; ++line) {
+		if (memcmp(lcd_ddram + line * DDRAM_LINE_2_ADDR,
+			   obj.ddram[line], WH1602_COLS))
+			goto err;
+	}
+
+	lcd_room = -1;
+	ret = wh1602_fb_flush(&obj);
+	if (ret)
+		goto err;
+
+	for (line = 0; line < WH1602_ROWS; ++line) {
+		if (memcmp(lcd_ddram + line * DDRAM_LINE_2_ADDR, new[line],
+			   WH1602_COLS))
+			goto err;
+	}
+
+	printf("[SUCCESS]\n");
+	return true;
+
+err:
+	printf("[FAIL]\n");
+	return false;
+}
+
+int main(void)
+{
+	bool res;
+
+	res = test_wh1602_fb();
+	if (!res)
+		return EXIT_FAILURE;
+
+	res = test_wh1602_fb_busy();
+	if (!res)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}